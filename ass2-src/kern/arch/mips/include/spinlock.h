@@ -46,6 +46,9 @@ SPINLOCK_INLINE
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 SPINLOCK_INLINE
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+SPINLOCK_INLINE
+spinlock_data_t spinlock_data_cas(volatile spinlock_data_t *sd,
+				  unsigned oldval, unsigned newval);
 
 ////////////////////////////////////////////////////////////
 
@@ -118,5 +121,35 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+/*
+ * Compare-and-swap: if *SD is OLDVAL, atomically replace it with
+ * NEWVAL. Return the value *SD had; the swap happened if that is
+ * OLDVAL. Also built on LL/SC, but unlike testandset this loops
+ * until the SC succeeds rather than reporting a spurious failure.
+ */
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_cas(volatile spinlock_data_t *sd,
+		  unsigned oldval, unsigned newval)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *sd */
+		"bne %0, %3, 2f;"	/*   give up if x != oldval */
+		"move %1, %4;"		/*   y = newval */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd), "r" (oldval), "r" (newval)
+		: "memory");
+	return x;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
@@ -12,30 +12,38 @@
 #include <vnode.h>
 #include <synch.h>
 
+struct proc;
+
 
 /*
- * Put your function declarations and data types here ...
+ * Each process has its own descriptor table (fd_table in struct
+ * proc), an array of pointers to opened_file objects. An opened_file
+ * holds the vnode, the access mode and the seek offset, which are
+ * shared by every descriptor that refers to it (after dup2, say). It
+ * is reference-counted and goes away when the last descriptor is
+ * closed.
+ *
+ * The refcount is changed with compare-and-swap rather than under a
+ * lock, and each process only touches its own descriptor table, so
+ * close and dup2 in one process never wait for another.
  */
 
-struct file_descriptor {
-    int             index;
-    int             mode;
-};
-
 struct opened_file {
     struct vnode*   of_vnode;
-    off_t           of_offset;
-    int             of_refcount;
+    off_t           of_offset;      // protected by of_lock
+    int             of_mode;        // O_RDONLY, O_WRONLY or O_RDWR
+    volatile spinlock_data_t of_refcount;   // atomic
     struct lock*    of_lock;
 };
 
-struct opened_file** of_table;
-struct lock* dup_lock;
+int of_create(char* filename, int flags, mode_t mode, struct opened_file** of);
+void of_incref(struct opened_file* of);
+void of_decref(struct opened_file* of);
 
-int fd_check(int fd);
-int std_fd_check(int fd);
-int of_create(const char* filename, int flags, mode_t mode, struct opened_file** of);
-int file_init(void);
+int fd_table_init(struct proc* proc);
+void fd_table_destroy(struct proc* proc);
+int fd_get(int fd, struct opened_file** of);
+int fd_place(struct opened_file* of, int* fd);
 
 int sys_open(const char* filename, int flags, mode_t mode, int* err);
 ssize_t sys_read(int fd, void *buf, size_t nbytes, int* err);
@@ -73,7 +73,7 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 
 	/* add more material here as needed */
-	struct file_descriptor fd_table[OPEN_MAX];
+	struct opened_file *fd_table[OPEN_MAX];	/* open files, by fd */
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
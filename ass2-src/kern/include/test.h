@@ -87,6 +87,7 @@ int writestress2(int, char **);
 int longstress(int, char **);
 int createstress(int, char **);
 int printfile(int, char **);
+int fdbench(int, char **);
 
 /* other tests */
 int kmalloctest(int, char **);
@@ -138,5 +138,13 @@ int uiomovezeros(size_t len, struct uio *uio);
 void uio_kinit(struct iovec *, struct uio *,
 	       void *kbuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * The same, except for a buffer coming from user space. The transfer
+ * goes straight to or from the user's memory, in the current
+ * process's address space, with no kernel buffer in between.
+ */
+void uio_uinit(struct iovec *, struct uio *,
+	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -577,6 +577,7 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[fdb] Open/close benchmark          ",
 	NULL
 };
 
@@ -704,6 +705,7 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "fdb",	fdbench },
 
 	{ NULL, NULL }
 };
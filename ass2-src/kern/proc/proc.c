@@ -62,6 +62,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	int fd;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -81,6 +82,9 @@ proc_create(const char *name)
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		proc->fd_table[fd] = NULL;
+	}
 
 	return proc;
 }
@@ -116,6 +120,7 @@ proc_destroy(struct proc *proc)
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
 	}
+	fd_table_destroy(proc);
 
 	/* VM fields */
 	if (proc->p_addrspace) {
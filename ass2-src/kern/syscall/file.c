@@ -17,71 +17,115 @@
 #include <proc.h>
 
 
-#define TABLE_MAX OPEN_MAX*2
-
-int fd_check(int fd) {
-    if (fd<3 || fd>=OPEN_MAX) return 1;
-    if (curproc->fd_table[fd].index==0) return 1;
-    if (of_table[curproc->fd_table[fd].index]==NULL) return 1;
-    return 0;
-}
-
-int std_fd_check(int fd) {
-    if (fd<0 || fd>=OPEN_MAX) return 1;
-    if (fd!=0 && curproc->fd_table[fd].index==0) return 1;
-    if (of_table[curproc->fd_table[fd].index]==NULL) return 1;
-    return 0;
-}
-
-int of_create(const char* filename, int flags, mode_t mode, struct opened_file** of) {
+// create an opened_file with one reference
+int of_create(char* filename, int flags, mode_t mode, struct opened_file** of) {
     // check file open correctly
     struct vnode* new_node;
-    int openret = vfs_open((char*)filename, flags, mode, &new_node);
+    int openret = vfs_open(filename, flags, mode, &new_node);
     if (openret)
         return openret;
 
     // check of malloc ok
     *of = kmalloc(sizeof(struct opened_file));
-    if (*of) {
-        (*of)->of_refcount = 1;
-        (*of)->of_offset = 0;
-        (*of)->of_lock = lock_create("of_lock");
-        (*of)->of_vnode = new_node;
-    } else {
+    if (*of == NULL) {
+        vfs_close(new_node);
+        return ENOMEM;
+    }
+    (*of)->of_lock = lock_create("of_lock");
+    if ((*of)->of_lock == NULL) {
+        kfree(*of);
         vfs_close(new_node);
-        kfree(new_node);
         return ENOMEM;
     }
+    (*of)->of_vnode = new_node;
+    (*of)->of_offset = 0;
+    (*of)->of_mode = flags & O_ACCMODE;
+    spinlock_data_set(&(*of)->of_refcount, 1);
 
     return 0;
 }
 
-int file_init(void) {
-    of_table = kmalloc(sizeof(struct opened_file*)*TABLE_MAX);
-    if (of_table == NULL) 
-        return ENOMEM;
-    memset(of_table, 0, TABLE_MAX*sizeof(struct opened_file*));
-    // connect to console std(in/out/err)
-    char c0[] = "con:";
-    char c1[] = "con:";
-    char c2[] = "con:";
-    int r0 = of_create(c0, O_RDONLY, 0644, &of_table[0]);
-    int r1 = of_create(c1, O_WRONLY, 0644, &of_table[1]);
-    int r2 = of_create(c2, O_WRONLY, 0644, &of_table[2]);
-    if (r0) return r0;
-    if (r1) return r1;
-    if (r2) return r2;
-    of_table[0]->of_refcount = 0;
-    of_table[1]->of_refcount = 0;
-    of_table[2]->of_refcount = 0;
-    dup_lock = lock_create("dup_lock");
-    if (dup_lock == NULL) return ENOMEM;
+void of_incref(struct opened_file* of) {
+    spinlock_data_t old;
 
+    do {
+        old = spinlock_data_get(&of->of_refcount);
+        KASSERT(old > 0);
+    } while (spinlock_data_cas(&of->of_refcount, old, old + 1) != old);
+}
+
+// drop a reference; whoever drops the last one closes the file
+void of_decref(struct opened_file* of) {
+    spinlock_data_t old;
+
+    do {
+        old = spinlock_data_get(&of->of_refcount);
+        KASSERT(old > 0);
+    } while (spinlock_data_cas(&of->of_refcount, old, old - 1) != old);
+
+    if (old == 1) {
+        vfs_close(of->of_vnode);
+        lock_destroy(of->of_lock);
+        kfree(of);
+    }
+}
+
+// connect a new process's fd 0, 1 and 2 to the console
+int fd_table_init(struct proc* proc) {
+    static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+    char path[5];
+    int fd, result;
+
+    for (fd=0; fd<3; fd++) {
+        KASSERT(proc->fd_table[fd] == NULL);
+        // vfs_open may modify the path
+        strcpy(path, "con:");
+        result = of_create(path, modes[fd], 0644, &proc->fd_table[fd]);
+        if (result) {
+            fd_table_destroy(proc);
+            return result;
+        }
+    }
     return 0;
 }
 
+// close everything a process has open
+void fd_table_destroy(struct proc* proc) {
+    int fd;
 
-// return val > 2 when success
+    for (fd=0; fd<OPEN_MAX; fd++) {
+        if (proc->fd_table[fd] != NULL) {
+            of_decref(proc->fd_table[fd]);
+            proc->fd_table[fd] = NULL;
+        }
+    }
+}
+
+// look up an fd in the current process
+int fd_get(int fd, struct opened_file** of) {
+    if (fd<0 || fd>=OPEN_MAX || curproc->fd_table[fd]==NULL)
+        return EBADF;
+    *of = curproc->fd_table[fd];
+    return 0;
+}
+
+// put an opened_file in the lowest free fd; consumes the reference
+int fd_place(struct opened_file* of, int* fd) {
+    int fd_index;
+
+    for (fd_index=0; fd_index<OPEN_MAX; fd_index++)
+        if (curproc->fd_table[fd_index] == NULL) {
+            curproc->fd_table[fd_index] = of;
+            *fd = fd_index;
+            return 0;
+        }
+
+    // full fd_table
+    return EMFILE;
+}
+
+
+// return val >= 0 when success
 // return val < 0 when fail
 int sys_open(const char* filename, int flags, mode_t mode, int* err) {
     // check filename
@@ -97,54 +141,56 @@ int sys_open(const char* filename, int flags, mode_t mode, int* err) {
         return -1;
     }
 
-    int index;
-
-    // check enough of_table
-    for (index=0; index<TABLE_MAX; index++)
-        if (of_table[index]==0)
-            break;
-    if (index == TABLE_MAX) {
-        *err = ENFILE;
+    // copy in the filename (vfs_open may also modify it)
+    char* path = kmalloc(PATH_MAX);
+    if (path == NULL) {
+        *err = ENOMEM;
+        return -1;
+    }
+    int result = copyinstr((const_userptr_t)filename, path, PATH_MAX, NULL);
+    if (result) {
+        kfree(path);
+        *err = result;
         return -1;
     }
 
     // of_create fail
-    int temp = of_create(filename, flags, mode, &of_table[index]);
-    if (temp) {
-        *err = temp;
+    struct opened_file* of;
+    result = of_create(path, flags, mode, &of);
+    kfree(path);
+    if (result) {
+        *err = result;
         return -1;
     }
 
     // set append mode if required
     if (flags & O_APPEND) {
         struct stat info;
-        off_t ret;
-        ret = VOP_STAT(of_table[index]->of_vnode, &info);
-        if (ret) {
-            *err = ret;
+        result = VOP_STAT(of->of_vnode, &info);
+        if (result) {
+            of_decref(of);
+            *err = result;
             return -1;
         }
-        of_table[index]->of_offset = info.st_size;
+        of->of_offset = info.st_size;
     }
 
-    int fd_index;
-    for (fd_index=3; fd_index<OPEN_MAX; fd_index++)
-        if (curproc->fd_table[fd_index].index == 0) {
-            curproc->fd_table[fd_index].index = index;
-            curproc->fd_table[fd_index].mode  = baseflags;
-            return fd_index;
-        }
-
-    // full fd_table
-    *err = EMFILE;
-    return -1;
+    int fd;
+    result = fd_place(of, &fd);
+    if (result) {
+        of_decref(of);
+        *err = result;
+        return -1;
+    }
+    return fd;
 }
 
 // return readed bytes when success
 // return val < 0 when fail
 ssize_t sys_read(int fd, void *buf, size_t nbytes, int* err) {
 	// handle bad reference
-	if (fd < 0 || fd >= OPEN_MAX) {
+	struct opened_file * of;
+	if (fd_get(fd, &of)) {
         *err = EBADF;
         return -1;
     }
@@ -155,62 +201,35 @@ ssize_t sys_read(int fd, void *buf, size_t nbytes, int* err) {
         return -1;
     }
 
-    // check of_table
-	struct file_descriptor * fdp = &(curproc->fd_table[fd]);
-    if(of_table[fdp->index] == NULL) {
-        *err = EBADF;
-        return -1;
-    }
-
 	//Check the premission
-	if(fdp->mode == O_WRONLY) {
+	if(of->of_mode == O_WRONLY) {
         *err = EBADF;
         return -1;
     }
 
-	struct opened_file * of = of_table[fdp->index];
-
 	//for debug
 	KASSERT(of != NULL); 
 
-	void * kbuf = kmalloc(sizeof(void *) * nbytes);
-	if(kbuf == NULL) {
-        *err = EFAULT;
-        return -1;
-    }
-
 	struct iovec _iovec;
 	struct uio _uio;
 	int result;
 
-	_iovec.iov_ubase = (userptr_t) buf;
-
-    //lock offset and start reading
+    //lock offset and read straight into the userland buffer
 	lock_acquire(of->of_lock);
 
-	uio_kinit(&_iovec, &_uio, kbuf, nbytes, of->of_offset, UIO_READ);
+	uio_uinit(&_iovec, &_uio, (userptr_t) buf, nbytes, of->of_offset, UIO_READ);
 
 	result = VOP_READ(of->of_vnode, &_uio);
 
 	if (result)
 	{
 		lock_release(of->of_lock);
-		kfree(kbuf);
         *err = result;
 		return -1;
 	}
 
     // the length of read
     int len = nbytes - _uio.uio_resid;
-    // copy the kernal buffer to userland buffer
-    result = copyout(kbuf, buf, len);
-
-	kfree(kbuf);
-    if (result && len) {
-        lock_release(of->of_lock);
-        *err = result;
-        return -1;
-    }
     // update offset
 	of->of_offset += len;
 	lock_release(of->of_lock);
@@ -222,7 +241,8 @@ ssize_t sys_read(int fd, void *buf, size_t nbytes, int* err) {
 // return val < 0 when fail
 ssize_t sys_write(int fd, const void *buf, size_t nbytes, int* err) {
 	// handle bad reference
-	if (fd < 0 || fd >= OPEN_MAX) {
+	struct opened_file * of;
+	if (fd_get(fd, &of)) {
         *err = EBADF;
         return -1;
     }
@@ -233,56 +253,28 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes, int* err) {
         return -1;
     }
 
-    // check of_table 
-	struct file_descriptor * fdp = &(curproc->fd_table[fd]);
-
-    if(of_table[fdp->index] == NULL) {
-        *err = EBADF;
-        return -1;
-    }
-
 	//Check the premission
-	if(fdp->mode == O_RDONLY) {
+	if(of->of_mode == O_RDONLY) {
         *err = EBADF;
         return -1;
     }
 
-	struct opened_file * of = of_table[fdp->index];
-
 	//for debug
 	KASSERT(of != NULL); 
 
-	void * kbuf = kmalloc(sizeof(void *) * nbytes);
-	if(kbuf == NULL) {
-        *err = EFAULT;
-        return -1;
-    }
-
-	int result;
-
-    //copy the userland buffer to kernal buffer
-	result = copyin((const_userptr_t) buf, kbuf, nbytes);
-	if (result && nbytes)
-	{
-		kfree(kbuf);
-        *err = result;
-		return -1;
-	}
-
 	struct iovec _iovec;
 	struct uio _uio;
-	_iovec.iov_ubase = (userptr_t) buf;
+	int result;
 
-    //lock the offset and start writing
+    //lock the offset and write straight from the userland buffer
 	lock_acquire(of->of_lock);
 
-	uio_kinit(&_iovec, &_uio, kbuf, nbytes, of->of_offset, UIO_WRITE);
+	uio_uinit(&_iovec, &_uio, (userptr_t) buf, nbytes, of->of_offset, UIO_WRITE);
 	result = VOP_WRITE(of->of_vnode, &_uio);
 
 	if (result)
 	{
 		lock_release(of->of_lock);
-		kfree(kbuf);
         *err = result;
 		return -1;
 	}
@@ -292,7 +284,6 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes, int* err) {
     // update offset
 	of->of_offset += len;
 	lock_release(of->of_lock);
-	kfree(kbuf);
 
 	return len;
 }
@@ -302,24 +293,21 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes, int* err) {
 off_t sys_lseek(int fd, uint64_t offset, int whence, int* err) {
 
     // check fd
-    if (std_fd_check(fd)) {
+    struct opened_file* of;
+    if (fd_get(fd, &of)) {
         *err = EBADF;
         return -1;
     }
-    if (fd_check(fd)) {
-        *err = ESPIPE;
-        return -1;
-    }
 
     // check is seekable or not
-    if (!VOP_ISSEEKABLE(of_table[curproc->fd_table[fd].index]->of_vnode)) {
+    if (!VOP_ISSEEKABLE(of->of_vnode)) {
         *err = ESPIPE;
         return -1;
     }
 
     struct stat info;
     off_t ret;
-    ret = VOP_STAT(of_table[curproc->fd_table[fd].index]->of_vnode, &info);
+    ret = VOP_STAT(of->of_vnode, &info);
     if (ret) {
         *err = ret;
         return -1;
@@ -327,96 +315,73 @@ off_t sys_lseek(int fd, uint64_t offset, int whence, int* err) {
 
     // lock offset and start lseeking
     off_t len = info.st_size;
-    lock_acquire(of_table[curproc->fd_table[fd].index]->of_lock);
+    lock_acquire(of->of_lock);
     switch (whence) {
         case SEEK_SET:
             ret = offset;
             break;
         case SEEK_CUR:
-            ret = of_table[curproc->fd_table[fd].index]->of_offset + offset;
+            ret = of->of_offset + offset;
             break;
         case SEEK_END:
             ret = len + offset;
             break;
         default:
-            lock_release(of_table[curproc->fd_table[fd].index]->of_lock);
+            lock_release(of->of_lock);
             *err = EINVAL;
             return -1;
     }
 
     if (ret<0 || ret>len) {
-        lock_release(of_table[curproc->fd_table[fd].index]->of_lock);
+        lock_release(of->of_lock);
         *err = EINVAL;
         return -1;
     }
 
     // update offset
-    of_table[curproc->fd_table[fd].index]->of_offset = ret;
-    lock_release(of_table[curproc->fd_table[fd].index]->of_lock);
+    of->of_offset = ret;
+    lock_release(of->of_lock);
     return ret;
 }
 
 // return val < 0 when fail
 int sys_close(int fd, int* err) {
     // check fd
-    lock_acquire(dup_lock);
-    if (fd_check(fd)) {
+    struct opened_file* of;
+    if (fd_get(fd, &of)) {
         *err = EBADF;
-        lock_release(dup_lock);
         return -1;
     }
 
-    // reduce the connections by one
-    of_table[curproc->fd_table[fd].index]->of_refcount--;
-
-    // no one openning the file
-    if (of_table[curproc->fd_table[fd].index]->of_refcount==0) {
-        vfs_close(of_table[curproc->fd_table[fd].index]->of_vnode);
-        lock_destroy(of_table[curproc->fd_table[fd].index]->of_lock);
-        of_table[curproc->fd_table[fd].index]->of_offset = 0;
-        of_table[curproc->fd_table[fd].index]->of_vnode = NULL;
-        of_table[curproc->fd_table[fd].index] = NULL;
-        curproc->fd_table[fd].index = 0;
-        curproc->fd_table[fd].mode = 0;
-    }
-
-    lock_release(dup_lock);
+    // take it out of the table and drop the table's reference
+    curproc->fd_table[fd] = NULL;
+    of_decref(of);
     return 0;
 }
 
-// return 0 when success
+// return val >= 0 when success
 // return val < 0 when fail
 int sys_dup2(int from, int to, int* err) {
 
     // check fd
-    lock_acquire(dup_lock);
-    if (std_fd_check(from) || to<0 || to >= OPEN_MAX) {
+    struct opened_file* of;
+    if (fd_get(from, &of) || to<0 || to >= OPEN_MAX) {
         *err = EBADF;
-        lock_release(dup_lock);
         return -1;
     }
 
     // check is the same fd or not
     if (from==to) {
-        lock_release(dup_lock);
         return to;
     }
-    
-    // start dup2
-    if (to<3 || (to>2 && curproc->fd_table[to].index==0)) {
-        of_table[curproc->fd_table[to].index]->of_refcount--;
-        if (of_table[curproc->fd_table[to].index]->of_refcount==0) {
-            vfs_close(of_table[curproc->fd_table[to].index]->of_vnode);
-            lock_destroy(of_table[curproc->fd_table[to].index]->of_lock);
-            of_table[curproc->fd_table[to].index]->of_offset = 0;
-            of_table[curproc->fd_table[to].index]->of_vnode = NULL;
-            of_table[curproc->fd_table[to].index] = NULL;
-        }
-    }
 
-    curproc->fd_table[to].index = curproc->fd_table[from].index;
-    curproc->fd_table[to].mode = curproc->fd_table[from].mode;
-    of_table[curproc->fd_table[to].index]->of_refcount++;
-    lock_release(dup_lock);
+    // start dup2: the new fd gets its own reference; drop the one
+    // it had before, if any
+    of_incref(of);
+    struct opened_file* old = curproc->fd_table[to];
+    curproc->fd_table[to] = of;
+    if (old != NULL) {
+        of_decref(old);
+    }
     return to;
 }
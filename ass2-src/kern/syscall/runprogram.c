@@ -58,23 +58,14 @@ runprogram(char *progname)
 	struct addrspace *as;
 	struct vnode *v;
 	vaddr_t entrypoint, stackptr;
-	int result = 0;
-	if (of_table == NULL)
-		result = -file_init();
+	int result;
+
+	/* Connect stdin, stdout and stderr to the console. */
+	result = fd_table_init(curproc);
 	if (result) {
 		return result;
 	}
-	memset(curproc->fd_table, 0, sizeof(struct file_descriptor)*OPEN_MAX);
-	curproc->fd_table[0].index = 0;
-	curproc->fd_table[0].mode = 0644;
-    of_table[0]->of_refcount++;
-	curproc->fd_table[1].index = 1;
-	curproc->fd_table[1].mode = 0644;
-    of_table[1]->of_refcount++;
-	curproc->fd_table[2].index = 2;
-	curproc->fd_table[2].mode = 0644;
-    of_table[2]->of_refcount++;
-	
+
 	/* Open the file. */
 	result = vfs_open(progname, O_RDONLY, 0, &v);
 	if (result) {
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fdbench: many processes opening, dup'ing and closing files at once.
+ *
+ * Each of NPROCS kernel threads runs in a process of its own, and so
+ * with its own descriptor table, and loops opening the same file,
+ * dup2'ing the fd, and closing both fds. None of that should make
+ * one process wait for another (apart from whatever the file system
+ * does inside vfs_open and vfs_close), so the rate should hold up as
+ * processes are added.
+ *
+ * Usage: fdb [nprocs [iterations [path]]]
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <proc.h>
+#include <synch.h>
+#include <file.h>
+#include <test.h>
+
+#define DEFAULT_NPROCS	8
+#define DEFAULT_ITERS	200
+#define MAX_NPROCS	32
+#define FDB_PATHLEN	64
+
+static struct semaphore *fdb_done;
+static char fdb_path[FDB_PATHLEN];
+static unsigned long fdb_iters;
+static unsigned fdb_errors[MAX_NPROCS];
+
+/*
+ * Open fdb_path in the current process. (vfs_open wants a path it
+ * can scribble on.)
+ */
+static
+int
+fdb_open(int flags, int *fd)
+{
+	char path[FDB_PATHLEN];
+	struct opened_file *of;
+	int result;
+
+	strcpy(path, fdb_path);
+	result = of_create(path, flags, 0664, &of);
+	if (result) {
+		return result;
+	}
+	result = fd_place(of, fd);
+	if (result) {
+		of_decref(of);
+		return result;
+	}
+	return 0;
+}
+
+static
+void
+fdb_thread(void *unused, unsigned long num)
+{
+	unsigned long i;
+	int fd, err;
+
+	(void)unused;
+
+	for (i=0; i<fdb_iters; i++) {
+		if (fdb_open(O_RDONLY, &fd)) {
+			fdb_errors[num]++;
+			continue;
+		}
+		err = 0;
+		if (sys_dup2(fd, fd + 1, &err) < 0 ||
+		    sys_close(fd + 1, &err) < 0) {
+			fdb_errors[num]++;
+		}
+		if (sys_close(fd, &err) < 0) {
+			fdb_errors[num]++;
+		}
+	}
+
+	V(fdb_done);
+}
+
+/*
+ * Wait for a thread to finish leaving its process so the process
+ * can be destroyed.
+ */
+static
+void
+fdb_reap(struct proc *proc)
+{
+	unsigned n;
+
+	while (1) {
+		spinlock_acquire(&proc->p_lock);
+		n = proc->p_numthreads;
+		spinlock_release(&proc->p_lock);
+		if (n == 0) {
+			break;
+		}
+		thread_yield();
+	}
+	proc_destroy(proc);
+}
+
+int
+fdbench(int nargs, char **args)
+{
+	struct proc *procs[MAX_NPROCS];
+	struct timespec before, after, duration;
+	struct opened_file *of;
+	char path[FDB_PATHLEN];
+	unsigned nprocs, i, errors;
+	uint64_t rounds, nsecs;
+	int result;
+
+	nprocs = nargs > 1 ? atoi(args[1]) : DEFAULT_NPROCS;
+	fdb_iters = nargs > 2 ? atoi(args[2]) : DEFAULT_ITERS;
+	if (nprocs < 1 || nprocs > MAX_NPROCS) {
+		kprintf("fdbench: nprocs must be 1-%d\n", MAX_NPROCS);
+		return EINVAL;
+	}
+	if (nargs > 3 && strlen(args[3]) >= FDB_PATHLEN) {
+		kprintf("fdbench: path too long\n");
+		return EINVAL;
+	}
+	strcpy(fdb_path, nargs > 3 ? args[3] : "emu0:fdbench");
+
+	/* Make sure the file exists. */
+	strcpy(path, fdb_path);
+	result = of_create(path, O_WRONLY|O_CREAT, 0664, &of);
+	if (result) {
+		kprintf("fdbench: %s: %s\n", fdb_path, strerror(result));
+		return result;
+	}
+	of_decref(of);
+
+	fdb_done = sem_create("fdbench", 0);
+	if (fdb_done == NULL) {
+		return ENOMEM;
+	}
+
+	kprintf("fdbench: %u processes, %lu rounds each on %s\n",
+		nprocs, fdb_iters, fdb_path);
+
+	gettime(&before);
+	for (i=0; i<nprocs; i++) {
+		fdb_errors[i] = 0;
+		procs[i] = proc_create_runprogram("fdbench");
+		if (procs[i] == NULL) {
+			panic("fdbench: proc_create_runprogram failed\n");
+		}
+		result = thread_fork("fdbench", procs[i], fdb_thread,
+				     NULL, i);
+		if (result) {
+			panic("fdbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nprocs; i++) {
+		P(fdb_done);
+	}
+	gettime(&after);
+
+	errors = 0;
+	for (i=0; i<nprocs; i++) {
+		fdb_reap(procs[i]);
+		errors += fdb_errors[i];
+	}
+	sem_destroy(fdb_done);
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	rounds = (uint64_t)nprocs * fdb_iters;
+	kprintf("fdbench: %llu open/dup2/close rounds in %llu.%09lu s",
+		rounds, (unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec);
+	if (nsecs > 0) {
+		kprintf(", %llu rounds/sec", rounds * 1000000000ULL / nsecs);
+	}
+	kprintf("\n");
+
+	if (errors > 0) {
+		kprintf("fdbench: %u errors\n", errors);
+		return EIO;
+	}
+	kprintf("fdbench: passed.\n");
+	return 0;
+}
@@ -46,6 +46,15 @@ SPINLOCK_INLINE
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 SPINLOCK_INLINE
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+SPINLOCK_INLINE
+spinlock_data_t spinlock_data_fetchadd(volatile spinlock_data_t *sd,
+				       unsigned inc);
+SPINLOCK_INLINE
+spinlock_data_t spinlock_data_swap(volatile spinlock_data_t *sd,
+				   unsigned val);
+SPINLOCK_INLINE
+spinlock_data_t spinlock_data_cas(volatile spinlock_data_t *sd,
+				  unsigned oldval, unsigned newval);
 
 ////////////////////////////////////////////////////////////
 
@@ -119,4 +128,88 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 }
 
 
+/*
+ * The following are also built on LL/SC, but unlike testandset they
+ * loop until the SC succeeds rather than reporting failure, since
+ * their callers have no sensible way to retry on their own.
+ */
+
+/*
+ * Atomically add INC to *SD; return the old value.
+ */
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_fetchadd(volatile spinlock_data_t *sd, unsigned inc)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *sd */
+		"addu %1, %0, %3;"	/*   y = x + inc */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd), "r" (inc)
+		: "memory");
+	return x;
+}
+
+/*
+ * Atomically store VAL in *SD; return the old value.
+ */
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_swap(volatile spinlock_data_t *sd, unsigned val)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *sd */
+		"move %1, %3;"		/*   y = val */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd), "r" (val)
+		: "memory");
+	return x;
+}
+
+/*
+ * Compare-and-swap: if *SD is OLDVAL, atomically replace it with
+ * NEWVAL. Return the value *SD had; the swap happened if that is
+ * OLDVAL.
+ */
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_cas(volatile spinlock_data_t *sd,
+		  unsigned oldval, unsigned newval)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *sd */
+		"bne %0, %3, 2f;"	/*   give up if x != oldval */
+		"move %1, %4;"		/*   y = newval */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd), "r" (oldval), "r" (newval)
+		: "memory");
+	return x;
+}
+
+
 #endif /* _MIPS_SPINLOCK_H_ */
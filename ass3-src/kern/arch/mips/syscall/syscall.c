@@ -37,6 +37,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <systat.h>
 
 
 /*
@@ -83,12 +84,14 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+	SYSTAT_STAMP(stamp);
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	SYSTAT_START(stamp);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -113,6 +116,20 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS___kdata:
+		err = sys___kdata(&retval);
+		break;
+
+	    case SYS_futex:
+		err = sys_futex((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				&retval);
+		break;
+
 
 	    /* process calls */
 
@@ -142,6 +159,14 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrlimit:
+		err = sys_getrlimit(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setrlimit:
+		err = sys_setrlimit(tf->tf_a0, (const_userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* file calls */
 
@@ -164,6 +189,10 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0, &retval);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +207,87 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The offset is 64 bits wide. It would go in the
+			 * a2/a3 pair, but size is already in a2, so it
+			 * goes on the stack after the space for the four
+			 * argument registers.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			if (callno == SYS_pread) {
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+			}
+			else {
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+			}
+		}
+		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_copy_file_range:
+		{
+			/* The fifth argument, len, is on the stack. */
+			size_t len;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &len, sizeof(len));
+			if (err) {
+				break;
+			}
+
+			err = sys_copy_file_range(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				len,
+				&retval);
+		}
+		break;
+	    case SYS_io_enter:
+		err = sys_io_enter(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_systat:
+#if OPT_SYSTAT
+		err = sys_systat(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+#else
+		err = ENOSYS;
+#endif
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -269,6 +379,7 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	SYSTAT_RECORD(callno, tf, retval, err, stamp);
 
 	if (err) {
 		/*
@@ -59,6 +59,8 @@ SRCS+=$(KTOP)/proc/pid.c
 SRCS+=$(KTOP)/proc/proc.c
 SRCS+=$(KTOP)/syscall/file_syscalls.c
 SRCS+=$(KTOP)/syscall/filetable.c
+SRCS+=$(KTOP)/syscall/futex_syscalls.c
+SRCS+=$(KTOP)/syscall/io_syscalls.c
 SRCS+=$(KTOP)/syscall/loadelf.c
 SRCS+=$(KTOP)/syscall/more_syscalls.c
 SRCS+=$(KTOP)/syscall/openfile.c
@@ -69,7 +71,10 @@ SRCS+=$(KTOP)/test/arraytest.c
 SRCS+=$(KTOP)/test/bitmaptest.c
 SRCS+=$(KTOP)/test/fstest.c
 SRCS+=$(KTOP)/test/kmalloctest.c
+SRCS+=$(KTOP)/test/pitest.c
+SRCS+=$(KTOP)/test/rwtest.c
 SRCS+=$(KTOP)/test/semunit.c
+SRCS+=$(KTOP)/test/spinlocktest.c
 SRCS+=$(KTOP)/test/synchtest.c
 SRCS+=$(KTOP)/test/threadlisttest.c
 SRCS+=$(KTOP)/test/threadtest.c
@@ -83,6 +88,7 @@ SRCS+=$(KTOP)/thread/thread.c
 SRCS+=$(KTOP)/thread/threadlist.c
 SRCS+=$(KTOP)/vfs/device.c
 SRCS+=$(KTOP)/vfs/devnull.c
+SRCS+=$(KTOP)/vfs/pipe.c
 SRCS+=$(KTOP)/vfs/vfscwd.c
 SRCS+=$(KTOP)/vfs/vfsfail.c
 SRCS+=$(KTOP)/vfs/vfslist.c
@@ -91,6 +97,7 @@ SRCS+=$(KTOP)/vfs/vfspath.c
 SRCS+=$(KTOP)/vfs/vnode.c
 SRCS+=$(KTOP)/vm/addrspace.c
 SRCS+=$(KTOP)/vm/frametable.c
+SRCS+=$(KTOP)/vm/kdata.c
 SRCS+=$(KTOP)/vm/kmalloc.c
 SRCS+=$(KTOP)/vm/vm.c
 SRCS.MACHINE.mips+=$(TOP)/common/gcc-millicode/adddi3.c
@@ -0,0 +1,5 @@
+/* Automatically generated; do not edit */
+#ifndef _OPT_SYSTAT_H_
+#define _OPT_SYSTAT_H_
+#define OPT_SYSTAT 0
+#endif /* _OPT_SYSTAT_H_ */
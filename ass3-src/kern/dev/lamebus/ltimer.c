@@ -50,6 +50,19 @@
 #define LT_GRANULARITY   1000000
 
 static bool havetimerclock;
+static bool haveoneshot;
+
+/*
+ * Start the countdown timer to interrupt once, USECS from now.
+ */
+static
+void
+ltimer_oneshot_start(void *vlt, uint32_t usecs)
+{
+	struct ltimer_softc *lt = vlt;
+
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, usecs);
+}
 
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
@@ -82,6 +95,8 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	 */
 	(void)ltimerno;
 	lt->lt_hardclock = 0;
+	lt->lt_timerclock = 0;
+	lt->lt_oneshot = 0;
 
 	/*
 	 * We do, however, use ltimer for the timer clock, since the
@@ -96,6 +111,17 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
 				   LT_GRANULARITY);
 	}
+	/*
+	 * A second timer, if there is one, is reprogrammed on the fly
+	 * to fire timeouts that are due between hardclocks.
+	 */
+	else if (!haveoneshot) {
+		haveoneshot = true;
+		lt->lt_oneshot = 1;
+
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
+		timeout_setoneshot(ltimer_oneshot_start, lt);
+	}
 
 	return 0;
 }
@@ -124,6 +150,12 @@ ltimer_irq(void *vlt)
 		if (lt->lt_timerclock) {
 			timerclock();
 		}
+		/*
+		 * And for the one-shot.
+		 */
+		if (lt->lt_oneshot) {
+			timeout_oneshot();
+		}
 	}
 }
 
@@ -39,6 +39,7 @@ struct ltimer_softc {
 	/* Initialized by config function */
 	int lt_hardclock;        /* true if we should call hardclock() */
 	int lt_timerclock;        /* true if we should call timerclock() */
+	int lt_oneshot;		/* true if used as the timeout one-shot */
 
 	/* Initialized by lower-level attach routine */
 	void *lt_bus;		/* bus we're on */
@@ -70,6 +70,7 @@ struct addrspace {
 #else
     struct as_seg * first;
     uint32_t asid;
+    paddr_t kdataproc;      /* process kdata page, or 0 if not yet touched */
 };
 #endif
 
@@ -73,11 +73,53 @@ void timespec_sub(const struct timespec *t1,
 		  const struct timespec *t2,
 		  struct timespec *ret);
 
+/*
+ * Timeouts: call a function at some point in the future.
+ *
+ * timeout_init  - set up a timeout to call FUNC(DATA) when it fires.
+ * timeout_add   - arm the timeout to fire DELAY from now. It must not
+ *                 already be pending.
+ * timeout_cancel - disarm the timeout. Returns true if it was pending;
+ *                 false if it already fired (or is firing right now)
+ *                 or was never added.
+ *
+ * Timeouts are kept on a hashed timer wheel checked on every
+ * hardclock, so they normally fire on the first hardclock at or after
+ * their deadline. Short timeouts are fired more precisely if a spare
+ * timer device has registered with timeout_setoneshot. FUNC is called
+ * in interrupt context and must not sleep. The struct timeout belongs
+ * to the caller and must stay put until it fires or is cancelled.
+ */
+struct timeout {
+	struct timeout *to_next;	/* list in wheel bucket */
+	struct timeout *to_prev;
+	uint64_t to_deadline;		/* nanoseconds, as from gettime */
+	unsigned to_bucket;		/* wheel bucket it's on */
+	void (*to_func)(void *);
+	void *to_data;
+	bool to_pending;
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, const struct timespec *delay);
+bool timeout_cancel(struct timeout *to);
+
+/*
+ * Called by a timer device that can be programmed to interrupt once,
+ * USECS microseconds from now, by calling START(DEV, USECS). Its
+ * interrupt handler should then call timeout_oneshot.
+ */
+void timeout_setoneshot(void (*start)(void *dev, uint32_t usecs), void *dev);
+void timeout_oneshot(void);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ * timespec_sleep() does the same for an arbitrary length of time; it
+ * returns ENOMEM if it can't get the resources to sleep, otherwise 0.
  */
 void clocksleep(int seconds);
+int timespec_sleep(const struct timespec *duration);
 
 
 #endif /* _CLOCK_H_ */
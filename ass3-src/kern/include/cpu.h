@@ -34,6 +34,7 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <systat.h>
 
 
 /*
@@ -59,8 +60,17 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Dead threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	struct spinlock_mcsnode c_mcsnodes[SPINLOCK_MCSNODES];
+					/* Queue nodes for MCS spinlocks */
+	uint32_t c_stealseed;		/* PRNG state for picking victims */
+	unsigned c_lockspun;		/* Contended lock acquires won by spinning */
+	unsigned c_lockslept;		/* Contended lock acquires that slept */
+	unsigned c_locktryfail;		/* Failed lock_tryacquire calls */
+	LOCKSTAT_CPUDATA(c_lockstat);	/* Lock statistics, if enabled */
+	SYSTAT_CPUDATA(c_systat);	/* Syscall statistics, if enabled */
 
 	/*
 	 * Accessed by other cpus.
@@ -117,6 +127,13 @@ void cpu_hatch(unsigned software_number);
  */
 void cpu_identify(char *buf, size_t max);
 
+/*
+ * Number of CPUs, and the CPU with software number NUM (counting
+ * from 0), for code that needs to visit every CPU's struct cpu.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_getnum(unsigned num);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
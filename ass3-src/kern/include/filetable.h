@@ -38,27 +38,40 @@
 
 
 /*
- * The file table is an array of open files.
+ * The file table is an array of open files that grows as needed, up
+ * to the process's limit on open files (RLIMIT_NOFILE; see
+ * setrlimit). It starts out big enough for FILETABLE_MINSIZE files
+ * and doubles when a file is placed past the end. Alongside the
+ * array is a bitmap with a bit set for each open fd, so finding the
+ * lowest free fd looks at a word of the bitmap at a time rather than
+ * an entry of the array at a time.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The soft limit starts at OPEN_MAX, which is what programs expect;
+ * it can be raised as far as the hard limit, which starts at
+ * FILETABLE_MAX (the most we can kmalloc an array for). Lowering the
+ * soft limit below a file that's already open leaves that file open,
+ * but no new fds at or above the limit are handed out. Limits are
+ * inherited across fork.
  *
  * Because we only have single-threaded processes, the file table is
  * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * the table is copied; the copy is only as big as it needs to be for
+ * the files actually open. Another exercise: what would you need to
+ * do to make this code safe for multithreaded processes? What happens
+ * if one thread calls close() while another one is in the middle of
+ * e.g. read() using the same file handle?
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct openfile **ft_openfiles;	/* ft_size entries */
+	uint32_t *ft_inuse;		/* bit set for each open fd */
+	unsigned ft_size;		/* size of table; multiple of 32 */
+	unsigned ft_limit;		/* soft limit on fds */
+	unsigned ft_hardlimit;		/* hard limit on fds */
 };
 
+#define FILETABLE_MINSIZE	32
+#define FILETABLE_MAX		1024
+
 /*
  * Filetable ops:
  *
@@ -71,7 +84,9 @@ struct filetable {
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. Can fail (ENOMEM) if the table has to
+ *           grow; placing NULL never fails.
+ * getlimit/setlimit - Get or set the soft and hard limits.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +98,11 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
+
+void filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max);
+int filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max);
 
 
 #endif /* _FILETABLE_H_ */
@@ -88,8 +88,8 @@
 //#define SYS_wait4      34
 //#define SYS_getrusage  35
 //                              (resource limits)
-//#define SYS_getrlimit  36
-//#define SYS_setrlimit  37
+#define SYS_getrlimit    36
+#define SYS_setrlimit    37
 //                              (process priority control)
 //#define SYS_getpriority 38
 //#define SYS_setpriority 39
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -196,6 +196,11 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+#define SYS_futex        121
+#define SYS_copy_file_range 122
+#define SYS_io_enter     123
+#define SYS_systat       124
+#define SYS___kdata      125
 
 /*CALLEND*/
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Each spinlock and sleep lock carries a lockstat_lockable with its
+ * name and the cycle count when it was last acquired. Every
+ * acquisition and release is recorded by the cpu doing it, in that
+ * cpu's own table of per-lock entries, so recording takes no locks;
+ * it happens with interrupts off (inside the spinlock, or with the
+ * sleep lock's spinlock held). Per lock we keep the number of
+ * acquisitions, how many of them had to wait, the total and largest
+ * wait, and the total and largest hold time, all in cycles.
+ *
+ * lockstat_print merges the cpus' tables and prints the locks with
+ * the most contended acquisitions; lockstat_reset clears them.
+ *
+ * When the option is off all of this compiles away to nothing.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <machine/cycles.h>
+
+struct cpu;
+struct lockstat_entry;	/* Opaque */
+
+struct lockstat_lockable {
+	const char *ll_name;
+	uint32_t ll_acquired;		/* cycle count when acquired */
+	struct cpu *ll_cpu;		/* cpu it was acquired on */
+};
+
+void lockstat_cpuinit(struct cpu *c);
+void lockstat_acquired(struct lockstat_lockable *ll, const void *lock,
+		       uint32_t waitstart, bool contended);
+void lockstat_released(struct lockstat_lockable *ll, const void *lock);
+void lockstat_print(unsigned maxlocks);
+void lockstat_reset(void);
+
+#define LOCKSTAT_CPUDATA(sym)		struct lockstat_entry *sym
+#define LOCKSTAT_CPUINIT(c)		lockstat_cpuinit(c)
+
+#define LOCKSTAT_LOCKABLE(sym)		struct lockstat_lockable sym
+#define LOCKSTAT_LOCKABLEINIT(ll, n) \
+	((ll)->ll_name = (n), (ll)->ll_acquired = 0, (ll)->ll_cpu = NULL)
+#define LOCKSTAT_LOCKABLE_INITIALIZER(field, n) \
+	, .field = { (n), 0, NULL }
+
+#define LOCKSTAT_WAITSTART(t)		((t) = cpu_getcycles())
+#define LOCKSTAT_ACQUIRED(ll, lk, t, c)	lockstat_acquired(ll, lk, t, c)
+#define LOCKSTAT_RELEASED(ll, lk)	lockstat_released(ll, lk)
+
+#else
+
+#define LOCKSTAT_CPUDATA(sym)
+#define LOCKSTAT_CPUINIT(c)
+
+#define LOCKSTAT_LOCKABLE(sym)
+#define LOCKSTAT_LOCKABLEINIT(ll, n)
+#define LOCKSTAT_LOCKABLE_INITIALIZER(field, n)
+
+#define LOCKSTAT_WAITSTART(t)		((t) = 0)
+#define LOCKSTAT_ACQUIRED(ll, lk, t, c)	((void)(t), (void)(c))
+#define LOCKSTAT_RELEASED(ll, lk)
+
+#endif
+
+#endif /* _LOCKSTAT_H_ */
@@ -51,6 +51,7 @@
 struct openfile {
 	struct vnode *of_vnode;
 	int of_accmode;	/* from open: O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;	/* from open: O_APPEND; writes go at the end */
 
 	struct lock *of_offsetlock;	/* lock for of_offset */
 	off_t of_offset;
@@ -63,6 +64,9 @@ struct openfile {
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* wrap an already-open vnode (consumes the vnode reference on success) */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
@@ -40,6 +40,7 @@
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
+struct ioctx;
 struct vnode;
 
 /*
@@ -64,6 +65,7 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct ioctx *p_ioctx;		/* io_enter state, if any */
 
 	/* add more material here as needed */
 };
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -51,39 +52,84 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * Spinlocks are fair: CPUs get the lock in the order they asked for
+ * it. There are two kinds, which behave the same apart from how they
+ * wait:
+ *
+ *    - ticket locks (the default), where splk_lock holds the next
+ *      ticket to hand out in its top half and the ticket now being
+ *      served in its bottom half. Waiters take a ticket and spin
+ *      reading splk_lock until their number comes up.
+ *
+ *    - MCS queue locks, where splk_lock points at the last of a queue
+ *      of per-cpu nodes, and each waiter spins on a flag in its own
+ *      node that its predecessor clears on release. Waiters don't all
+ *      hammer the lock word, so these are for locks that are heavily
+ *      contended across many CPUs (kmalloc's, for one).
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+	volatile spinlock_data_t splk_lock; /* Ticket pair or MCS tail. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	struct spinlock_mcsnode *splk_mcsnode; /* Holder's node (MCS). */
+	bool splk_mcs;			    /* MCS lock, not ticket lock. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
+	LOCKSTAT_LOCKABLE(splk_lockstat);   /* Contention statistics. */
+};
+
+/*
+ * Queue node for MCS locks. Each cpu has SPINLOCK_MCSNODES of them
+ * (in struct cpu), one for each MCS lock it is waiting for or holding;
+ * a node is spun on only by its own cpu.
+ */
+struct spinlock_mcsnode {
+	struct spinlock_mcsnode *volatile mn_next; /* Next waiter. */
+	volatile bool mn_waiting;	/* Cleared when it's our turn. */
+	bool mn_inuse;			/* Node is taken. */
 };
 
+#define SPINLOCK_MCSNODES	8
+
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * The _NAMED form gives the lock a name for lockstat; others are just
+ * called "spinlock". The _MCS form makes a named MCS lock.
  */
-#ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
-				  HANGMAN_LOCKABLE_INITIALIZER }
+#if OPT_HANGMAN
+#define SPINLOCK_HANGMAN_INITIALIZER \
+	, .splk_hangman = HANGMAN_LOCKABLE_INITIALIZER
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_HANGMAN_INITIALIZER
 #endif
+#define SPINLOCK_INITIALIZER_KIND(name, mcs) \
+	{ .splk_lock = SPINLOCK_DATA_INITIALIZER, .splk_holder = NULL, \
+	  .splk_mcsnode = NULL, .splk_mcs = (mcs) \
+	  SPINLOCK_HANGMAN_INITIALIZER \
+	  LOCKSTAT_LOCKABLE_INITIALIZER(splk_lockstat, name) }
+#define SPINLOCK_INITIALIZER_NAMED(name) SPINLOCK_INITIALIZER_KIND(name, false)
+#define SPINLOCK_INITIALIZER_MCS(name)	SPINLOCK_INITIALIZER_KIND(name, true)
+#define SPINLOCK_INITIALIZER	SPINLOCK_INITIALIZER_NAMED("spinlock")
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_mcs	Same, but make it an MCS lock.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * SPINLOCK_SETNAME names an initialized lock for lockstat.
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_mcs(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -91,5 +137,8 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+#define SPINLOCK_SETNAME(lk, name) \
+	LOCKSTAT_LOCKABLEINIT(&(lk)->splk_lockstat, name)
+
 
 #endif /* _SPINLOCK_H_ */
@@ -37,6 +37,8 @@
 
 #include <spinlock.h>
 
+struct timespec;	/* in kern/time.h */
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -58,8 +60,15 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_timed gives up with ETIMEDOUT if the count is still 0 after
+ * TIMEOUT (relative); it returns 0 on success. P_try only decrements
+ * the count if it can do so without blocking, and returns true if it
+ * did.
  */
 void P(struct semaphore *);
+int P_timed(struct semaphore *, const struct timespec *timeout);
+bool P_try(struct semaphore *);
 void V(struct semaphore *);
 
 
@@ -75,9 +84,14 @@ void V(struct semaphore *);
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKSTAT_LOCKABLE(lk_lockstat); /* Contention statistics. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        unsigned lk_nspun;              /* Contended acquires won spinning */
+        unsigned lk_nslept;             /* Contended acquires that slept */
+        struct lock *lk_nextheld;       /* Link on holder's t_heldlocks */
+        struct thread *lk_waiters;      /* Waiters lending us priority */
 };
 
 struct lock *lock_create(const char *name);
@@ -87,17 +101,43 @@ void lock_destroy(struct lock *);
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
  *                   same time.
+ *    lock_tryacquire - Get the lock if nobody holds it; never waits.
+ *                   Returns true if the lock was acquired.
+ *    lock_acquire_timed - Get the lock, but give up and return ETIMEDOUT
+ *                   if it can't be had within TIMEOUT. Returns 0 on
+ *                   success.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * lock_acquire is adaptive: if the lock is held by a thread that is
+ * currently running on another cpu, it spins for a while in the hope
+ * that the holder lets go soon, and only goes to sleep if the holder
+ * stops running or the spin budget runs out. lk_nspun and lk_nslept
+ * count how contended acquires were resolved; lock_printstats and
+ * lock_resetstats show and clear the same counts summed over all
+ * locks.
+ *
+ * Locks do priority inheritance: while a thread waits for a lock, the
+ * holder runs at the waiter's priority if that is higher, and so on
+ * down the chain if the holder is itself waiting for another lock.
+ * lock_repriority recomputes the current thread's priority after its
+ * base priority changes; it is for thread_setpriority.
  */
 void lock_acquire(struct lock *);
+bool lock_tryacquire(struct lock *);
+int lock_acquire_timed(struct lock *, const struct timespec *timeout);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+void lock_repriority(void);
+
+void lock_printstats(void);
+void lock_resetstats(void);
+
 
 /*
  * Condition variable.
@@ -115,8 +155,7 @@ bool lock_do_i_hold(struct lock *);
 
 struct cv {
         char *cv_name;
-        struct wchan *cv_wchan;
-        struct spinlock cv_wchanlock;
+        struct wchan *cv_wchan;         /* Protected by the lock's lk_lock */
 };
 
 struct cv *cv_create(const char *name);
@@ -128,16 +167,92 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but stop sleeping after TIMEOUT and
+ *                   return ETIMEDOUT (with the lock re-acquired, as
+ *                   always). Returns 0 if woken by a signal, and
+ *                   that includes a signal that arrives before the
+ *                   timeout when the lock is only got back after it:
+ *                   a signal is never consumed by a waiter that then
+ *                   reports ETIMEDOUT.
  *
- * For all three operations, the current thread must hold the lock passed
- * in. Note that under normal circumstances the same lock should be used
- * on all operations with any particular CV.
+ * For all these operations, the current thread must hold the lock passed
+ * in. The same lock must be used on all operations with any particular
+ * CV, as the lock's spinlock also protects the CV's wait channel.
+ *
+ * Signalled threads are not made runnable right away; they are moved
+ * onto the lock's wait channel and woken one at a time as the lock is
+ * released, so a broadcast doesn't start a stampede for the lock.
  *
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock,
+		 const struct timespec *timeout);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at the same time, or one
+ * writer. The mode chosen at creation time decides who gets in when
+ * both kinds of thread are waiting:
+ *
+ *    RWLOCK_PREFER_READER - new readers are let in as long as no
+ *                   writer actually holds the lock. Readers never
+ *                   wait for other readers, but a steady stream of
+ *                   them can starve writers.
+ *    RWLOCK_PREFER_WRITER - once a writer is waiting, new readers
+ *                   wait behind it. Writers can't be starved, but a
+ *                   thread must not take a read lock recursively
+ *                   (a writer arriving in between deadlocks it).
+ *
+ * Only writers are visible to the deadlock detector as holders; a
+ * reader shows up to it only while it is waiting for a writer.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+#define RWLOCK_PREFER_READER	0
+#define RWLOCK_PREFER_WRITER	1
+
+struct rwlock {
+        char *rwlk_name;
+        HANGMAN_LOCKABLE(rwlk_hangman); /* Deadlock detector hook. */
+        struct wchan *rwlk_rwchan;      /* Readers sleep here */
+        struct wchan *rwlk_wwchan;      /* Writers sleep here */
+        struct spinlock rwlk_lock;
+        int rwlk_mode;                  /* RWLOCK_PREFER_* */
+        volatile unsigned rwlk_readers; /* Number of readers holding */
+        volatile unsigned rwlk_wwaiting; /* Number of writers waiting */
+        struct thread *volatile rwlk_writer;
+};
+
+struct rwlock *rwlock_create(const char *name, int mode);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Release a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusively).
+ *    rwlock_release_write - Release a write hold. Only the writer
+ *                           may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread
+ *                           holds the lock for writing.
+ *    rwlock_is_held       - Return true if anybody holds the lock
+ *                           at all. Readers aren't tracked
+ *                           individually, so this is as close as we
+ *                           can get to "do I hold it for reading";
+ *                           use it for assertions only.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+bool rwlock_is_held(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -54,6 +54,9 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,18 +67,32 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
+int sys___kdata(int32_t *retval);
+int sys_futex(userptr_t uaddr, int op, int val, int *retval);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_getrlimit(int resource, userptr_t rlp);
+int sys_setrlimit(int resource, const_userptr_t rlp);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds, int *retval);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_copy_file_range(int infd, userptr_t inoff, int outfd, userptr_t outoff,
+			size_t len, int *retval);
+int sys_io_enter(userptr_t ring, unsigned to_submit, unsigned min_complete,
+		 int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYSTAT_H_
+#define _SYSTAT_H_
+
+/*
+ * System call statistics and tracing. Enable with "options systat"
+ * in the kernel config.
+ *
+ * syscall() takes a timestamp (the cycle count and the cpu) on the
+ * way in, and on the way out hands it to systat_record along with
+ * the call number, arguments, and result. Each cpu keeps its own
+ * table of per-call counts and latency histograms (see
+ * <kern/systat.h>), so recording takes no locks; it is done with
+ * interrupts off to stay on the cpu. Calls that don't return
+ * (_exit, a successful execv) are not counted.
+ *
+ * While tracing is on, every call is also logged in a ring of the
+ * last SYSTAT_TRACESIZE calls, which is shared and has a spinlock.
+ *
+ * The kernel menu shows these with "systat" and "strace"; user
+ * programs get them from the systat() system call.
+ *
+ * When the option is off all of this compiles away to nothing, and
+ * systat() fails with ENOSYS.
+ */
+
+#include "opt-systat.h"
+
+#if OPT_SYSTAT
+
+#include <kern/systat.h>
+
+struct cpu;
+struct trapframe;
+
+struct systat_stamp {
+	uint32_t ss_cycles;
+	struct cpu *ss_cpu;
+};
+
+void systat_cpuinit(struct cpu *c);
+void systat_start(struct systat_stamp *ss);
+void systat_record(int callno, const struct trapframe *tf,
+		   int retval, int err, const struct systat_stamp *ss);
+void systat_print(int callno);
+void systat_printtrace(unsigned max);
+void systat_settrace(bool on);
+void systat_reset(void);
+int sys_systat(int op, userptr_t buf, size_t len, int *retval);
+
+#define SYSTAT_CPUDATA(sym)		struct systat_call **sym
+#define SYSTAT_CPUINIT(c)		systat_cpuinit(c)
+
+#define SYSTAT_STAMP(sym)		struct systat_stamp sym
+#define SYSTAT_START(ss)		systat_start(&(ss))
+#define SYSTAT_RECORD(n, tf, rv, e, ss)	systat_record(n, tf, rv, e, &(ss))
+
+#else
+
+#define SYSTAT_CPUDATA(sym)
+#define SYSTAT_CPUINIT(c)
+
+#define SYSTAT_STAMP(sym)
+#define SYSTAT_START(ss)
+#define SYSTAT_RECORD(n, tf, rv, e, ss)
+
+#endif
+
+#endif /* _SYSTAT_H_ */
@@ -53,10 +53,12 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int timedsynchtest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -81,6 +83,22 @@ int semu19(int, char **);
 int semu20(int, char **);
 int semu21(int, char **);
 int semu22(int, char **);
+int semu23(int, char **);
+int semu24(int, char **);
+int semu25(int, char **);
+int semu26(int, char **);
+
+/* reader-writer lock tests */
+int rwtest(int, char **);
+int rwtest2(int, char **);
+int rwtest3(int, char **);
+
+/* priority inheritance tests */
+int pitest(int, char **);
+int pitest2(int, char **);
+
+/* spinlock benchmark */
+int spinlocktest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -37,10 +37,13 @@
  */
 
 #include <array.h>
+#include <clock.h>
 #include <spinlock.h>
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
+struct wchan;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -56,6 +59,14 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Thread priorities. Higher numbers run first; threads of the same
+ * priority share the cpu round-robin.
+ */
+#define PRI_MIN		0
+#define PRI_DEFAULT	50
+#define PRI_MAX		99
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -82,9 +93,33 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks when last run */
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
+	/*
+	 * Timed sleep fields (see wchan_sleep_timed). t_timedlock is
+	 * the sleep's wchan spinlock while the timeout may still run.
+	 */
+	struct timeout t_timeout;	/* Wakes us if the sleep times out */
+	struct spinlock *volatile t_timedlock;
+	struct wchan *t_timedoutof;	/* Channel the timeout woke us from */
+
+	/*
+	 * Priority fields.
+	 *
+	 * t_pri is what the scheduler goes by. It is t_basepri, raised
+	 * to the priority of the most important thread waiting for a
+	 * lock this thread holds (priority inheritance). The lock
+	 * fields are maintained by synch.c; see there.
+	 */
+	int t_basepri;			/* Priority set by thread_setpriority */
+	volatile int t_pri;		/* Effective priority */
+	struct lock *t_heldlocks;	/* Locks held, linked by lk_nextheld */
+	struct lock *t_waitlock;	/* Lock we're waiting for, if any */
+	struct thread *t_nextwaiter;	/* Link on t_waitlock's lk_waiters */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -128,7 +163,7 @@ void thread_start_cpus(void);
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
-/* Call during system shutdown to offline other CPUs. */
+/* Call during system shutdown to offline other CPUs and free thread pools. */
 void thread_shutdown(void);
 
 /*
@@ -159,15 +194,15 @@ __DEAD void thread_exit(void);
 void thread_yield(void);
 
 /*
- * Reshuffle the run queue. Called from the timer interrupt.
+ * Set the current thread's priority (PRI_MIN to PRI_MAX). New
+ * threads start with their creator's priority.
  */
-void schedule(void);
+void thread_setpriority(int pri);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Reshuffle the run queue. Called from the timer interrupt.
  */
-void thread_consider_migration(void);
+void schedule(void);
 
 
 #endif /* _THREAD_H_ */
@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct timespec; /* in kern/time.h */
 struct wchan; /* Opaque */
 
 /*
@@ -66,15 +67,33 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but give up after TIMEOUT: the thread is taken off
+ * the channel and ETIMEDOUT is returned. Returns 0 if awakened in the
+ * normal way first.
+ */
+int wchan_sleep_timed(struct wchan *wc, struct spinlock *lk,
+		      const struct timespec *timeout);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
  *
- * The current implementation is FIFO but this is not promised by the
+ * wchan_wakeone picks the highest-priority sleeper, and the one that
+ * has slept longest among equals, but this is not promised by the
  * interface.
  */
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Move one thread, or all threads, sleeping on FROM over to TO
+ * without waking them; they wake when someone wakes TO. The two
+ * channels must share the associated spinlock LK, which should be
+ * locked. Returns the number of threads moved.
+ */
+unsigned wchan_requeue(struct wchan *from, struct wchan *to,
+		       struct spinlock *lk, bool all);
+
 
 #endif /* _WCHAN_H_ */
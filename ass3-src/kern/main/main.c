@@ -47,6 +47,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <ioring.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -130,6 +131,8 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
+	ioring_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -44,9 +44,12 @@
 #include <sfs.h>
 #include <pid.h>
 #include <syscall.h>
+#include <systat.h>
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-systat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -500,6 +503,85 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for showing how contended lock acquires went and, with
+ * "options lockstat", the most contended locks.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lock_printstats();
+#if OPT_LOCKSTAT
+		lockstat_print(20);
+#endif
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lock_resetstats();
+#if OPT_LOCKSTAT
+		lockstat_reset();
+#endif
+	}
+	else {
+		kprintf("Usage: lockstat [reset]\n");
+	}
+
+	return 0;
+}
+
+#if OPT_SYSTAT
+/*
+ * Command for showing system call counts and latencies.
+ */
+static
+int
+cmd_systat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		systat_print(-1);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		systat_reset();
+	}
+	else if (nargs == 2 && args[1][0] >= '0' && args[1][0] <= '9') {
+		systat_print(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: systat [reset | callno]\n");
+	}
+
+	return 0;
+}
+
+/*
+ * Command for turning system call tracing on and off, and showing
+ * the most recent calls.
+ */
+static
+int
+cmd_strace(int nargs, char **args)
+{
+	if (nargs == 1) {
+		systat_printtrace(20);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		systat_settrace(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		systat_settrace(false);
+	}
+	else if (nargs == 2 && args[1][0] >= '0' && args[1][0] <= '9') {
+		systat_printtrace(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: strace [on | off | count]\n");
+	}
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -569,6 +651,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork rate test         ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -576,7 +659,14 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
-	"[semu1-22] Semaphore unit tests     ",
+	"[sy5] Timed lock/CV test            ",
+	"[semu1-26] Semaphore unit tests     ",
+	"[rwt1] RW lock stress test          ",
+	"[rwt2] RW lock reader preference    ",
+	"[rwt3] RW lock writer preference    ",
+	"[pi1] Priority inversion test       ",
+	"[pi2] Priority inheritance chains   ",
+	"[spt] Spinlock benchmark            ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
@@ -606,6 +696,11 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[lockstat] Lock contention stats    ",
+#if OPT_SYSTAT
+	"[systat] System call latencies      ",
+	"[strace] System call trace          ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +752,11 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "lockstat",   cmd_lockstat },
+#if OPT_SYSTAT
+	{ "systat",     cmd_systat },
+	{ "strace",     cmd_strace },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -673,12 +773,14 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	timedsynchtest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -703,6 +805,22 @@ static struct {
 	{ "semu20",	semu20 },
 	{ "semu21",	semu21 },
 	{ "semu22",	semu22 },
+	{ "semu23",	semu23 },
+	{ "semu24",	semu24 },
+	{ "semu25",	semu25 },
+	{ "semu26",	semu26 },
+
+	/* reader-writer lock tests */
+	{ "rwt1",	rwtest },
+	{ "rwt2",	rwtest2 },
+	{ "rwt3",	rwtest3 },
+
+	/* priority inheritance tests */
+	{ "pi1",	pitest },
+	{ "pi2",	pitest2 },
+
+	/* spinlock benchmark */
+	{ "spt",	spinlocktest },
 
 	/* system call assignment tests */
 	/* For testing the wait implementation. */
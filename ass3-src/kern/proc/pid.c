@@ -56,7 +56,7 @@ struct pidinfo {
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct semaphore *pi_exitsem;	// V'd once, when the thread exits
 };
 
 
@@ -67,8 +67,13 @@ struct pidinfo {
  * (pid % PROCS_MAX), and only allows one process per slot. If a
  * new pid allocation would cause a hash collision, we just don't
  * use that pid.
+ *
+ * The table is protected by a reader-writer lock: lookups that don't
+ * change anything (the checks at the top of pid_wait) take it for
+ * reading; allocating, freeing, and recording exit status take it
+ * for writing.
  */
-static struct lock *pidlock;		// lock for global exit data
+static struct rwlock *pidlock;		// lock for global exit data
 static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
 static pid_t nextpid;			// next candidate pid
 static int nprocs;			// number of allocated pids
@@ -91,8 +96,8 @@ pidinfo_create(pid_t pid, pid_t ppid)
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_exitsem = sem_create("pidinfo exit", 0);
+	if (pi->pi_exitsem == NULL) {
 		kfree(pi);
 		return NULL;
 	}
@@ -114,7 +119,7 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	sem_destroy(pi->pi_exitsem);
 	kfree(pi);
 }
 
@@ -128,7 +133,7 @@ pid_bootstrap(void)
 {
 	int i;
 
-	pidlock = lock_create("pidlock");
+	pidlock = rwlock_create("pidlock", RWLOCK_PREFER_WRITER);
 	if (pidlock == NULL) {
 		panic("Out of memory creating pid lock\n");
 	}
@@ -158,7 +163,8 @@ pi_get(pid_t pid)
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	/* may be held for reading, which we can't check more closely */
+	KASSERT(rwlock_is_held(pidlock));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	if (pi==NULL) {
@@ -178,7 +184,7 @@ static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(rwlock_do_i_hold_write(pidlock));
 
 	KASSERT(pid != INVALID_PID);
 
@@ -198,7 +204,7 @@ pi_drop(pid_t pid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(rwlock_do_i_hold_write(pidlock));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	KASSERT(pi != NULL);
@@ -218,7 +224,7 @@ static
 void
 inc_nextpid(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(rwlock_do_i_hold_write(pidlock));
 
 	nextpid++;
 	if (nextpid > PID_MAX) {
@@ -239,10 +245,10 @@ pid_alloc(pid_t *retval)
 	KASSERT(curproc->p_pid != INVALID_PID);
 
 	/* lock the table */
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		rwlock_release_write(pidlock);
 		return EAGAIN;
 	}
 
@@ -265,7 +271,7 @@ pid_alloc(pid_t *retval)
 
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
+		rwlock_release_write(pidlock);
 		return ENOMEM;
 	}
 
@@ -273,7 +279,7 @@ pid_alloc(pid_t *retval)
 
 	inc_nextpid();
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 
 	*retval = pid;
 	return 0;
@@ -290,7 +296,7 @@ pid_unalloc(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -304,7 +310,7 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
@@ -318,7 +324,7 @@ pid_disown(pid_t theirpid)
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -329,7 +335,7 @@ pid_disown(pid_t theirpid)
 		pi_drop(them->pi_pid);
 	}
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
@@ -346,7 +352,7 @@ pid_setexitstatus(int status)
 	struct pidinfo *us;
 	int i;
 
-	lock_acquire(pidlock);
+	rwlock_acquire_write(pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
 
 	/* First, disown all children */
@@ -374,11 +380,12 @@ pid_setexitstatus(int status)
 		pi_drop(curproc->p_pid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		/* only the parent ever waits, so one V is enough */
+		V(us->pi_exitsem);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 }
 
 /*
@@ -415,11 +422,15 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
+	/*
+	 * The checks only need to look at the table, so do them with
+	 * a read lock and don't hold up anyone else doing the same.
+	 */
+	rwlock_acquire_read(pidlock);
 
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
+		rwlock_release_read(pidlock);
 		return ESRCH;
 	}
 
@@ -427,22 +438,29 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 
 	/* Only allow waiting for own children. */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
+		rwlock_release_read(pidlock);
 		return EPERM;
 	}
 
-	if (them->pi_exited == false) {
-		if (flags == WNOHANG) {
-			lock_release(pidlock);
-			KASSERT(ret != NULL);
-			*ret = 0;
-			return 0;
-		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+	if (them->pi_exited == false && flags == WNOHANG) {
+		rwlock_release_read(pidlock);
+		KASSERT(ret != NULL);
+		*ret = 0;
+		return 0;
 	}
 
+	rwlock_release_read(pidlock);
+
+	/*
+	 * Only the parent (that's us) can drop a pidinfo whose
+	 * pi_ppid is still set, so THEM stays valid without the lock.
+	 * If the child has already exited this P doesn't wait.
+	 */
+	P(them->pi_exitsem);
+
+	rwlock_acquire_write(pidlock);
+	KASSERT(them->pi_exited == true);
+
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
@@ -460,6 +478,6 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
 
-	lock_release(pidlock);
+	rwlock_release_write(pidlock);
 	return 0;
 }
@@ -52,6 +52,7 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <ioring.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -94,6 +95,7 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_ioctx = NULL;
 
 	return proc;
 }
@@ -124,6 +126,16 @@ proc_destroy(struct proc *proc)
 	 * incorrect to destroy it.)
 	 */
 
+	/*
+	 * Async I/O. Doesn't wait: requests still in flight hold their
+	 * own openfile references, and the worker that finishes the
+	 * last of them throws it away and frees the context.
+	 */
+	if (proc->p_ioctx) {
+		ioctx_destroy(proc->p_ioctx);
+		proc->p_ioctx = NULL;
+	}
+
 	/* VFS fields */
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
@@ -34,6 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/iovec.h>
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
@@ -41,12 +42,14 @@
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
+#include <addrspace.h>
 #include <synch.h>
 #include <copyinout.h>
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
 /*
@@ -105,20 +108,32 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for all the read and write calls.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the uio the
+ * caller has set up.
+ *
+ * If POS is NULL, the I/O happens at the file's seek position. The
+ * offset lock is held across the whole transfer however many iovecs
+ * the uio has, so a readv or writev lands in one contiguous piece of
+ * the file. For files opened with O_APPEND, writes go at the end of
+ * the file, which we look up with the offset lock held so appends by
+ * different processes sharing the file can't overwrite each other.
+ *
+ * Otherwise (pread and pwrite) the I/O happens at *POS, and the seek
+ * position and its lock are left alone, so I/O on different parts of
+ * a shared file doesn't queue up behind the offset lock. O_APPEND
+ * doesn't apply; the caller asked for a particular place.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_doio(int fd, struct uio *useruio, const off_t *pos, int badaccmode,
+	 ssize_t *retval)
 {
 	struct openfile *file;
+	struct stat info;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,14 +142,29 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
-		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+	if (pos != NULL) {
+		/* Explicit offset: only for seekable objects. */
+		locked = false;
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		if (*pos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
+		useruio->uio_offset = *pos;
 	}
 	else {
-		pos = 0;
+		/* Only lock the seek position if we're really using it. */
+		locked = VOP_ISSEEKABLE(file->of_vnode);
+		if (locked) {
+			lock_acquire(file->of_offsetlock);
+			useruio->uio_offset = file->of_offset;
+		}
+		else {
+			useruio->uio_offset = 0;
+		}
 	}
 
 	if (file->of_accmode == badaccmode) {
@@ -142,20 +172,26 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	if (locked && file->of_append && useruio->uio_rw == UIO_WRITE) {
+		result = VOP_STAT(file->of_vnode, &info);
+		if (result) {
+			goto fail;
+		}
+		useruio->uio_offset = info.st_size;
+	}
 
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	size = useruio->uio_resid;
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
 	if (result) {
 		goto fail;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
 		lock_release(file->of_offsetlock);
 	}
 
@@ -165,7 +201,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -177,13 +213,31 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for read, write, pread, and pwrite: a uio with one
+ * buffer. POS is as for sys_doio.
+ */
+static
+int
+sys_readwrite(int fd, userptr_t buf, size_t size, const off_t *pos,
+	      enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	/* set up a uio with the buffer and its size */
+	uio_uinit(&iov, &useruio, buf, size, 0, rw);
+
+	return sys_doio(fd, &useruio, pos, badaccmode, retval);
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	return sys_readwrite(fd, buf, size, NULL, UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +246,414 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	return sys_readwrite(fd, buf, size, NULL, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_readwrite with an explicit offset
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, &pos, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite with an explicit offset
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, &pos, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Common logic for readv and writev.
+ *
+ * Copy in the iovec array, which may have at most IOV_MAX entries.
+ * Small arrays go on the stack; bigger ones are kmalloc'd. The total
+ * length has to fit in the ssize_t we return. Then make one uio out of
+ * the lot and hand it to sys_doio.
+ */
+#define SMALL_IOVCNT 8
+#define IOV_TOTALMAX ((~(size_t)0) >> 1)	/* largest ssize_t */
+
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[SMALL_IOVCNT];
+	struct iovec *iov;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= SMALL_IOVCNT) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto done;
+	}
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > IOV_TOTALMAX - total) {
+			result = EINVAL;
+			goto done;
+		}
+		total += iov[i].iov_len;
+	}
+
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = 0;
+	useruio.uio_resid = total;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
+
+	result = sys_doio(fd, &useruio, NULL, badaccmode, retval);
+
+done:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Work out where copy_file_range should read or write FILE: at the
+ * offset the user passed in UOFF, or, if that's NULL, at the file's
+ * seek position. In the latter case (if the file is seekable) the
+ * offset lock is taken and *LOCKED set, and for a write to an
+ * O_APPEND file the position is the end of the file.
+ */
+static
+int
+copy_getpos(struct openfile *file, const_userptr_t uoff, bool iswrite,
+	    off_t *pos, bool *locked)
+{
+	struct stat info;
+	int result;
+
+	*locked = false;
+	if (uoff != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			return ESPIPE;
+		}
+		result = copyin(uoff, pos, sizeof(*pos));
+		if (result) {
+			return result;
+		}
+		if (*pos < 0) {
+			return EINVAL;
+		}
+		return 0;
+	}
+
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		*pos = 0;
+		return 0;
+	}
+
+	lock_acquire(file->of_offsetlock);
+	*pos = file->of_offset;
+	if (iswrite && file->of_append) {
+		result = VOP_STAT(file->of_vnode, &info);
+		if (result) {
+			lock_release(file->of_offsetlock);
+			return result;
+		}
+		*pos = info.st_size;
+	}
+	*locked = true;
+	return 0;
+}
+
+/*
+ * Move up to LEN bytes from INFILE at *INPOS to OUTFILE at *OUTPOS
+ * through a kernel buffer, advancing both positions. Stops early at
+ * end of file, or after a short read (so that copying from the console
+ * or another such device doesn't sit waiting to fill the whole
+ * length). Returns the amount copied; an error is only reported if
+ * nothing was copied.
+ */
+#define COPY_BUFSIZE 4096
+
+static
+int
+copy_data(struct openfile *infile, off_t *inpos,
+	  struct openfile *outfile, off_t *outpos,
+	  size_t len, size_t *copied)
+{
+	char *buf;
+	struct iovec iov;
+	struct uio ku;
+	size_t chunk, got, done;
+	off_t start;
+	int result;
+
+	buf = kmalloc(COPY_BUFSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	*copied = 0;
+	result = 0;
+	while (*copied < len) {
+		chunk = len - *copied;
+		if (chunk > COPY_BUFSIZE) {
+			chunk = COPY_BUFSIZE;
+		}
+
+		start = *inpos;
+		uio_kinit(&iov, &ku, buf, chunk, start, UIO_READ);
+		result = VOP_READ(infile->of_vnode, &ku);
+		if (result) {
+			break;
+		}
+		got = chunk - ku.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		done = 0;
+		while (done < got) {
+			uio_kinit(&iov, &ku, buf + done, got - done, *outpos,
+				  UIO_WRITE);
+			result = VOP_WRITE(outfile->of_vnode, &ku);
+			if (result) {
+				break;
+			}
+			if (ku.uio_resid == got - done) {
+				/* wrote nothing; give up rather than spin */
+				result = EIO;
+				break;
+			}
+			done = got - ku.uio_resid;
+			*outpos = ku.uio_offset;
+		}
+		/*
+		 * Only move the input position past what got written, so
+		 * after a failed write it agrees with the count returned.
+		 */
+		*inpos = start + done;
+		*copied += done;
+		if (result || got < chunk) {
+			break;
+		}
+	}
+
+	kfree(buf);
+	if (*copied > 0) {
+		/* report the partial copy, like a short read or write */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * copy_file_range() - copy data from one file to another inside the
+ * kernel, without passing it through a user buffer.
+ *
+ * UINOFF and UOUTOFF point to user off_t's giving the positions to
+ * use, which are updated afterwards; if either is NULL that side uses
+ * (and updates) the file's seek position, as read and write would.
+ * The same open file can't be used for both sides through its seek
+ * position, and within one file the two ranges can't overlap: the
+ * copy goes a buffer at a time, so later pieces would read what
+ * earlier ones had already overwritten. When both sides take offset locks they do so in a fixed
+ * (address) order, so two copies running in opposite directions
+ * between the same pair of files can't deadlock.
+ */
+int
+sys_copy_file_range(int infd, userptr_t uinoff, int outfd, userptr_t uoutoff,
+		    size_t len, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *infile, *outfile;
+	off_t inpos, outpos;
+	bool inlocked = false, outlocked = false;
+	size_t copied;
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = filetable_get(ft, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &outfile);
+	if (result) {
+		filetable_put(ft, infd, infile);
+		return result;
+	}
+
+	if (infile->of_accmode == O_WRONLY ||
+	    outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	if (infile == outfile && uinoff == NULL && uoutoff == NULL) {
+		result = EINVAL;
+		goto out;
+	}
+
+	/* the return value is a ssize_t; don't copy more than fits */
+	if (len > IOV_TOTALMAX) {
+		len = IOV_TOTALMAX;
+	}
+
+	if ((uintptr_t)infile <= (uintptr_t)outfile) {
+		result = copy_getpos(infile, uinoff, false,
+				     &inpos, &inlocked);
+		if (!result) {
+			result = copy_getpos(outfile, uoutoff, true,
+					     &outpos, &outlocked);
+		}
+	}
+	else {
+		result = copy_getpos(outfile, uoutoff, true,
+				     &outpos, &outlocked);
+		if (!result) {
+			result = copy_getpos(infile, uinoff, false,
+					     &inpos, &inlocked);
+		}
+	}
+	if (result) {
+		goto out;
+	}
+
+	if (infile->of_vnode == outfile->of_vnode &&
+	    VOP_ISSEEKABLE(infile->of_vnode) &&
+	    inpos < outpos + (off_t)len && outpos < inpos + (off_t)len) {
+		result = EINVAL;
+		goto out;
+	}
+
+	result = copy_data(infile, &inpos, outfile, &outpos, len, &copied);
+	if (result) {
+		goto out;
+	}
+
+	/* hand back the new positions */
+	if (inlocked) {
+		infile->of_offset = inpos;
+	}
+	else if (uinoff != NULL) {
+		result = copyout(&inpos, uinoff, sizeof(inpos));
+	}
+	if (outlocked) {
+		outfile->of_offset = outpos;
+	}
+	else if (uoutoff != NULL && !result) {
+		result = copyout(&outpos, uoutoff, sizeof(outpos));
+	}
+	*retval = copied;
+
+out:
+	if (outlocked) {
+		lock_release(outfile->of_offsetlock);
+	}
+	if (inlocked) {
+		lock_release(infile->of_offsetlock);
+	}
+	filetable_put(ft, outfd, outfile);
+	filetable_put(ft, infd, infile);
+	return result;
+}
+
+/*
+ * pipe() - make a pipe, and place its read and write ends in the file
+ * table. Return the two fds through the user array FDS.
+ */
+int
+sys_pipe(userptr_t fds, int *retval)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int kfds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &kfds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &kfds[1]);
+	if (result) {
+		filetable_placeat(ft, NULL, kfds[0], &junk);
+		KASSERT(junk == readfile);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		filetable_placeat(ft, NULL, kfds[1], &junk);
+		filetable_placeat(ft, NULL, kfds[0], &junk);
+		openfile_decref(writefile);
+		openfile_decref(readfile);
+		return result;
+	}
+
+	*retval = 0;
+	return 0;
 }
 
 /*
@@ -296,11 +757,17 @@ sys_dup2(int oldfd, int newfd, int *retval)
 {
 	struct filetable *ft;
 	struct openfile *oldfdfile, *newfdfile;
+	unsigned limit, hardlimit;
 	int result;
 
 	ft = curproc->p_filetable;
 
-	if (!filetable_okfd(ft, newfd)) {
+	/*
+	 * okfd also allows fds left open above a lowered limit, but
+	 * dup2 makes a new fd, so it has to be under the limit.
+	 */
+	filetable_getlimit(ft, &limit, &hardlimit);
+	if (!filetable_okfd(ft, newfd) || (unsigned)newfd >= limit) {
 		return EBADF;
 	}
 
@@ -321,7 +788,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
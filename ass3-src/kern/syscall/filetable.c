@@ -38,6 +38,103 @@
 #include <filetable.h>
 
 
+#define FT_WORDBITS	32
+#define FT_WORDS(size)	((size) / FT_WORDBITS)
+
+/*
+ * Allocate the arrays for an empty table of SIZE entries.
+ */
+static
+int
+filetable_alloc(struct filetable *ft, unsigned size)
+{
+	unsigned i;
+
+	KASSERT(size % FT_WORDBITS == 0);
+	KASSERT(size <= FILETABLE_MAX);
+
+	ft->ft_openfiles = kmalloc(size * sizeof(struct openfile *));
+	if (ft->ft_openfiles == NULL) {
+		return ENOMEM;
+	}
+	ft->ft_inuse = kmalloc(FT_WORDS(size) * sizeof(uint32_t));
+	if (ft->ft_inuse == NULL) {
+		kfree(ft->ft_openfiles);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < size; i++) {
+		ft->ft_openfiles[i] = NULL;
+	}
+	for (i = 0; i < FT_WORDS(size); i++) {
+		ft->ft_inuse[i] = 0;
+	}
+	ft->ft_size = size;
+	return 0;
+}
+
+/*
+ * Grow the table so that FD is in it. Doubles the size until it
+ * fits, so growing one fd at a time doesn't copy the table every
+ * time.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned fd)
+{
+	struct filetable bigger;
+	unsigned size;
+	int result;
+
+	KASSERT(fd >= ft->ft_size);
+	KASSERT(fd < FILETABLE_MAX);
+
+	size = ft->ft_size;
+	while (size <= fd) {
+		size *= 2;
+	}
+	if (size > FILETABLE_MAX) {
+		size = FILETABLE_MAX;
+	}
+
+	result = filetable_alloc(&bigger, size);
+	if (result) {
+		return result;
+	}
+	memcpy(bigger.ft_openfiles, ft->ft_openfiles,
+	       ft->ft_size * sizeof(struct openfile *));
+	memcpy(bigger.ft_inuse, ft->ft_inuse,
+	       FT_WORDS(ft->ft_size) * sizeof(uint32_t));
+
+	kfree(ft->ft_openfiles);
+	kfree(ft->ft_inuse);
+	ft->ft_openfiles = bigger.ft_openfiles;
+	ft->ft_inuse = bigger.ft_inuse;
+	ft->ft_size = size;
+	return 0;
+}
+
+/*
+ * Store FILE (which may be NULL) in slot FD and update the bitmap.
+ */
+static
+void
+filetable_set(struct filetable *ft, unsigned fd, struct openfile *file)
+{
+	uint32_t bit;
+
+	KASSERT(fd < ft->ft_size);
+
+	bit = (uint32_t)1 << (fd % FT_WORDBITS);
+	ft->ft_openfiles[fd] = file;
+	if (file != NULL) {
+		ft->ft_inuse[fd / FT_WORDBITS] |= bit;
+	}
+	else {
+		ft->ft_inuse[fd / FT_WORDBITS] &= ~bit;
+	}
+}
+
 /*
  * Construct a filetable.
  */
@@ -45,7 +142,6 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
@@ -53,9 +149,12 @@ filetable_create(void)
 	}
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	if (filetable_alloc(ft, FILETABLE_MINSIZE)) {
+		kfree(ft);
+		return NULL;
 	}
+	ft->ft_limit = OPEN_MAX;
+	ft->ft_hardlimit = FILETABLE_MAX;
 
 	return ft;
 }
@@ -66,17 +165,22 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned w, fd;
+	uint32_t bits;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
+	for (w = 0; w < FT_WORDS(ft->ft_size); w++) {
+		for (bits = ft->ft_inuse[w], fd = w * FT_WORDBITS;
+		     bits != 0; bits >>= 1, fd++) {
+			if (bits & 1) {
+				openfile_decref(ft->ft_openfiles[fd]);
+			}
 		}
 	}
+	kfree(ft->ft_openfiles);
+	kfree(ft->ft_inuse);
 	kfree(ft);
 }
 
@@ -94,13 +198,19 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The copy is only made big enough for the highest fd that's open,
+ * and only the bitmap words with something in them are looked at, so
+ * forking a process with a few files open is cheap whatever the size
+ * its table once grew to.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned words, size, w, fd;
+	uint32_t bits;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,18 +218,39 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	/* find the last bitmap word in use */
+	for (words = FT_WORDS(src->ft_size); words > 0; words--) {
+		if (src->ft_inuse[words - 1] != 0) {
+			break;
+		}
+	}
+	size = FILETABLE_MINSIZE;
+	while (size < words * FT_WORDBITS) {
+		size *= 2;
+	}
+
+	dest = kmalloc(sizeof(struct filetable));
 	if (dest == NULL) {
 		return ENOMEM;
 	}
+	if (filetable_alloc(dest, size)) {
+		kfree(dest);
+		return ENOMEM;
+	}
+	dest->ft_limit = src->ft_limit;
+	dest->ft_hardlimit = src->ft_hardlimit;
 
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
+	for (w = 0; w < words; w++) {
+		dest->ft_inuse[w] = src->ft_inuse[w];
+		for (bits = src->ft_inuse[w], fd = w * FT_WORDBITS;
+		     bits != 0; bits >>= 1, fd++) {
+			if (bits & 1) {
+				file = src->ft_openfiles[fd];
+				openfile_incref(file);
+				dest->ft_openfiles[fd] = file;
+			}
 		}
-		dest->ft_openfiles[fd] = file;
 	}
 
 	*dest_ret = dest;
@@ -127,15 +258,17 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 }
 
 /*
- * Check if a file handle is in range.
+ * Check if a file handle is in range: below the limit, or in the
+ * table already (which it can be if the limit was lowered after it
+ * was opened). The second case is only good for looking up files
+ * that are already open; anything making a new fd must also check
+ * the limit.
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
-	(void)ft;
-
-	return (fd >= 0 && fd < OPEN_MAX);
+	return (fd >= 0 &&
+		((unsigned)fd < ft->ft_limit || (unsigned)fd < ft->ft_size));
 }
 
 /*
@@ -151,7 +284,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (!filetable_okfd(ft, fd) || (unsigned)fd >= ft->ft_size) {
 		return EBADF;
 	}
 
@@ -184,6 +317,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
+	KASSERT((unsigned)fd < ft->ft_size);
 	KASSERT(ft->ft_openfiles[fd] == file);
 }
 
@@ -194,23 +328,46 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * the behavior had to be defined explicitly in order to allow
  * manipulating stdin/stdout/stderr.)
  *
+ * The smallest free descriptor is found by skipping over full words
+ * of the bitmap. If the table is full, the new descriptor is the one
+ * just past the end, and the table grows, limit permitting.
+ *
  * Consumes a reference to the openfile object. (That reference is
  * placed in the table.)
  */
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned words, w, fd;
+	uint32_t bits;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+	words = FT_WORDS(ft->ft_size);
+	for (w = 0; w < words; w++) {
+		if (ft->ft_inuse[w] != 0xffffffff) {
+			break;
+		}
+	}
+	fd = w * FT_WORDBITS;
+	if (w < words) {
+		for (bits = ft->ft_inuse[w]; bits & 1; bits >>= 1) {
+			fd++;
+		}
+	}
+
+	if (fd >= ft->ft_limit) {
+		return EMFILE;
+	}
+	if (fd >= ft->ft_size) {
+		result = filetable_grow(ft, fd);
+		if (result) {
+			return result;
 		}
 	}
 
-	return EMFILE;
+	filetable_set(ft, fd, file);
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +378,62 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the location is past the end of the table and the
+ * table can't be grown, in which case nothing has changed. Placing
+ * NULL never fails.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
+	if ((unsigned)fd >= ft->ft_size) {
+		if (newfile == NULL) {
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		result = filetable_grow(ft, fd);
+		if (result) {
+			return result;
+		}
+	}
+
 	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	filetable_set(ft, fd, newfile);
+	return 0;
+}
+
+/*
+ * Get the limits on the number of fds.
+ */
+void
+filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max)
+{
+	*cur = ft->ft_limit;
+	*max = ft->ft_hardlimit;
+}
+
+/*
+ * Set the limits on the number of fds. We have no notion of
+ * privilege, so nobody can raise the hard limit; the soft limit can
+ * go anywhere up to it.
+ */
+int
+filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max)
+{
+	if (cur > max) {
+		return EINVAL;
+	}
+	if (max > ft->ft_hardlimit) {
+		return EPERM;
+	}
+	ft->ft_limit = cur;
+	ft->ft_hardlimit = max;
+	return 0;
 }
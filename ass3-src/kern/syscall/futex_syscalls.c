@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: sleeping and waking on user addresses.
+ *
+ * User code keeps its lock or condition state in an ordinary int and
+ * only calls into the kernel when it has to sleep, or when it knows
+ * somebody is sleeping. Waiters are kept in a fixed hash table of
+ * buckets keyed by (address space, user address). Each address with
+ * anybody waiting on it has a futexq on its bucket's list, with a CV
+ * to sleep on; it is created by the first waiter and freed by the
+ * last one out.
+ *
+ * The bucket lock is a sleep lock rather than a spinlock because
+ * FUTEX_WAIT has to read the user's word with it held (otherwise a
+ * wakeup could slip in between the check and the sleep), and copyin
+ * can fault.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_BUCKETS	64	/* must be a power of 2 */
+
+struct futexq {
+	struct addrspace *fq_as;
+	vaddr_t fq_addr;
+	struct cv *fq_cv;
+	unsigned fq_waiters;	/* threads sleeping here */
+	unsigned fq_wakeups;	/* wakeups not yet collected */
+	struct futexq *fq_next;
+};
+
+struct futexbucket {
+	struct lock *fb_lock;
+	struct futexq *fb_queues;
+};
+
+static struct futexbucket futextable[FUTEX_BUCKETS];
+
+/*
+ * Setup function.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		futextable[i].fb_lock = lock_create("futex");
+		if (futextable[i].fb_lock == NULL) {
+			panic("futex_bootstrap: lock_create failed\n");
+		}
+		futextable[i].fb_queues = NULL;
+	}
+}
+
+static
+struct futexbucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)as ^ (uint32_t)(addr >> 2);
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return &futextable[h & (FUTEX_BUCKETS - 1)];
+}
+
+/*
+ * Find the queue for (AS, ADDR) in bucket FB, or NULL. Must hold the
+ * bucket lock.
+ */
+static
+struct futexq *
+futex_findq(struct futexbucket *fb, struct addrspace *as, vaddr_t addr)
+{
+	struct futexq *fq;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	for (fq = fb->fb_queues; fq != NULL; fq = fq->fq_next) {
+		if (fq->fq_as == as && fq->fq_addr == addr) {
+			return fq;
+		}
+	}
+	return NULL;
+}
+
+static
+int
+futex_wait(struct futexbucket *fb, struct addrspace *as,
+	   userptr_t uaddr, int val)
+{
+	struct futexq *fq, **fqp;
+	int cur, result;
+
+	lock_acquire(fb->fb_lock);
+
+	result = copyin((const_userptr_t)uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fq = futex_findq(fb, as, (vaddr_t)uaddr);
+	if (fq == NULL) {
+		fq = kmalloc(sizeof(*fq));
+		if (fq == NULL) {
+			lock_release(fb->fb_lock);
+			return ENOMEM;
+		}
+		fq->fq_cv = cv_create("futex");
+		if (fq->fq_cv == NULL) {
+			kfree(fq);
+			lock_release(fb->fb_lock);
+			return ENOMEM;
+		}
+		fq->fq_as = as;
+		fq->fq_addr = (vaddr_t)uaddr;
+		fq->fq_waiters = 0;
+		fq->fq_wakeups = 0;
+		fq->fq_next = fb->fb_queues;
+		fb->fb_queues = fq;
+	}
+
+	fq->fq_waiters++;
+	while (fq->fq_wakeups == 0) {
+		cv_wait(fq->fq_cv, fb->fb_lock);
+	}
+	fq->fq_wakeups--;
+	fq->fq_waiters--;
+
+	if (fq->fq_waiters == 0) {
+		KASSERT(fq->fq_wakeups == 0);
+		for (fqp = &fb->fb_queues; *fqp != fq; fqp = &(*fqp)->fq_next) {
+			KASSERT(*fqp != NULL);
+		}
+		*fqp = fq->fq_next;
+		cv_destroy(fq->fq_cv);
+		kfree(fq);
+	}
+
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+static
+int
+futex_wake(struct futexbucket *fb, struct addrspace *as,
+	   userptr_t uaddr, int val, int *retval)
+{
+	struct futexq *fq;
+	unsigned n, i;
+
+	if (val < 0) {
+		return EINVAL;
+	}
+
+	lock_acquire(fb->fb_lock);
+
+	n = 0;
+	fq = futex_findq(fb, as, (vaddr_t)uaddr);
+	if (fq != NULL) {
+		/* Only threads not already woken count */
+		n = fq->fq_waiters - fq->fq_wakeups;
+		if (n > (unsigned)val) {
+			n = val;
+		}
+		fq->fq_wakeups += n;
+		if (n == fq->fq_waiters) {
+			cv_broadcast(fq->fq_cv, fb->fb_lock);
+		}
+		else {
+			for (i=0; i<n; i++) {
+				cv_signal(fq->fq_cv, fb->fb_lock);
+			}
+		}
+	}
+
+	lock_release(fb->fb_lock);
+	*retval = n;
+	return 0;
+}
+
+/*
+ * futex system call.
+ */
+int
+sys_futex(userptr_t uaddr, int op, int val, int *retval)
+{
+	struct addrspace *as;
+	struct futexbucket *fb;
+
+	/* The word must be aligned so it can't straddle a page */
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	KASSERT(as != NULL);
+	fb = futex_bucket(as, (vaddr_t)uaddr);
+
+	*retval = 0;
+	switch (op) {
+	    case FUTEX_WAIT:
+		return futex_wait(fb, as, uaddr, val);
+	    case FUTEX_WAKE:
+		return futex_wake(fb, as, uaddr, val, retval);
+	}
+	return EINVAL;
+}
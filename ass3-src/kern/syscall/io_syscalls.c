@@ -0,0 +1,747 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous I/O: io_enter() and its worker threads.
+ *
+ * The process queues requests on the submission ring in its struct
+ * ioring (see <kern/ioring.h>) and calls io_enter, which copies them
+ * in and puts them on a single system-wide work queue. A pool of
+ * kernel threads takes requests off the queue and does the I/O into
+ * or out of kernel buffers, so several requests (on different disks,
+ * say, or on emufs) are being worked on at once while the process
+ * carries on. Finished requests go on their process's done list, and
+ * io_enter posts them to the completion ring, copying read data out
+ * to the user's buffer as it goes.
+ *
+ * The worker threads run in the kernel process and can't get at the
+ * user's address space, which is why all the copying in and out
+ * happens in io_enter, in the process's own context.
+ *
+ * Workers take a context's ic_lock to hand back a finished request,
+ * so io_enter never holds it across a copyin or copyout: a page fault
+ * on the user's ring or buffers would hold up every worker with a
+ * request to finish. io_enter copies submissions into kernel memory
+ * before taking ic_lock to queue them, and takes finished requests
+ * off the done list under ic_lock before copying them out. The ring
+ * state only io_enter uses is protected by ic_enterlock, which the
+ * workers never touch.
+ *
+ * Only seekable files (regular files and disks) are accepted. A read
+ * from a pipe or the console could wait forever, and with only a few
+ * workers for the whole system a handful of those would stall
+ * everyone's I/O.
+ *
+ * Each request holds a reference to its openfile, so closing the fd
+ * while the request is in flight is harmless. When a process exits or
+ * execs, ioctx_destroy cuts the context loose: completions not yet
+ * collected are thrown away, and requests still in flight are thrown
+ * away by the worker that finishes them, the last of which frees the
+ * context. Nobody waits.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/iovec.h>
+#include <kern/ioring.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <proc.h>
+#include <current.h>
+#include <thread.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <ioring.h>
+#include <syscall.h>
+
+#define IORING_WORKERS	4	/* worker threads */
+
+/*
+ * One request.
+ */
+struct ioreq {
+	struct ioctx *ir_ctx;		/* owning process's context */
+	struct openfile *ir_file;	/* file, or NULL for a nop */
+	int ir_op;			/* IORING_OP_* */
+	off_t ir_offset;		/* offset, or -1 for the seek position */
+	userptr_t ir_ubuf;		/* user's buffer */
+	void *ir_kbuf;			/* our copy of the data */
+	size_t ir_len;			/* length of both buffers */
+	unsigned ir_userdata;		/* for the completion */
+	int ir_res;			/* result for the completion */
+	struct ioreq *ir_next;		/* work queue or done list */
+};
+
+/*
+ * Per-process state, created on the first io_enter.
+ *
+ * ic_sqhead and ic_cqtail are the kernel's own copies of the ring
+ * counters it owns; the ones in user memory are only written, never
+ * believed. They, and ic_ring, are protected by ic_enterlock; the
+ * rest by ic_lock.
+ */
+struct ioctx {
+	struct lock *ic_enterlock;	/* one io_enter at a time */
+	userptr_t ic_ring;		/* the user's struct ioring */
+	unsigned ic_sqhead;		/* next submission to take */
+	unsigned ic_cqtail;		/* next completion slot to fill */
+
+	struct lock *ic_lock;
+	struct cv *ic_cv;		/* signalled when a request finishes */
+	unsigned ic_inflight;		/* requests not yet finished */
+	unsigned ic_ndone;		/* finished, not yet posted */
+	struct ioreq *ic_done;		/* list of finished requests */
+	struct ioreq **ic_donetail;	/* where to append to it */
+	bool ic_dying;			/* owner gone; free when idle */
+};
+
+/* The work queue. */
+static struct lock *ioq_lock;
+static struct cv *ioq_cv;
+static struct ioreq *ioq_head;
+static struct ioreq **ioq_tail = &ioq_head;
+
+/* Addresses of the fields of the user's ring. */
+#define RING_FIELD(ring, field) \
+	((userptr_t)&((struct ioring *)(ring))->field)
+
+////////////////////////////////////////////////////////////
+// requests
+
+static
+void
+ioreq_destroy(struct ioreq *req)
+{
+	if (req->ir_kbuf != NULL) {
+		kfree(req->ir_kbuf);
+	}
+	if (req->ir_file != NULL) {
+		openfile_decref(req->ir_file);
+	}
+	kfree(req);
+}
+
+/*
+ * Check a submission and set up a request for it. Failures that are
+ * the submission's fault (a bad fd, say) are reported in its
+ * completion rather than from io_enter, so on return *REQ_RET is
+ * either a request ready for the workers, or one that has already
+ * failed with ir_res set. Returns an error only if we couldn't get
+ * memory for the request at all.
+ */
+static
+int
+ioreq_create(struct ioctx *ctx, const struct ioring_sqe *sqe,
+	     struct ioreq **req_ret)
+{
+	struct ioreq *req;
+	struct openfile *file;
+	int result;
+
+	req = kmalloc(sizeof(*req));
+	if (req == NULL) {
+		return ENOMEM;
+	}
+	req->ir_ctx = ctx;
+	req->ir_file = NULL;
+	req->ir_op = sqe->sqe_op;
+	req->ir_offset = sqe->sqe_offset;
+	req->ir_ubuf = sqe->sqe_buf;
+	req->ir_kbuf = NULL;
+	req->ir_len = sqe->sqe_len;
+	req->ir_userdata = sqe->sqe_userdata;
+	req->ir_res = 0;
+	req->ir_next = NULL;
+	*req_ret = req;
+
+	if (req->ir_len > IORING_MAXLEN) {
+		req->ir_len = IORING_MAXLEN;
+	}
+
+	switch (req->ir_op) {
+	    case IORING_OP_NOP:
+		return 0;
+	    case IORING_OP_READ:
+	    case IORING_OP_WRITE:
+	    case IORING_OP_FSYNC:
+		break;
+	    default:
+		req->ir_res = -EINVAL;
+		return 0;
+	}
+
+	result = filetable_get(curproc->p_filetable, sqe->sqe_fd, &file);
+	if (result) {
+		req->ir_res = -result;
+		return 0;
+	}
+	openfile_incref(file);
+	filetable_put(curproc->p_filetable, sqe->sqe_fd, file);
+	req->ir_file = file;
+
+	if (req->ir_op == IORING_OP_FSYNC) {
+		return 0;
+	}
+
+	if ((req->ir_op == IORING_OP_READ && file->of_accmode == O_WRONLY) ||
+	    (req->ir_op == IORING_OP_WRITE && file->of_accmode == O_RDONLY)) {
+		req->ir_res = -EBADF;
+		return 0;
+	}
+	if (req->ir_offset < -1) {
+		req->ir_res = -EINVAL;
+		return 0;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		/* might block forever; see above */
+		req->ir_res = -ESPIPE;
+		return 0;
+	}
+
+	if (req->ir_len > 0) {
+		req->ir_kbuf = kmalloc(req->ir_len);
+		if (req->ir_kbuf == NULL) {
+			req->ir_res = -ENOMEM;
+			return 0;
+		}
+	}
+	if (req->ir_op == IORING_OP_WRITE) {
+		result = copyin(req->ir_ubuf, req->ir_kbuf, req->ir_len);
+		if (result) {
+			req->ir_res = -result;
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Do the I/O for a request. Runs on a worker thread. Returns the
+ * result for the completion.
+ */
+static
+int
+ioreq_run(struct ioreq *req)
+{
+	struct openfile *file = req->ir_file;
+	struct iovec iov;
+	struct uio ku;
+	struct stat info;
+	enum uio_rw rw;
+	bool locked;
+	int result;
+
+	switch (req->ir_op) {
+	    case IORING_OP_NOP:
+		return 0;
+	    case IORING_OP_FSYNC:
+		result = VOP_FSYNC(file->of_vnode);
+		return result ? -result : 0;
+	}
+
+	rw = req->ir_op == IORING_OP_READ ? UIO_READ : UIO_WRITE;
+	uio_kinit(&iov, &ku, req->ir_kbuf, req->ir_len, req->ir_offset, rw);
+
+	/* As in sys_doio: the seek position, and appends, need the lock. */
+	locked = req->ir_offset < 0;
+	if (locked) {
+		lock_acquire(file->of_offsetlock);
+		ku.uio_offset = file->of_offset;
+		if (file->of_append && rw == UIO_WRITE) {
+			result = VOP_STAT(file->of_vnode, &info);
+			if (result) {
+				lock_release(file->of_offsetlock);
+				return -result;
+			}
+			ku.uio_offset = info.st_size;
+		}
+	}
+
+	result = (rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, &ku) :
+		VOP_WRITE(file->of_vnode, &ku);
+
+	if (locked) {
+		if (!result) {
+			file->of_offset = ku.uio_offset;
+		}
+		lock_release(file->of_offsetlock);
+	}
+
+	return result ? -result : (int)(req->ir_len - ku.uio_resid);
+}
+
+static void ioctx_free(struct ioctx *ctx);
+
+/*
+ * Hand a finished request back to its process, or throw it away if
+ * the process is gone.
+ */
+static
+void
+ioreq_finish(struct ioreq *req)
+{
+	struct ioctx *ctx = req->ir_ctx;
+	bool last;
+
+	lock_acquire(ctx->ic_lock);
+	KASSERT(ctx->ic_inflight > 0);
+	ctx->ic_inflight--;
+	if (ctx->ic_dying) {
+		last = ctx->ic_inflight == 0;
+		lock_release(ctx->ic_lock);
+		ioreq_destroy(req);
+		if (last) {
+			ioctx_free(ctx);
+		}
+		return;
+	}
+	ctx->ic_ndone++;
+	*ctx->ic_donetail = req;
+	ctx->ic_donetail = &req->ir_next;
+	cv_broadcast(ctx->ic_cv, ctx->ic_lock);
+	lock_release(ctx->ic_lock);
+}
+
+////////////////////////////////////////////////////////////
+// worker threads
+
+static
+void
+ioring_worker(void *unused1, unsigned long unused2)
+{
+	struct ioreq *req;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		lock_acquire(ioq_lock);
+		while (ioq_head == NULL) {
+			cv_wait(ioq_cv, ioq_lock);
+		}
+		req = ioq_head;
+		ioq_head = req->ir_next;
+		if (ioq_head == NULL) {
+			ioq_tail = &ioq_head;
+		}
+		lock_release(ioq_lock);
+
+		req->ir_next = NULL;
+		req->ir_res = ioreq_run(req);
+		ioreq_finish(req);
+	}
+}
+
+static
+void
+ioring_queue(struct ioreq *req)
+{
+	lock_acquire(ioq_lock);
+	*ioq_tail = req;
+	ioq_tail = &req->ir_next;
+	cv_signal(ioq_cv, ioq_lock);
+	lock_release(ioq_lock);
+}
+
+/*
+ * Setup function.
+ */
+void
+ioring_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	ioq_lock = lock_create("ioq");
+	ioq_cv = cv_create("ioq");
+	if (ioq_lock == NULL || ioq_cv == NULL) {
+		panic("ioring_bootstrap: out of memory\n");
+	}
+
+	for (i=0; i<IORING_WORKERS; i++) {
+		result = thread_fork("ioring", NULL, ioring_worker, NULL, 0);
+		if (result) {
+			panic("ioring_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// per-process context
+
+static
+struct ioctx *
+ioctx_create(void)
+{
+	struct ioctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	ctx->ic_enterlock = lock_create("io_enter");
+	if (ctx->ic_enterlock == NULL) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ic_lock = lock_create("ioctx");
+	if (ctx->ic_lock == NULL) {
+		lock_destroy(ctx->ic_enterlock);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ic_cv = cv_create("ioctx");
+	if (ctx->ic_cv == NULL) {
+		lock_destroy(ctx->ic_lock);
+		lock_destroy(ctx->ic_enterlock);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ic_ring = NULL;
+	ctx->ic_sqhead = 0;
+	ctx->ic_cqtail = 0;
+	ctx->ic_inflight = 0;
+	ctx->ic_ndone = 0;
+	ctx->ic_done = NULL;
+	ctx->ic_donetail = &ctx->ic_done;
+	ctx->ic_dying = false;
+	return ctx;
+}
+
+static
+void
+ioctx_free(struct ioctx *ctx)
+{
+	KASSERT(ctx->ic_done == NULL);
+	cv_destroy(ctx->ic_cv);
+	lock_destroy(ctx->ic_lock);
+	lock_destroy(ctx->ic_enterlock);
+	kfree(ctx);
+}
+
+/*
+ * Clean up at process exit or exec: throw away the completions nobody
+ * collected, and leave anything still being worked on to be thrown
+ * away (and the context freed) by the workers when it finishes.
+ */
+void
+ioctx_destroy(struct ioctx *ctx)
+{
+	struct ioreq *req;
+	bool idle;
+
+	lock_acquire(ctx->ic_lock);
+	while (ctx->ic_done != NULL) {
+		req = ctx->ic_done;
+		ctx->ic_done = req->ir_next;
+		ioreq_destroy(req);
+	}
+	ctx->ic_donetail = &ctx->ic_done;
+	ctx->ic_ndone = 0;
+	idle = ctx->ic_inflight == 0;
+	ctx->ic_dying = true;
+	lock_release(ctx->ic_lock);
+
+	if (idle) {
+		ioctx_free(ctx);
+	}
+}
+
+/*
+ * Put requests back at the front of the done list, after a failed
+ * copyout in ioctx_post.
+ */
+static
+void
+ioctx_unpost(struct ioctx *ctx, struct ioreq *reqs, unsigned n)
+{
+	struct ioreq **tailp;
+
+	if (reqs == NULL) {
+		return;
+	}
+	for (tailp = &reqs; *tailp != NULL; tailp = &(*tailp)->ir_next) {
+		/* find the end */
+	}
+
+	lock_acquire(ctx->ic_lock);
+	*tailp = ctx->ic_done;
+	if (ctx->ic_done == NULL) {
+		ctx->ic_donetail = tailp;
+	}
+	ctx->ic_done = reqs;
+	ctx->ic_ndone += n;
+	lock_release(ctx->ic_lock);
+}
+
+/*
+ * Post finished requests to the completion ring until it's full or
+ * we run out. Must hold the enter lock, and not the context lock,
+ * which is only taken to take requests off the done list. Returns the
+ * number of completions in the ring the process hasn't consumed yet.
+ */
+static
+int
+ioctx_post(struct ioctx *ctx, unsigned *avail_ret)
+{
+	struct ioring_cqe cqe;
+	struct ioreq *reqs, *req, **tailp;
+	unsigned cqhead, room, n;
+	int result;
+
+	KASSERT(lock_do_i_hold(ctx->ic_enterlock));
+
+	result = copyin(RING_FIELD(ctx->ic_ring, cq_head),
+			&cqhead, sizeof(cqhead));
+	if (result) {
+		return result;
+	}
+	if (ctx->ic_cqtail - cqhead > IORING_CQ_ENTRIES) {
+		/* The process has scribbled on its cq_head. */
+		return EINVAL;
+	}
+	room = IORING_CQ_ENTRIES - (ctx->ic_cqtail - cqhead);
+
+	/* Take as many as fit off the done list. */
+	lock_acquire(ctx->ic_lock);
+	reqs = ctx->ic_done;
+	tailp = &reqs;
+	for (n = 0; n < room && *tailp != NULL; n++) {
+		tailp = &(*tailp)->ir_next;
+	}
+	ctx->ic_done = *tailp;
+	if (ctx->ic_done == NULL) {
+		ctx->ic_donetail = &ctx->ic_done;
+	}
+	*tailp = NULL;
+	ctx->ic_ndone -= n;
+	lock_release(ctx->ic_lock);
+
+	while (reqs != NULL) {
+		req = reqs;
+
+		if (req->ir_op == IORING_OP_READ && req->ir_res > 0) {
+			result = copyout(req->ir_kbuf, req->ir_ubuf,
+					 req->ir_res);
+			if (result) {
+				req->ir_res = -result;
+			}
+		}
+
+		cqe.cqe_userdata = req->ir_userdata;
+		cqe.cqe_res = req->ir_res;
+		result = copyout(&cqe,
+			RING_FIELD(ctx->ic_ring,
+			   cq[ctx->ic_cqtail & (IORING_CQ_ENTRIES - 1)]),
+			sizeof(cqe));
+		if (result) {
+			ioctx_unpost(ctx, reqs, n);
+			return result;
+		}
+		ctx->ic_cqtail++;
+
+		reqs = req->ir_next;
+		n--;
+		ioreq_destroy(req);
+	}
+
+	result = copyout(&ctx->ic_cqtail, RING_FIELD(ctx->ic_ring, cq_tail),
+			 sizeof(ctx->ic_cqtail));
+	if (result) {
+		return result;
+	}
+
+	*avail_ret = ctx->ic_cqtail - cqhead;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// the system call
+
+/*
+ * io_enter: take up to TO_SUBMIT requests from the submission ring
+ * in RING, then wait until at least MIN_COMPLETE completions are
+ * waiting in the completion ring (or nothing more is coming). Returns
+ * the number of requests submitted.
+ *
+ * The number of requests a process can have outstanding (submitted
+ * but not yet posted) is limited to the size of the completion ring,
+ * so completions always have somewhere to go eventually. Submissions
+ * beyond that stay in the submission ring for next time.
+ */
+static
+int
+io_enter(struct ioctx *ctx, userptr_t ring, unsigned to_submit,
+	 unsigned min_complete, int *retval)
+{
+	struct ioring_sqe sqe;
+	struct ioreq *req;
+	unsigned sqtail, avail, room, submitted;
+	bool wait;
+	int result;
+
+	if (ring != ctx->ic_ring) {
+		/* New ring: pick up where its counters are. */
+		result = copyin(RING_FIELD(ring, sq_head), &ctx->ic_sqhead,
+				sizeof(ctx->ic_sqhead));
+		if (!result) {
+			result = copyin(RING_FIELD(ring, cq_tail),
+					&ctx->ic_cqtail,
+					sizeof(ctx->ic_cqtail));
+		}
+		if (result) {
+			ctx->ic_ring = NULL;
+			return result;
+		}
+		ctx->ic_ring = ring;
+	}
+
+	/* Submit. */
+	result = copyin(RING_FIELD(ring, sq_tail), &sqtail, sizeof(sqtail));
+	if (result) {
+		return result;
+	}
+	if (sqtail - ctx->ic_sqhead > IORING_SQ_ENTRIES) {
+		return EINVAL;
+	}
+	if (to_submit > sqtail - ctx->ic_sqhead) {
+		to_submit = sqtail - ctx->ic_sqhead;
+	}
+
+	/* Only we add to these, so the room can only grow meanwhile. */
+	lock_acquire(ctx->ic_lock);
+	room = IORING_CQ_ENTRIES - (ctx->ic_inflight + ctx->ic_ndone);
+	lock_release(ctx->ic_lock);
+	if (to_submit > room) {
+		to_submit = room;
+	}
+
+	submitted = 0;
+	while (submitted < to_submit) {
+		result = copyin(RING_FIELD(ring,
+				   sq[ctx->ic_sqhead & (IORING_SQ_ENTRIES - 1)]),
+				&sqe, sizeof(sqe));
+		if (result) {
+			break;
+		}
+		result = ioreq_create(ctx, &sqe, &req);
+		if (result) {
+			break;
+		}
+		ctx->ic_sqhead++;
+		submitted++;
+
+		lock_acquire(ctx->ic_lock);
+		if (req->ir_res == 0) {
+			ctx->ic_inflight++;
+		}
+		else {
+			/* Failed already; it's done. */
+			ctx->ic_ndone++;
+			*ctx->ic_donetail = req;
+			ctx->ic_donetail = &req->ir_next;
+		}
+		lock_release(ctx->ic_lock);
+
+		if (req->ir_res == 0) {
+			ioring_queue(req);
+		}
+	}
+	if (result && submitted == 0) {
+		return result;
+	}
+
+	result = copyout(&ctx->ic_sqhead, RING_FIELD(ring, sq_head),
+			 sizeof(ctx->ic_sqhead));
+	if (result) {
+		return result;
+	}
+
+	/* Post completions, waiting for more if asked to. */
+	while (1) {
+		result = ioctx_post(ctx, &avail);
+		if (result) {
+			return result;
+		}
+		if (avail >= min_complete) {
+			break;
+		}
+
+		/*
+		 * Wait for something to post, unless there's nothing
+		 * more coming. If there's something on the done list
+		 * already, the ring has room for it; go round again.
+		 */
+		lock_acquire(ctx->ic_lock);
+		wait = ctx->ic_inflight > 0 || ctx->ic_done != NULL;
+		while (ctx->ic_done == NULL && ctx->ic_inflight > 0) {
+			cv_wait(ctx->ic_cv, ctx->ic_lock);
+		}
+		lock_release(ctx->ic_lock);
+		if (!wait) {
+			break;
+		}
+	}
+
+	*retval = submitted;
+	return 0;
+}
+
+int
+sys_io_enter(userptr_t ring, unsigned to_submit, unsigned min_complete,
+	     int *retval)
+{
+	struct ioctx *ctx;
+	int result;
+
+	if (min_complete > IORING_CQ_ENTRIES) {
+		return EINVAL;
+	}
+
+	ctx = curproc->p_ioctx;
+	if (ctx == NULL) {
+		ctx = ioctx_create();
+		if (ctx == NULL) {
+			return ENOMEM;
+		}
+		curproc->p_ioctx = ctx;
+	}
+
+	lock_acquire(ctx->ic_enterlock);
+	result = io_enter(ctx, ring, to_submit, min_complete, retval);
+	lock_release(ctx->ic_enterlock);
+	return result;
+}
@@ -44,7 +44,7 @@
  */
 static
 struct openfile *
-openfile_create(struct vnode *vn, int accmode)
+openfile_create(struct vnode *vn, int accmode, bool append)
 {
 	struct openfile *file;
 
@@ -68,6 +68,7 @@ openfile_create(struct vnode *vn, int accmode)
 
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
+	file->of_append = append;
 	file->of_offset = 0;
 	file->of_refcount = 1;
 
@@ -106,7 +107,8 @@ openfile_open(char *filename, int openflags, mode_t mode,
 		return result;
 	}
 
-	file = openfile_create(vn, openflags & O_ACCMODE);
+	file = openfile_create(vn, openflags & O_ACCMODE,
+			       (openflags & O_APPEND) != 0);
 	if (file == NULL) {
 		vfs_close(vn);
 		return ENOMEM;
@@ -116,6 +118,25 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap a vnode we already have (such as one end of a pipe) in an
+ * openfile object. Consumes the caller's reference to the vnode on
+ * success.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode, false);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -33,6 +33,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <machine/trapframe.h>
@@ -42,6 +44,7 @@
 #include <current.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <filetable.h>
 #include <syscall.h>
 
 /* note that sys_execv is in runprogram.c */
@@ -157,3 +160,60 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	}
 	return result;
 }
+
+/*
+ * sys_getrlimit, sys_setrlimit
+ *
+ * The only limit we enforce is RLIMIT_NOFILE, which is kept in the
+ * file table. Everything else reads as unlimited and can't be set.
+ */
+int
+sys_getrlimit(int resource, userptr_t rlp)
+{
+	struct rlimit rl;
+	unsigned cur, max;
+
+	if (resource < 0 || resource >= __RLIMIT_NUM) {
+		return EINVAL;
+	}
+
+	if (resource == RLIMIT_NOFILE) {
+		filetable_getlimit(curproc->p_filetable, &cur, &max);
+		rl.rlim_cur = cur;
+		rl.rlim_max = max;
+	}
+	else {
+		rl.rlim_cur = RLIM_INFINITY;
+		rl.rlim_max = RLIM_INFINITY;
+	}
+
+	return copyout(&rl, rlp, sizeof(rl));
+}
+
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+	struct rlimit rl;
+	unsigned cur, max;
+	int result;
+
+	if (resource != RLIMIT_NOFILE) {
+		return EINVAL;
+	}
+
+	result = copyin(rlp, &rl, sizeof(rl));
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Anything past what the table can hold is as good as infinity.
+	 * This has to be clamped: the limit decides which fds get handed
+	 * out, and filetable_grow asserts it's never asked for one at or
+	 * past FILETABLE_MAX.
+	 */
+	cur = rl.rlim_cur > FILETABLE_MAX ? FILETABLE_MAX : rl.rlim_cur;
+	max = rl.rlim_max > FILETABLE_MAX ? FILETABLE_MAX : rl.rlim_max;
+
+	return filetable_setlimit(curproc->p_filetable, cur, max);
+}
@@ -47,6 +47,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <ioring.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -431,7 +432,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -591,6 +596,17 @@ sys_execv(userptr_t prog, userptr_t uargv)
 		return result;
 	}
 
+	/*
+	 * Drop any io_enter context. Its requests point into the old
+	 * image, so their completions mustn't land in the new one. Not
+	 * before loadexec, though: if that fails, the old image carries
+	 * on and still wants them.
+	 */
+	if (curproc->p_ioctx != NULL) {
+		ioctx_destroy(curproc->p_ioctx);
+		curproc->p_ioctx = NULL;
+	}
+
 	/* don't need this any more */
 	kfree(path);
 
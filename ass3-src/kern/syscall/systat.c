@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call statistics and tracing. See <systat.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <machine/cycles.h>
+#include <spinlock.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <mips/trapframe.h>
+#include <systat.h>
+
+/*
+ * Names of the calls we implement, for printing.
+ */
+static const char *const systat_names[SYSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_getrlimit] = "getrlimit",
+	[SYS_setrlimit] = "setrlimit",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_lseek] = "lseek",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_link] = "link",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_rename] = "rename",
+	[SYS_chdir] = "chdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_fstat] = "fstat",
+	[SYS___time] = "__time",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_sync] = "sync",
+	[SYS_reboot] = "reboot",
+	[SYS_futex] = "futex",
+	[SYS_copy_file_range] = "copy_file_range",
+	[SYS_io_enter] = "io_enter",
+	[SYS_systat] = "systat",
+	[SYS___kdata] = "__kdata",
+};
+
+/*
+ * The trace log: the last SYSTAT_TRACESIZE calls made while tracing
+ * was on. Entry N (counting from 0 since the last reset) lives in
+ * slot N % SYSTAT_TRACESIZE.
+ */
+static struct spinlock systat_loglock = SPINLOCK_INITIALIZER_NAMED("systat");
+static struct systat_trace systat_log[SYSTAT_TRACESIZE];
+static unsigned systat_seq;		/* entries logged */
+static volatile bool systat_tracing;
+
+static
+const char *
+systat_name(int callno)
+{
+	if (callno >= 0 && callno < SYSTAT_NCALLS &&
+	    systat_names[callno] != NULL) {
+		return systat_names[callno];
+	}
+	return "?";
+}
+
+/*
+ * Set up a cpu's table. Called from cpu_create. Each call number's
+ * counts are allocated separately, because the whole table is bigger
+ * than a page and kmalloc can't give us that once the VM system is up.
+ */
+void
+systat_cpuinit(struct cpu *c)
+{
+	unsigned i;
+
+	c->c_systat = kmalloc(SYSTAT_NCALLS * sizeof(*c->c_systat));
+	if (c->c_systat == NULL) {
+		panic("systat_cpuinit: Out of memory\n");
+	}
+	for (i=0; i<SYSTAT_NCALLS; i++) {
+		c->c_systat[i] = kmalloc(sizeof(struct systat_call));
+		if (c->c_systat[i] == NULL) {
+			panic("systat_cpuinit: Out of memory\n");
+		}
+		bzero(c->c_systat[i], sizeof(struct systat_call));
+	}
+}
+
+/*
+ * Note when (and where) a call started.
+ */
+void
+systat_start(struct systat_stamp *ss)
+{
+	int spl;
+
+	spl = splhigh();
+	ss->ss_cycles = cpu_getcycles();
+	ss->ss_cpu = curcpu->c_self;
+	splx(spl);
+}
+
+/*
+ * Histogram bucket for a latency: floor(log2(cycles)).
+ */
+static
+unsigned
+systat_bucket(uint32_t cycles)
+{
+	unsigned b;
+
+	b = 0;
+	while (cycles > 1) {
+		cycles >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Count a finished call, and log it if tracing is on.
+ */
+void
+systat_record(int callno, const struct trapframe *tf,
+	      int retval, int err, const struct systat_stamp *ss)
+{
+	struct systat_call *sc;
+	struct systat_trace *st;
+	uint32_t cycles;
+	bool timed;
+	int spl;
+
+	spl = splhigh();
+
+	/*
+	 * Cycle counters on different cpus don't agree, so if the
+	 * call slept and woke up somewhere else we can't time it.
+	 */
+	timed = ss->ss_cpu == curcpu->c_self;
+	cycles = timed ? cpu_getcycles() - ss->ss_cycles : 0;
+
+	if (callno >= 0 && callno < SYSTAT_NCALLS &&
+	    curcpu->c_systat != NULL) {
+		sc = curcpu->c_systat[callno];
+		sc->sc_count++;
+		if (err) {
+			sc->sc_errors++;
+		}
+		if (timed) {
+			sc->sc_timed++;
+			sc->sc_cycles += cycles;
+			if (cycles > sc->sc_maxcycles) {
+				sc->sc_maxcycles = cycles;
+			}
+			sc->sc_hist[systat_bucket(cycles)]++;
+		}
+	}
+
+	if (systat_tracing) {
+		spinlock_acquire(&systat_loglock);
+		st = &systat_log[systat_seq % SYSTAT_TRACESIZE];
+		st->st_seq = systat_seq++;
+		st->st_pid = curproc->p_pid;
+		st->st_callno = callno;
+		st->st_args[0] = tf->tf_a0;
+		st->st_args[1] = tf->tf_a1;
+		st->st_args[2] = tf->tf_a2;
+		st->st_args[3] = tf->tf_a3;
+		st->st_retval = err ? -1 : retval;
+		st->st_err = err;
+		st->st_cycles = cycles;
+		spinlock_release(&systat_loglock);
+	}
+
+	splx(spl);
+}
+
+/*
+ * Add up CALLNO's counts over all cpus. The other cpus keep counting
+ * while we read, so this is only approximate.
+ */
+static
+void
+systat_merge(int callno, struct systat_call *total)
+{
+	const struct systat_call *sc;
+	unsigned ncpus, c, i;
+
+	bzero(total, sizeof(*total));
+	ncpus = cpu_count();
+	for (c=0; c<ncpus; c++) {
+		sc = cpu_getnum(c)->c_systat[callno];
+		total->sc_count += sc->sc_count;
+		total->sc_errors += sc->sc_errors;
+		total->sc_timed += sc->sc_timed;
+		total->sc_cycles += sc->sc_cycles;
+		if (sc->sc_maxcycles > total->sc_maxcycles) {
+			total->sc_maxcycles = sc->sc_maxcycles;
+		}
+		for (i=0; i<SYSTAT_BUCKETS; i++) {
+			total->sc_hist[i] += sc->sc_hist[i];
+		}
+	}
+}
+
+/*
+ * Print a line per call number that has been used or, if CALLNO is
+ * not negative, CALLNO's latency histogram.
+ */
+void
+systat_print(int callno)
+{
+	struct systat_call sc;
+	unsigned i, lo, hi, most, stars;
+	int n;
+
+	if (callno >= SYSTAT_NCALLS) {
+		kprintf("systat: No call %d\n", callno);
+		return;
+	}
+
+	if (callno >= 0) {
+		systat_merge(callno, &sc);
+		kprintf("%s (%d): %u calls, %u errors, %u timed\n",
+			systat_name(callno), callno,
+			sc.sc_count, sc.sc_errors, sc.sc_timed);
+		lo = SYSTAT_BUCKETS;
+		hi = most = 0;
+		for (i=0; i<SYSTAT_BUCKETS; i++) {
+			if (sc.sc_hist[i] == 0) {
+				continue;
+			}
+			if (lo == SYSTAT_BUCKETS) {
+				lo = i;
+			}
+			hi = i;
+			if (sc.sc_hist[i] > most) {
+				most = sc.sc_hist[i];
+			}
+		}
+		for (i=lo; i<=hi && i<SYSTAT_BUCKETS; i++) {
+			stars = sc.sc_hist[i] * 40ULL / most;
+			kprintf("%10u -> %-10u %8u ",
+				i == 0 ? 0 : 1U << i, (2U << i) - 1,
+				sc.sc_hist[i]);
+			while (stars-- > 0) {
+				kprintf("*");
+			}
+			kprintf("\n");
+		}
+		return;
+	}
+
+	kprintf("%-16s %4s %10s %8s %12s %10s\n",
+		"call", "num", "calls", "errors", "avg cycles", "max");
+	for (n=0; n<SYSTAT_NCALLS; n++) {
+		systat_merge(n, &sc);
+		if (sc.sc_count == 0) {
+			continue;
+		}
+		kprintf("%-16s %4d %10u %8u %12llu %10u\n",
+			systat_name(n), n, sc.sc_count, sc.sc_errors,
+			sc.sc_timed ? sc.sc_cycles / sc.sc_timed : 0ULL,
+			sc.sc_maxcycles);
+	}
+	kprintf("(_exit and successful execv are not counted)\n");
+}
+
+/*
+ * Print the last MAX calls in the trace log, oldest first.
+ */
+void
+systat_printtrace(unsigned max)
+{
+	struct systat_trace st;
+	unsigned seq, first;
+
+	spinlock_acquire(&systat_loglock);
+	seq = systat_seq;
+	spinlock_release(&systat_loglock);
+
+	if (max > SYSTAT_TRACESIZE) {
+		max = SYSTAT_TRACESIZE;
+	}
+	first = seq > max ? seq - max : 0;
+
+	for (; first < seq; first++) {
+		spinlock_acquire(&systat_loglock);
+		st = systat_log[first % SYSTAT_TRACESIZE];
+		spinlock_release(&systat_loglock);
+		if (st.st_seq != first) {
+			/* overwritten while we were printing */
+			continue;
+		}
+		kprintf("%6u [%d] %s(0x%x, 0x%x, 0x%x, 0x%x) = %d",
+			st.st_seq, st.st_pid, systat_name(st.st_callno),
+			st.st_args[0], st.st_args[1],
+			st.st_args[2], st.st_args[3], st.st_retval);
+		if (st.st_err) {
+			kprintf(" %s", strerror(st.st_err));
+		}
+		if (st.st_cycles) {
+			kprintf(" <%u>", st.st_cycles);
+		}
+		kprintf("\n");
+	}
+	kprintf("(%s; %u calls logged)\n",
+		systat_tracing ? "tracing" : "not tracing", seq);
+}
+
+void
+systat_settrace(bool on)
+{
+	systat_tracing = on;
+}
+
+/*
+ * Clear all the cpus' counts and the trace log. Like printing, this
+ * races with other cpus counting, so a few counts may survive.
+ */
+void
+systat_reset(void)
+{
+	unsigned ncpus, c, i;
+
+	ncpus = cpu_count();
+	for (c=0; c<ncpus; c++) {
+		for (i=0; i<SYSTAT_NCALLS; i++) {
+			bzero(cpu_getnum(c)->c_systat[i],
+			      sizeof(struct systat_call));
+		}
+	}
+
+	spinlock_acquire(&systat_loglock);
+	systat_seq = 0;
+	bzero(systat_log, sizeof(systat_log));
+	spinlock_release(&systat_loglock);
+}
+
+/*
+ * The systat system call. See <kern/systat.h>.
+ */
+int
+sys_systat(int op, userptr_t buf, size_t len, int *retval)
+{
+	struct systat_call sc;
+	struct systat_trace st;
+	unsigned n, i, seq, first;
+	int result;
+
+	switch (op) {
+	    case SYSTAT_STATS:
+		n = len / sizeof(sc);
+		if (n > SYSTAT_NCALLS) {
+			n = SYSTAT_NCALLS;
+		}
+		for (i=0; i<n; i++) {
+			systat_merge(i, &sc);
+			result = copyout(&sc, buf + i * sizeof(sc),
+					 sizeof(sc));
+			if (result) {
+				return result;
+			}
+		}
+		*retval = n;
+		return 0;
+
+	    case SYSTAT_TRACE:
+		spinlock_acquire(&systat_loglock);
+		seq = systat_seq;
+		spinlock_release(&systat_loglock);
+
+		n = len / sizeof(st);
+		if (n > SYSTAT_TRACESIZE) {
+			n = SYSTAT_TRACESIZE;
+		}
+		if (n > seq) {
+			n = seq;
+		}
+		first = seq - n;
+
+		/* Can't copyout while holding a spinlock, so go one by one. */
+		for (i=0; i<n; i++) {
+			spinlock_acquire(&systat_loglock);
+			st = systat_log[(first + i) % SYSTAT_TRACESIZE];
+			spinlock_release(&systat_loglock);
+			result = copyout(&st, buf + i * sizeof(st),
+					 sizeof(st));
+			if (result) {
+				return result;
+			}
+		}
+		*retval = n;
+		return 0;
+
+	    case SYSTAT_RESET:
+		systat_reset();
+		break;
+
+	    case SYSTAT_TRACEON:
+		systat_settrace(true);
+		break;
+
+	    case SYSTAT_TRACEOFF:
+		systat_settrace(false);
+		break;
+
+	    default:
+		return EINVAL;
+	}
+
+	*retval = 0;
+	return 0;
+}
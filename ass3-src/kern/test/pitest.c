@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Priority inheritance tests.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define PI_LOW		10
+#define PI_MED		30
+#define PI_HIGH		70
+
+#define PI_MEDSECS	5	/* how long the medium threads hog the cpus */
+#define PI_LOWWORK	200	/* yields the low thread makes holding the lock */
+
+static struct lock *lock_a;
+static struct lock *lock_b;
+static struct semaphore *readysem;
+static struct semaphore *gosem;
+static struct semaphore *donesem;
+
+static struct spinlock pi_countlock = SPINLOCK_INITIALIZER;
+static volatile unsigned nmedsrunning;
+static volatile bool medsdone;
+static volatile bool highwon;
+
+static
+void
+makeitems(void)
+{
+	lock_a = lock_create("pitest-a");
+	lock_b = lock_create("pitest-b");
+	readysem = sem_create("pitest-ready", 0);
+	gosem = sem_create("pitest-go", 0);
+	donesem = sem_create("pitest-done", 0);
+	if (lock_a == NULL || lock_b == NULL || readysem == NULL ||
+	    gosem == NULL || donesem == NULL) {
+		panic("pitest: out of memory\n");
+	}
+}
+
+static
+void
+destroyitems(void)
+{
+	lock_destroy(lock_a);
+	lock_destroy(lock_b);
+	sem_destroy(readysem);
+	sem_destroy(gosem);
+	sem_destroy(donesem);
+}
+
+static
+void
+forkorpanic(const char *name, void (*func)(void *, unsigned long))
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+/*
+ * Wait until some thread is waiting for LK. Sleep rather than yield,
+ * since we outrank the low-priority test threads.
+ */
+static
+void
+waitforwaiter(struct lock *lk)
+{
+	while (lk->lk_waiters == NULL) {
+		clocksleep(1);
+	}
+}
+
+static
+void
+checkpri(const char *who, int pri)
+{
+	if (curthread->t_pri != pri) {
+		panic("pitest: %s has priority %d, expected %d\n",
+		      who, curthread->t_pri, pri);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// inversion
+
+/*
+ * Classic priority inversion: a low-priority thread holds a lock that
+ * a high-priority thread wants, while medium-priority threads keep
+ * every cpu busy. Without inheritance the low thread never gets to
+ * run, and the high thread waits until the medium ones give up.
+ */
+
+static
+void
+pi1_low(void *junk, unsigned long junk2)
+{
+	int i;
+
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_LOW);
+	lock_acquire(lock_a);
+	V(readysem);
+
+	/* Hold on until the hogs are all running, then work a bit. */
+	P(gosem);
+	for (i=0; i<PI_LOWWORK; i++) {
+		thread_yield();
+	}
+	checkpri("low thread", PI_HIGH);
+	lock_release(lock_a);
+	checkpri("low thread", PI_LOW);
+	V(donesem);
+}
+
+static
+void
+pi1_high(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_HIGH);
+	lock_acquire(lock_a);
+	highwon = !medsdone;
+	lock_release(lock_a);
+	V(donesem);
+}
+
+static
+void
+pi1_med(void *junk, unsigned long junk2)
+{
+	struct timespec start, now;
+
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_MED);
+	spinlock_acquire(&pi_countlock);
+	nmedsrunning++;
+	spinlock_release(&pi_countlock);
+
+	/* Burn cpu without ever blocking. */
+	gettime(&start);
+	do {
+		gettime(&now);
+	} while (now.tv_sec - start.tv_sec < PI_MEDSECS);
+
+	medsdone = true;
+	V(donesem);
+}
+
+int
+pitest(int nargs, char **args)
+{
+	unsigned i, nmeds;
+
+	(void)nargs;
+	(void)args;
+
+	makeitems();
+	nmedsrunning = 0;
+	medsdone = false;
+	highwon = false;
+	nmeds = cpu_count();
+
+	kprintf("Starting priority inversion test...\n");
+	forkorpanic("pi1-low", pi1_low);
+	P(readysem);
+	forkorpanic("pi1-high", pi1_high);
+	waitforwaiter(lock_a);
+	for (i=0; i<nmeds; i++) {
+		forkorpanic("pi1-med", pi1_med);
+	}
+	while (nmedsrunning < nmeds) {
+		clocksleep(1);
+	}
+	V(gosem);
+	for (i=0; i<nmeds+2; i++) {
+		P(donesem);
+	}
+	if (!highwon) {
+		panic("pitest: high-priority thread was held up "
+		      "by medium-priority ones\n");
+	}
+	destroyitems();
+	kprintf("Priority inversion test done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// chains
+
+/*
+ * Transitive inheritance: thread 1 holds A; thread 2 holds B and
+ * waits for A; thread 3 (high priority) waits for B. Thread 1 should
+ * run at thread 3's priority until it releases A, and thread 2 until
+ * it releases B. Everyone should end up back where they started.
+ */
+
+static
+void
+pi2_first(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_LOW);
+	lock_acquire(lock_a);
+	V(readysem);
+	P(gosem);
+	checkpri("thread 1", PI_HIGH);
+	lock_release(lock_a);
+	checkpri("thread 1", PI_LOW);
+	V(donesem);
+}
+
+static
+void
+pi2_second(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_LOW);
+	lock_acquire(lock_b);
+	V(readysem);
+	lock_acquire(lock_a);
+	checkpri("thread 2", PI_HIGH);
+	lock_release(lock_a);
+	checkpri("thread 2", PI_HIGH);
+	lock_release(lock_b);
+	checkpri("thread 2", PI_LOW);
+	V(donesem);
+}
+
+static
+void
+pi2_third(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	thread_setpriority(PI_HIGH);
+	lock_acquire(lock_b);
+	checkpri("thread 3", PI_HIGH);
+	lock_release(lock_b);
+	V(donesem);
+}
+
+int
+pitest2(int nargs, char **args)
+{
+	int i;
+
+	(void)nargs;
+	(void)args;
+
+	makeitems();
+
+	kprintf("Starting priority inheritance chain test...\n");
+	forkorpanic("pi2-1", pi2_first);
+	P(readysem);
+	forkorpanic("pi2-2", pi2_second);
+	P(readysem);
+	waitforwaiter(lock_a);
+	forkorpanic("pi2-3", pi2_third);
+	waitforwaiter(lock_b);
+	V(gosem);
+	for (i=0; i<3; i++) {
+		P(donesem);
+	}
+	destroyitems();
+	kprintf("Priority inheritance chain test done.\n");
+	return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reader-writer lock tests.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NRWTHREADS	32
+#define NRWLOOPS	200
+#define RWWRITEREVERY	8	/* one thread in this many is a writer */
+
+static struct rwlock *testrw;
+static struct semaphore *donesem;
+static volatile unsigned long testval1;
+static volatile unsigned long testval2;
+static volatile unsigned nreaders;	/* readers inside right now */
+static volatile unsigned maxreaders;	/* most readers seen inside */
+static volatile bool entered;		/* set by the probe threads */
+
+static
+void
+makeitems(int mode)
+{
+	testrw = rwlock_create("testrw", mode);
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	donesem = sem_create("donesem", 0);
+	if (donesem == NULL) {
+		panic("rwtest: sem_create failed\n");
+	}
+}
+
+static
+void
+destroyitems(void)
+{
+	rwlock_destroy(testrw);
+	sem_destroy(donesem);
+	testrw = NULL;
+	donesem = NULL;
+}
+
+////////////////////////////////////////////////////////////
+// stress test
+
+/*
+ * Writers set testval1 and testval2 to the same value, yielding in
+ * between; readers check that they never see them differ. Readers
+ * also count how many of them are inside at once.
+ */
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % RWWRITEREVERY == 0) {
+			rwlock_acquire_write(testrw);
+			if (nreaders != 0) {
+				panic("rwt1: thread %lu: writer with %u "
+				      "readers\n", num, nreaders);
+			}
+			testval1 = num;
+			thread_yield();
+			testval2 = num;
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			nreaders++;
+			if (nreaders > maxreaders) {
+				maxreaders = nreaders;
+			}
+			if (testval1 != testval2) {
+				panic("rwt1: thread %lu: saw %lu/%lu\n",
+				      num, testval1, testval2);
+			}
+			thread_yield();
+			if (testval1 != testval2) {
+				panic("rwt1: thread %lu: saw %lu/%lu\n",
+				      num, testval1, testval2);
+			}
+			nreaders--;
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+rwstress(int mode)
+{
+	int i, result;
+
+	makeitems(mode);
+	testval1 = testval2 = 0;
+	nreaders = maxreaders = 0;
+
+	for (i=0; i<NRWTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwt1: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("  at most %u readers at once\n", maxreaders);
+	destroyitems();
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting rwlock test...\n");
+	kprintf("Reader preference:\n");
+	rwstress(RWLOCK_PREFER_READER);
+	kprintf("Writer preference:\n");
+	rwstress(RWLOCK_PREFER_WRITER);
+	kprintf("Rwlock test done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// preference tests
+
+static
+void
+probereader(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	rwlock_acquire_read(testrw);
+	entered = true;
+	rwlock_release_read(testrw);
+	V(donesem);
+}
+
+static
+void
+probewriter(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	rwlock_acquire_write(testrw);
+	rwlock_release_write(testrw);
+	V(donesem);
+}
+
+static
+void
+forkprobe(void (*func)(void *, unsigned long))
+{
+	int result;
+
+	result = thread_fork("rwtest probe", NULL, func, NULL, 0);
+	if (result) {
+		panic("rwtest: thread_fork failed: %s\n", strerror(result));
+	}
+	kprintf("Sleeping for probe to run\n");
+	clocksleep(1);
+}
+
+/*
+ * While we hold a read lock, another reader gets in at once; a writer
+ * then waits. Whether a reader arriving after the writer gets in
+ * depends on the mode.
+ */
+static
+void
+rwprefer(const char *name, int mode)
+{
+	makeitems(mode);
+
+	rwlock_acquire_read(testrw);
+
+	entered = false;
+	forkprobe(probereader);
+	if (!entered) {
+		panic("%s: second reader was kept out\n", name);
+	}
+	P(donesem);
+
+	forkprobe(probewriter);
+	KASSERT(testrw->rwlk_wwaiting == 1);
+
+	entered = false;
+	forkprobe(probereader);
+	if (mode == RWLOCK_PREFER_READER && !entered) {
+		panic("%s: reader waited behind a writer\n", name);
+	}
+	if (mode == RWLOCK_PREFER_WRITER && entered) {
+		panic("%s: reader jumped ahead of a waiting writer\n", name);
+	}
+
+	rwlock_release_read(testrw);
+	P(donesem);
+	P(donesem);
+	KASSERT(entered);
+
+	kprintf("Test passed; now cleaning up.\n");
+	destroyitems();
+}
+
+int
+rwtest2(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	rwprefer("rwt2", RWLOCK_PREFER_READER);
+	return 0;
+}
+
+int
+rwtest3(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	rwprefer("rwt3", RWLOCK_PREFER_WRITER);
+	return 0;
+}
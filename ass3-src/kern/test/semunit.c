@@ -28,8 +28,10 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <wchan.h>
 #include <synch.h>
 #include <thread.h>
 #include <current.h>
@@ -818,3 +820,159 @@ semu22(int nargs, char **args)
 	panic("semu22: P tolerated null semaphore\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// timed and try variants
+
+/*
+ * Return nanoseconds elapsed since START.
+ */
+static
+uint64_t
+nsecs_since(const struct timespec *start)
+{
+	struct timespec now, diff;
+
+	gettime(&now);
+	timespec_sub(&now, start, &diff);
+	return (uint64_t)diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+}
+
+/*
+ * A thread that Vs a semaphore after a short nap.
+ */
+static
+void
+latev(void *vsem, unsigned long junk)
+{
+	struct semaphore *sem = vsem;
+	struct timespec ts;
+
+	(void)junk;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200000000;
+	if (timespec_sleep(&ts)) {
+		panic("semunit: timespec_sleep failed\n");
+	}
+	V(sem);
+}
+
+/*
+ * 23. P_timed on a semaphore nobody Vs:
+ *     - returns ETIMEDOUT
+ *     - not before the timeout is up
+ *     - leaves the count at 0 and the wchan empty
+ *     - leaves sem_lock unheld
+ */
+int
+semu23(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct timespec ts, start;
+	int result;
+
+	(void)nargs; (void)args;
+
+	sem = makesem(0);
+	ts.tv_sec = 0;
+	ts.tv_nsec = 300000000;
+	gettime(&start);
+	result = P_timed(sem, &ts);
+	KASSERT(result == ETIMEDOUT);
+	KASSERT(nsecs_since(&start) >= 300000000);
+	KASSERT(sem->sem_count == 0);
+	spinlock_acquire(&sem->sem_lock);
+	KASSERT(wchan_isempty(sem->sem_wchan, &sem->sem_lock));
+	spinlock_release(&sem->sem_lock);
+	KASSERT(spinlock_not_held(&sem->sem_lock));
+
+	ok();
+	/* clean up */
+	sem_destroy(sem);
+	return 0;
+}
+
+/*
+ * 24. P_timed on a semaphore whose count is positive returns 0 at
+ * once and decrements the count.
+ */
+int
+semu24(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct timespec ts;
+	int result;
+
+	(void)nargs; (void)args;
+
+	sem = makesem(2);
+	ts.tv_sec = 0;
+	ts.tv_nsec = 0;
+	result = P_timed(sem, &ts);
+	KASSERT(result == 0);
+	KASSERT(sem->sem_count == 1);
+
+	ok();
+	/* clean up */
+	sem_destroy(sem);
+	return 0;
+}
+
+/*
+ * 25. P_timed on a semaphore that is Ved before the timeout returns
+ * 0, well before the timeout, and leaves the count at 0.
+ */
+int
+semu25(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct timespec ts, start;
+	int result;
+
+	(void)nargs; (void)args;
+
+	sem = makesem(0);
+	result = thread_fork("semu25", NULL, latev, sem, 0);
+	if (result) {
+		panic("semu25: thread_fork failed\n");
+	}
+	ts.tv_sec = 10;
+	ts.tv_nsec = 0;
+	gettime(&start);
+	result = P_timed(sem, &ts);
+	KASSERT(result == 0);
+	KASSERT(nsecs_since(&start) < 5000000000ULL);
+	KASSERT(sem->sem_count == 0);
+
+	ok();
+	/* clean up */
+	sem_destroy(sem);
+	return 0;
+}
+
+/*
+ * 26. P_try:
+ *     - fails and leaves the count alone if the count is 0
+ *     - succeeds and decrements the count if it isn't
+ */
+int
+semu26(int nargs, char **args)
+{
+	struct semaphore *sem;
+
+	(void)nargs; (void)args;
+
+	sem = makesem(0);
+	KASSERT(!P_try(sem));
+	KASSERT(sem->sem_count == 0);
+	V(sem);
+	KASSERT(P_try(sem));
+	KASSERT(sem->sem_count == 0);
+	KASSERT(spinlock_not_held(&sem->sem_lock));
+
+	ok();
+	/* clean up */
+	sem_destroy(sem);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spinlock microbenchmark: ticket locks against MCS locks.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NSPLOOPS	20000
+#define MAXSPTHREADS	8
+
+static struct spinlock ticketlock = SPINLOCK_INITIALIZER_NAMED("spt-ticket");
+static struct spinlock mcslock = SPINLOCK_INITIALIZER_MCS("spt-mcs");
+static struct semaphore *donesem;
+static volatile bool go;
+static volatile unsigned long counter;
+
+/*
+ * Wait for the starting gun, then hammer the lock with a trivial
+ * critical section.
+ */
+static
+void
+spinthread(void *lkv, unsigned long junk)
+{
+	struct spinlock *lk = lkv;
+	int i;
+
+	(void)junk;
+
+	while (!go) {
+		thread_yield();
+	}
+	for (i=0; i<NSPLOOPS; i++) {
+		spinlock_acquire(lk);
+		counter++;
+		spinlock_release(lk);
+	}
+	V(donesem);
+}
+
+static
+void
+runone(struct spinlock *lk, const char *kind, unsigned nthreads)
+{
+	struct timespec before, after, diff;
+	uint64_t usecs, total;
+	unsigned i;
+	int result;
+
+	go = false;
+	counter = 0;
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinlocktest", NULL, spinthread, lk, i);
+		if (result) {
+			panic("spinlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&before);
+	go = true;
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+
+	total = (uint64_t)nthreads * NSPLOOPS;
+	if (counter != total) {
+		panic("spinlocktest: %s lock lost updates (%lu of %llu)\n",
+		      kind, counter, (unsigned long long)total);
+	}
+
+	timespec_sub(&after, &before, &diff);
+	usecs = (uint64_t)diff.tv_sec * 1000000 + diff.tv_nsec / 1000;
+	kprintf("%-6s %u threads: %llu acquires in %llu.%06lu seconds", kind,
+		nthreads, (unsigned long long)total,
+		(unsigned long long)diff.tv_sec,
+		(unsigned long)(diff.tv_nsec / 1000));
+	if (usecs > 0) {
+		kprintf(" (%llu/sec)",
+			(unsigned long long)(total * 1000000ULL / usecs));
+	}
+	kprintf("\n");
+}
+
+/*
+ * Run 1, 2, 4, and 8 threads against each kind of lock. Runs with more
+ * threads than cpus still work, but then measure the scheduler more
+ * than the lock.
+ */
+int
+spinlocktest(int nargs, char **args)
+{
+	unsigned n;
+
+	(void)nargs;
+	(void)args;
+
+	donesem = sem_create("spinlocktest", 0);
+	if (donesem == NULL) {
+		panic("spinlocktest: sem_create failed\n");
+	}
+
+	kprintf("Starting spinlock test on %u cpus...\n", cpu_count());
+	for (n=1; n<=MAXSPTHREADS; n*=2) {
+		runone(&ticketlock, "ticket", n);
+		runone(&mcslock, "mcs", n);
+	}
+	kprintf("Spinlock test done.\n");
+
+	sem_destroy(donesem);
+	donesem = NULL;
+	return 0;
+}
@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <clock.h>
@@ -400,3 +401,165 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Timed lock and CV waits.
+ *
+ * A helper thread holds the lock for a while; lock_acquire_timed with
+ * a shorter timeout must fail, and with a longer one must succeed.
+ * Then cv_timedwait must time out when nobody signals, and not when
+ * somebody does, coming back holding the lock either way. Last, a
+ * signal that arrives before the timeout, from a thread that then
+ * hangs on to the lock until after it, must still count as a signal.
+ */
+
+#define TT_HOLDNSECS	500000000	/* how long the helper holds the lock */
+
+static struct semaphore *ttsem;
+
+static
+void
+setts(struct timespec *ts, time_t secs, long nsecs)
+{
+	ts->tv_sec = secs;
+	ts->tv_nsec = nsecs;
+}
+
+static
+void
+ttholder(void *junk1, unsigned long junk2)
+{
+	struct timespec ts;
+
+	(void)junk1;
+	(void)junk2;
+
+	lock_acquire(testlock);
+	V(ttsem);
+	setts(&ts, 0, TT_HOLDNSECS);
+	timespec_sleep(&ts);
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+void
+ttsignaller(void *junk1, unsigned long junk2)
+{
+	struct timespec ts;
+
+	(void)junk1;
+	(void)junk2;
+
+	/* Wait for the main thread to be asleep on the CV. */
+	P(ttsem);
+	lock_acquire(testlock);
+	lock_release(testlock);
+	setts(&ts, 0, 100000000);
+	timespec_sleep(&ts);
+
+	lock_acquire(testlock);
+	cv_signal(testcv, testlock);
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+void
+ttracer(void *junk1, unsigned long junk2)
+{
+	struct timespec ts;
+
+	(void)junk1;
+	(void)junk2;
+
+	/* We get the lock once the main thread is asleep on the CV. */
+	lock_acquire(testlock);
+	cv_signal(testcv, testlock);
+	setts(&ts, 1, 0);
+	timespec_sleep(&ts);
+	lock_release(testlock);
+	V(donesem);
+}
+
+int
+timedsynchtest(int nargs, char **args)
+{
+	struct timespec ts;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	ttsem = sem_create("ttsem", 0);
+	if (ttsem == NULL) {
+		panic("timedsynchtest: sem_create failed\n");
+	}
+	kprintf("Starting timed lock/CV test...\n");
+
+	result = thread_fork("ttholder", NULL, ttholder, NULL, 0);
+	if (result) {
+		panic("timedsynchtest: thread_fork failed\n");
+	}
+	P(ttsem);
+
+	setts(&ts, 0, 100000000);
+	result = lock_acquire_timed(testlock, &ts);
+	if (result != ETIMEDOUT) {
+		panic("timedsynchtest: lock_acquire_timed didn't time out\n");
+	}
+	KASSERT(!lock_do_i_hold(testlock));
+	KASSERT(testlock->lk_waiters == NULL);
+
+	setts(&ts, 10, 0);
+	result = lock_acquire_timed(testlock, &ts);
+	if (result != 0) {
+		panic("timedsynchtest: lock_acquire_timed: %s\n",
+		      strerror(result));
+	}
+	KASSERT(lock_do_i_hold(testlock));
+	P(donesem);
+
+	setts(&ts, 0, 100000000);
+	result = cv_timedwait(testcv, testlock, &ts);
+	if (result != ETIMEDOUT) {
+		panic("timedsynchtest: cv_timedwait didn't time out\n");
+	}
+	KASSERT(lock_do_i_hold(testlock));
+
+	result = thread_fork("ttsignaller", NULL, ttsignaller, NULL, 0);
+	if (result) {
+		panic("timedsynchtest: thread_fork failed\n");
+	}
+	V(ttsem);
+	setts(&ts, 10, 0);
+	result = cv_timedwait(testcv, testlock, &ts);
+	if (result != 0) {
+		panic("timedsynchtest: cv_timedwait: %s\n", strerror(result));
+	}
+	KASSERT(lock_do_i_hold(testlock));
+	P(donesem);
+
+	/* Signal, then the timeout while we wait for the lock. */
+	result = thread_fork("ttracer", NULL, ttracer, NULL, 0);
+	if (result) {
+		panic("timedsynchtest: thread_fork failed\n");
+	}
+	setts(&ts, 0, 300000000);
+	result = cv_timedwait(testcv, testlock, &ts);
+	if (result != 0) {
+		panic("timedsynchtest: cv_timedwait lost a signal that "
+		      "raced the timeout: %s\n", strerror(result));
+	}
+	KASSERT(lock_do_i_hold(testlock));
+	lock_release(testlock);
+	P(donesem);
+
+	sem_destroy(ttsem);
+	ttsem = NULL;
+	kprintf("Timed lock/CV test done.\n");
+	return 0;
+}
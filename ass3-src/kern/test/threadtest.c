@@ -32,11 +32,13 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NFORKS    2000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +146,60 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+emptythread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Fork-rate benchmark: fork NFORKS threads that exit right away,
+ * NTHREADS at a time, and report threads created per second.
+ */
+int
+threadtest4(int nargs, char **args)
+{
+	struct timespec before, after, diff;
+	uint64_t usecs;
+	int i, j, result;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread fork rate test...\n");
+
+	gettime(&before);
+	for (i=0; i<NFORKS; i+=NTHREADS) {
+		for (j=0; j<NTHREADS; j++) {
+			result = thread_fork("forkrate", NULL, emptythread,
+					     NULL, j);
+			if (result) {
+				panic("threadtest4: thread_fork failed %s)\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<NTHREADS; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&after);
+
+	timespec_sub(&after, &before, &diff);
+	usecs = (uint64_t)diff.tv_sec * 1000000 + diff.tv_nsec / 1000;
+	kprintf("%d threads in %llu.%06lu seconds", NFORKS,
+		(unsigned long long)diff.tv_sec,
+		(unsigned long)(diff.tv_nsec / 1000));
+	if (usecs > 0) {
+		kprintf(" (%llu threads/sec)",
+			(unsigned long long)(NFORKS * 1000000ULL / usecs));
+	}
+	kprintf("\nThread fork rate test done.\n");
+
+	return 0;
+}
@@ -28,19 +28,22 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <kdata.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * This is pretty primitive. Callbacks can be scheduled for points in
+ * the future with timeouts (below), but a real kernel would have
+ * more of the infrastructure around them.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -51,13 +54,270 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Timer wheel.
+ *
+ * Pending timeouts are hashed by the hardclock tick their deadline
+ * falls in into one of TIMEOUT_BUCKETS lists. Each time the wheel is
+ * run, the buckets for the ticks since the last run are checked and
+ * anything whose deadline has passed is fired; timeouts more than a
+ * full turn of the wheel away just stay put until their turn comes
+ * round again. CPU 0 runs the wheel from hardclock, and a spare timer
+ * device (if there is one) runs it between ticks for timeouts due
+ * sooner than the next tick.
+ */
+#define TIMEOUT_BUCKETS		256	/* must be a power of 2 */
+#define TICK_NSECS		(1000000000ULL / HZ)
+
+static struct spinlock timeout_lock = SPINLOCK_INITIALIZER_NAMED("timeout");
+static struct timeout *timeout_wheel[TIMEOUT_BUCKETS];
+static unsigned timeout_count;		/* number pending */
+static uint64_t timeout_lasttick;	/* tick the wheel last ran for */
+
+/* One-shot timer device, if any, and when it is next due to go off */
+static void (*timeout_oneshot_start)(void *dev, uint32_t usecs);
+static void *timeout_oneshot_dev;
+static uint64_t timeout_oneshot_due;	/* 0 if not running */
+
+static
+uint64_t
+timeout_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Set up the wheel. Also called by hardclock_bootstrap.
+ */
+static
+void
+timeout_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<TIMEOUT_BUCKETS; i++) {
+		timeout_wheel[i] = NULL;
+	}
+	timeout_count = 0;
+	timeout_lasttick = 0;
+	timeout_oneshot_due = 0;
+}
+
+/*
+ * Put the one-shot timer (if any) on the earliest deadline in the
+ * next tick's worth of buckets, unless it is already going to go off
+ * by then. Must hold timeout_lock.
+ */
+static
+void
+timeout_arm_oneshot(uint64_t now)
+{
+	struct timeout *to;
+	uint64_t soonest, tick;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&timeout_lock));
+
+	if (timeout_oneshot_start == NULL) {
+		return;
+	}
+	if (timeout_oneshot_due != 0 && timeout_oneshot_due <= now) {
+		/* Already went off; the interrupt is on its way. */
+		timeout_oneshot_due = 0;
+	}
+
+	soonest = 0;
+	tick = now / TICK_NSECS;
+	for (i=0; i<2; i++) {
+		for (to = timeout_wheel[(tick + i) % TIMEOUT_BUCKETS];
+		     to != NULL; to = to->to_next) {
+			if (to->to_deadline > now &&
+			    to->to_deadline < now + TICK_NSECS &&
+			    (soonest == 0 || to->to_deadline < soonest)) {
+				soonest = to->to_deadline;
+			}
+		}
+	}
+
+	if (soonest == 0) {
+		return;
+	}
+	if (timeout_oneshot_due != 0 && timeout_oneshot_due <= soonest) {
+		return;
+	}
+	timeout_oneshot_due = soonest;
+	timeout_oneshot_start(timeout_oneshot_dev,
+			      (uint32_t)((soonest - now + 999) / 1000));
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = to->to_prev = NULL;
+	to->to_deadline = 0;
+	to->to_bucket = 0;
+	to->to_func = func;
+	to->to_data = data;
+	to->to_pending = false;
+}
+
+void
+timeout_add(struct timeout *to, const struct timespec *delay)
+{
+	uint64_t now, tick;
+	unsigned bucket;
+
+	KASSERT(delay->tv_sec >= 0);
+	KASSERT(delay->tv_nsec >= 0 && delay->tv_nsec < 1000000000);
+
+	now = timeout_now();
+
+	spinlock_acquire(&timeout_lock);
+	KASSERT(!to->to_pending);
+
+	to->to_deadline = now + (uint64_t)delay->tv_sec * 1000000000ULL
+		+ delay->tv_nsec;
+
+	if (timeout_count == 0) {
+		/* Wheel was idle; nothing older than now to catch up on */
+		timeout_lasttick = now / TICK_NSECS;
+	}
+	tick = to->to_deadline / TICK_NSECS;
+	if (tick < timeout_lasttick) {
+		tick = timeout_lasttick;
+	}
+	bucket = tick % TIMEOUT_BUCKETS;
+
+	to->to_bucket = bucket;
+	to->to_prev = NULL;
+	to->to_next = timeout_wheel[bucket];
+	if (to->to_next != NULL) {
+		to->to_next->to_prev = to;
+	}
+	timeout_wheel[bucket] = to;
+	to->to_pending = true;
+	timeout_count++;
+
+	timeout_arm_oneshot(now);
+	spinlock_release(&timeout_lock);
+}
+
+/*
+ * Take a pending timeout off the wheel. Must hold timeout_lock.
+ */
+static
+void
+timeout_remove(struct timeout *to)
+{
+	KASSERT(spinlock_do_i_hold(&timeout_lock));
+	KASSERT(to->to_pending);
+
+	if (to->to_prev != NULL) {
+		to->to_prev->to_next = to->to_next;
+	}
+	else {
+		timeout_wheel[to->to_bucket] = to->to_next;
+	}
+	if (to->to_next != NULL) {
+		to->to_next->to_prev = to->to_prev;
+	}
+	to->to_next = to->to_prev = NULL;
+	to->to_pending = false;
+	KASSERT(timeout_count > 0);
+	timeout_count--;
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool ret;
+
+	spinlock_acquire(&timeout_lock);
+	ret = to->to_pending;
+	if (ret) {
+		timeout_remove(to);
+	}
+	spinlock_release(&timeout_lock);
+	return ret;
+}
+
+/*
+ * Fire everything whose deadline has passed. The functions are called
+ * without timeout_lock held, so they may add timeouts themselves.
+ */
+static
+void
+timeout_run(void)
+{
+	struct timeout *to, *next, *expired;
+	uint64_t now, tick, nowtick;
+	unsigned n;
+
+	/*
+	 * Unlocked peek: an empty wheel is the common case, and
+	 * there's no sense reading the clock for it. A timeout added
+	 * just now will be seen on the next tick.
+	 */
+	if (timeout_count == 0) {
+		return;
+	}
+
+	now = timeout_now();
+	nowtick = now / TICK_NSECS;
+	expired = NULL;
+
+	spinlock_acquire(&timeout_lock);
+	tick = timeout_lasttick;
+	for (n=0; tick <= nowtick && n < TIMEOUT_BUCKETS; tick++, n++) {
+		for (to = timeout_wheel[tick % TIMEOUT_BUCKETS];
+		     to != NULL; to = next) {
+			next = to->to_next;
+			if (to->to_deadline <= now) {
+				/* Reuse to_next to chain up the expired list */
+				timeout_remove(to);
+				to->to_next = expired;
+				expired = to;
+			}
+		}
+	}
+	timeout_lasttick = nowtick;
+	timeout_arm_oneshot(now);
+	spinlock_release(&timeout_lock);
+
+	while (expired != NULL) {
+		to = expired;
+		expired = to->to_next;
+		to->to_next = NULL;
+		/* TO may be reused or freed as soon as FUNC is called */
+		to->to_func(to->to_data);
+	}
+}
+
+void
+timeout_setoneshot(void (*start)(void *dev, uint32_t usecs), void *dev)
+{
+	spinlock_acquire(&timeout_lock);
+	KASSERT(timeout_oneshot_start == NULL);
+	timeout_oneshot_dev = dev;
+	timeout_oneshot_start = start;
+	spinlock_release(&timeout_lock);
+}
+
+/*
+ * Called from the one-shot timer's interrupt handler.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+void
+timeout_oneshot(void)
+{
+	spinlock_acquire(&timeout_lock);
+	timeout_oneshot_due = 0;
+	spinlock_release(&timeout_lock);
+	timeout_run();
+}
 
 /*
  * Setup.
@@ -65,11 +325,7 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
+	timeout_bootstrap();
 }
 
 /*
@@ -79,10 +335,10 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	/*
+	 * Nothing to do; sleepers are woken individually by their
+	 * own timeouts now rather than all at once here.
+	 */
 }
 
 /*
@@ -96,26 +352,97 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	/*
+	 * There is no periodic load balancing here; idle cpus pull
+	 * work for themselves in thread_switch (see thread_steal).
+	 * Since hardclock also runs on idle cpus, the interrupt
+	 * taken here is what gets an idle cpu to go looking.
+	 */
 	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
+
+	/* One cpu is enough to turn the timer wheel and keep the time. */
+	if (curcpu->c_number == 0) {
+		timeout_run();
+		kdata_tick();
 	}
+
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	thread_yield();
 }
 
+/*
+ * State for a thread sleeping in timespec_sleep. It lives on the
+ * sleeping thread's stack.
+ */
+struct clocksleeper {
+	struct timeout cs_timeout;
+	struct spinlock cs_lock;
+	struct wchan *cs_wchan;
+	volatile bool cs_done;
+};
+
+/*
+ * Timeout function: wake up one sleeper.
+ */
+static
+void
+clocksleep_wakeup(void *data)
+{
+	struct clocksleeper *cs = data;
+
+	spinlock_acquire(&cs->cs_lock);
+	cs->cs_done = true;
+	wchan_wakeone(cs->cs_wchan, &cs->cs_lock);
+	spinlock_release(&cs->cs_lock);
+}
+
+/*
+ * Suspend execution for the given length of time.
+ */
+int
+timespec_sleep(const struct timespec *duration)
+{
+	struct clocksleeper cs;
+
+	if (duration->tv_sec == 0 && duration->tv_nsec == 0) {
+		return 0;
+	}
+
+	cs.cs_wchan = wchan_create("clocksleep");
+	if (cs.cs_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&cs.cs_lock);
+	cs.cs_done = false;
+	timeout_init(&cs.cs_timeout, clocksleep_wakeup, &cs);
+
+	spinlock_acquire(&cs.cs_lock);
+	timeout_add(&cs.cs_timeout, duration);
+	while (!cs.cs_done) {
+		wchan_sleep(cs.cs_wchan, &cs.cs_lock);
+	}
+	spinlock_release(&cs.cs_lock);
+
+	spinlock_cleanup(&cs.cs_lock);
+	wchan_destroy(cs.cs_wchan);
+	return 0;
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	struct timespec ts;
+	int result;
+
+	ts.tv_sec = num_secs;
+	ts.tv_nsec = 0;
+	result = timespec_sleep(&ts);
+	if (result) {
+		panic("clocksleep: %s\n", strerror(result));
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -180,3 +180,29 @@ hangman_release(struct hangman_actor *a,
 
 	spinlock_release(&hangman_lock);
 }
+
+/*
+ * Note that a has stopped waiting for l without getting it (e.g.
+ * because the wait timed out).
+ */
+void
+hangman_giveup(struct hangman_actor *a,
+	       struct hangman_lockable *l)
+{
+	if (l == &hangman_lock.splk_hangman) {
+		/* don't recurse */
+		return;
+	}
+
+	spinlock_acquire(&hangman_lock);
+
+	if (a->a_waiting != l) {
+		spinlock_release(&hangman_lock);
+		panic("hangman_giveup: not waiting for lock %s (%p)\n",
+		      l->l_name, l);
+	}
+
+	a->a_waiting = NULL;
+
+	spinlock_release(&hangman_lock);
+}
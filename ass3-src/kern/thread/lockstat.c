@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See <lockstat.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <current.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_SLOTS	64	/* per cpu; must be a power of 2 */
+#define LOCKSTAT_PROBE	8	/* slots to try before giving up */
+
+/*
+ * Per-cpu, per-lock counts. Each cpu's table has LOCKSTAT_SLOTS
+ * entries hashed by lock address, plus one more at the end that
+ * collects everything that didn't fit.
+ */
+struct lockstat_entry {
+	const void *le_lock;		/* NULL if slot is free */
+	const char *le_name;
+	unsigned le_acquires;
+	unsigned le_contended;
+	uint64_t le_waitcycles;		/* total, contended acquires only */
+	uint32_t le_waitmax;
+	uint64_t le_holdcycles;
+	uint32_t le_holdmax;
+};
+
+/*
+ * Set up a cpu's table. Called from cpu_create.
+ */
+void
+lockstat_cpuinit(struct cpu *c)
+{
+	c->c_lockstat = NULL;
+	c->c_lockstat = kmalloc((LOCKSTAT_SLOTS + 1) * sizeof(*c->c_lockstat));
+	if (c->c_lockstat == NULL) {
+		panic("lockstat_cpuinit: Out of memory\n");
+	}
+	bzero(c->c_lockstat, (LOCKSTAT_SLOTS + 1) * sizeof(*c->c_lockstat));
+	c->c_lockstat[LOCKSTAT_SLOTS].le_lock = c;
+	c->c_lockstat[LOCKSTAT_SLOTS].le_name = "(other)";
+}
+
+/*
+ * Find (or make) the entry for LOCK in this cpu's table. Must be
+ * called with interrupts off so we stay on this cpu. Returns NULL if
+ * the cpu has no table yet.
+ */
+static
+struct lockstat_entry *
+lockstat_find(const void *lock, const char *name)
+{
+	struct lockstat_entry *table, *le;
+	uint32_t h;
+	unsigned i;
+
+	table = curcpu->c_lockstat;
+	if (table == NULL) {
+		return NULL;
+	}
+
+	h = ((uint32_t)(uintptr_t)lock >> 2) * 2654435761U;
+	for (i=0; i<LOCKSTAT_PROBE; i++) {
+		le = &table[(h + i) & (LOCKSTAT_SLOTS - 1)];
+		if (le->le_lock == lock) {
+			return le;
+		}
+		if (le->le_lock == NULL) {
+			le->le_lock = lock;
+			le->le_name = name;
+			return le;
+		}
+	}
+	return &table[LOCKSTAT_SLOTS];
+}
+
+void
+lockstat_acquired(struct lockstat_lockable *ll, const void *lock,
+		  uint32_t waitstart, bool contended)
+{
+	struct lockstat_entry *le;
+	uint32_t now, wait;
+
+	now = cpu_getcycles();
+	ll->ll_acquired = now;
+	ll->ll_cpu = curcpu->c_self;
+
+	le = lockstat_find(lock, ll->ll_name);
+	if (le == NULL) {
+		return;
+	}
+	le->le_acquires++;
+	if (contended) {
+		wait = now - waitstart;
+		le->le_contended++;
+		le->le_waitcycles += wait;
+		if (wait > le->le_waitmax) {
+			le->le_waitmax = wait;
+		}
+	}
+}
+
+void
+lockstat_released(struct lockstat_lockable *ll, const void *lock)
+{
+	struct lockstat_entry *le;
+	uint32_t hold;
+
+	/*
+	 * Cycle counters on different cpus don't agree, so if a sleep
+	 * lock's holder moved cpus we can't tell how long it held it.
+	 */
+	if (ll->ll_cpu != curcpu->c_self) {
+		return;
+	}
+	hold = cpu_getcycles() - ll->ll_acquired;
+	ll->ll_cpu = NULL;
+
+	le = lockstat_find(lock, ll->ll_name);
+	if (le == NULL) {
+		return;
+	}
+	le->le_holdcycles += hold;
+	if (hold > le->le_holdmax) {
+		le->le_holdmax = hold;
+	}
+}
+
+/*
+ * Add SRC's counts into DEST.
+ */
+static
+void
+lockstat_merge(struct lockstat_entry *dest, const struct lockstat_entry *src)
+{
+	dest->le_acquires += src->le_acquires;
+	dest->le_contended += src->le_contended;
+	dest->le_waitcycles += src->le_waitcycles;
+	if (src->le_waitmax > dest->le_waitmax) {
+		dest->le_waitmax = src->le_waitmax;
+	}
+	dest->le_holdcycles += src->le_holdcycles;
+	if (src->le_holdmax > dest->le_holdmax) {
+		dest->le_holdmax = src->le_holdmax;
+	}
+}
+
+/*
+ * Print the MAXLOCKS locks with the most contended acquisitions,
+ * summed over all cpus. The other cpus keep updating their tables
+ * while we read them, so the numbers are only approximate.
+ */
+void
+lockstat_print(unsigned maxlocks)
+{
+	struct lockstat_entry *all, *le, *best;
+	const struct lockstat_entry *src;
+	unsigned ncpus, nall, c, i, j;
+	struct cpu *cpu;
+
+	ncpus = cpu_count();
+	all = kmalloc(ncpus * (LOCKSTAT_SLOTS + 1) * sizeof(*all));
+	if (all == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	/* Merge the per-cpu tables by lock address. (Quadratic, but small.) */
+	nall = 0;
+	for (c=0; c<ncpus; c++) {
+		cpu = cpu_getnum(c);
+		for (i=0; i<=LOCKSTAT_SLOTS; i++) {
+			src = &cpu->c_lockstat[i];
+			if (src->le_lock == NULL || src->le_acquires == 0) {
+				continue;
+			}
+			/* all the cpus' overflow entries merge together */
+			for (j=0; j<nall; j++) {
+				if (all[j].le_lock == src->le_lock ||
+				    (i == LOCKSTAT_SLOTS &&
+				     all[j].le_name == src->le_name)) {
+					break;
+				}
+			}
+			if (j == nall) {
+				bzero(&all[nall], sizeof(all[nall]));
+				all[nall].le_lock = src->le_lock;
+				all[nall].le_name = src->le_name;
+				nall++;
+			}
+			lockstat_merge(&all[j], src);
+		}
+	}
+
+	kprintf("%-16s %-10s %10s %10s %12s %10s %12s %10s\n",
+		"lock", "address", "acquires", "contended",
+		"avg wait", "max wait", "avg hold", "max hold");
+
+	for (i=0; i<maxlocks && i<nall; i++) {
+		/* selection sort, most contended first */
+		best = &all[i];
+		for (j=i+1; j<nall; j++) {
+			if (all[j].le_contended > best->le_contended) {
+				best = &all[j];
+			}
+		}
+		if (best != &all[i]) {
+			struct lockstat_entry tmp;
+
+			tmp = all[i];
+			all[i] = *best;
+			*best = tmp;
+		}
+		le = &all[i];
+		kprintf("%-16s %p %10u %10u %12llu %10u %12llu %10u\n",
+			le->le_name, le->le_lock,
+			le->le_acquires, le->le_contended,
+			le->le_contended ?
+			le->le_waitcycles / le->le_contended : 0ULL,
+			le->le_waitmax,
+			le->le_holdcycles / le->le_acquires,
+			le->le_holdmax);
+	}
+	kprintf("(%u locks seen; times are in cycles)\n", nall);
+
+	kfree(all);
+}
+
+/*
+ * Clear all the cpus' tables. Like printing, this races with other
+ * cpus updating their tables, so a few counts may survive.
+ */
+void
+lockstat_reset(void)
+{
+	unsigned ncpus, c, i;
+	struct cpu *cpu;
+	struct lockstat_entry *le;
+
+	ncpus = cpu_count();
+	for (c=0; c<ncpus; c++) {
+		cpu = cpu_getnum(c);
+		for (i=0; i<=LOCKSTAT_SLOTS; i++) {
+			le = &cpu->c_lockstat[i];
+			le->le_acquires = 0;
+			le->le_contended = 0;
+			le->le_waitcycles = 0;
+			le->le_waitmax = 0;
+			le->le_holdcycles = 0;
+			le->le_holdmax = 0;
+		}
+	}
+}
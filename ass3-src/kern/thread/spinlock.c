@@ -41,8 +41,25 @@
 
 /*
  * Spinlocks.
+ *
+ * Ticket locks split splk_lock into two 16-bit halves: the top half
+ * is the next ticket to hand out and the bottom half is the ticket
+ * now being served. The lock is free when the two are equal. (16 bits
+ * is plenty; it would take 65536 cpus waiting at once to wrap.)
+ *
+ * MCS locks keep a pointer to the last waiter's queue node in
+ * splk_lock, or 0 if the lock is free. See spinlock.h.
  */
 
+#define TICKET_ONE		0x10000
+#define TICKET_NEXT(v)		((v) >> 16)
+#define TICKET_SERVING(v)	((v) & 0xffff)
+
+/*
+ * Node for MCS locks taken before curcpu exists. There's only one cpu
+ * running then, and nothing holds two MCS locks at once that early.
+ */
+static struct spinlock_mcsnode spinlock_bootnode;
 
 /*
  * Initialize spinlock.
@@ -52,7 +69,20 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	splk->splk_mcsnode = NULL;
+	splk->splk_mcs = false;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKSTAT_LOCKABLEINIT(&splk->splk_lockstat, "spinlock");
+}
+
+/*
+ * Initialize an MCS spinlock.
+ */
+void
+spinlock_init_mcs(struct spinlock *splk)
+{
+	spinlock_init(splk);
+	splk->splk_mcs = true;
 }
 
 /*
@@ -61,8 +91,137 @@ spinlock_init(struct spinlock *splk)
 void
 spinlock_cleanup(struct spinlock *splk)
 {
+	spinlock_data_t v;
+
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	KASSERT(splk->splk_mcsnode == NULL);
+	v = spinlock_data_get(&splk->splk_lock);
+	if (splk->splk_mcs) {
+		KASSERT(v == 0);
+	}
+	else {
+		KASSERT(TICKET_NEXT(v) == TICKET_SERVING(v));
+	}
+}
+
+/*
+ * Take a ticket and wait for it to come up. Returns true if we had
+ * to wait.
+ */
+static
+bool
+spinlock_ticket_acquire(struct spinlock *splk)
+{
+	spinlock_data_t v;
+	unsigned ticket;
+
+	v = spinlock_data_fetchadd(&splk->splk_lock, TICKET_ONE);
+	ticket = TICKET_NEXT(v);
+	if (TICKET_SERVING(v) == ticket) {
+		return false;
+	}
+	/* Only read while spinning; the holder is the only writer. */
+	while (TICKET_SERVING(spinlock_data_get(&splk->splk_lock)) != ticket) {
+		/* spin */
+	}
+	return true;
+}
+
+/*
+ * Serve the next ticket. Other cpus may be taking tickets at the same
+ * time, so this has to be atomic even though nobody else changes the
+ * serving half.
+ */
+static
+void
+spinlock_ticket_release(struct spinlock *splk)
+{
+	spinlock_data_t old, new;
+
+	do {
+		old = spinlock_data_get(&splk->splk_lock);
+		new = (old & ~0xffffU) | TICKET_SERVING(old + 1);
+	} while (spinlock_data_cas(&splk->splk_lock, old, new) != old);
+}
+
+/*
+ * Get a free queue node from this cpu. Interrupts are off, so nothing
+ * else on this cpu can be after one at the same time.
+ */
+static
+struct spinlock_mcsnode *
+spinlock_mcsnode_get(void)
+{
+	struct spinlock_mcsnode *node;
+	unsigned i;
+
+	if (!CURCPU_EXISTS()) {
+		node = &spinlock_bootnode;
+		KASSERT(!node->mn_inuse);
+		node->mn_inuse = true;
+		return node;
+	}
+	for (i=0; i<SPINLOCK_MCSNODES; i++) {
+		node = &curcpu->c_mcsnodes[i];
+		if (!node->mn_inuse) {
+			node->mn_inuse = true;
+			return node;
+		}
+	}
+	panic("spinlock: cpu %u holds too many MCS spinlocks\n",
+	      curcpu->c_number);
+	return NULL;
+}
+
+/*
+ * Join the queue and wait for our predecessor to hand over. Returns
+ * true if we had to wait.
+ */
+static
+bool
+spinlock_mcs_acquire(struct spinlock *splk)
+{
+	struct spinlock_mcsnode *node, *pred;
+
+	node = spinlock_mcsnode_get();
+	node->mn_next = NULL;
+	node->mn_waiting = true;
+	membar_store_store();
+
+	pred = (struct spinlock_mcsnode *)(uintptr_t)
+		spinlock_data_swap(&splk->splk_lock, (uintptr_t)node);
+	if (pred != NULL) {
+		pred->mn_next = node;
+		/* Spin on our own node, not the lock. */
+		while (node->mn_waiting) {
+			/* spin */
+		}
+	}
+	splk->splk_mcsnode = node;
+	return pred != NULL;
+}
+
+/*
+ * Hand the lock to the next waiter, if any, and give back our node.
+ */
+static
+void
+spinlock_mcs_release(struct spinlock *splk, struct spinlock_mcsnode *node)
+{
+	if (node->mn_next == NULL) {
+		/* Nobody queued behind us; try to mark the lock free. */
+		if (spinlock_data_cas(&splk->splk_lock, (uintptr_t)node, 0)
+		    == (uintptr_t)node) {
+			node->mn_inuse = false;
+			return;
+		}
+		/* Someone has swapped in but not linked up yet. */
+		while (node->mn_next == NULL) {
+			/* spin */
+		}
+	}
+	node->mn_next->mn_waiting = false;
+	node->mn_inuse = false;
 }
 
 /*
@@ -76,8 +235,11 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	uint32_t waitstart;
+	bool contended;
 
 	splraise(IPL_NONE, IPL_HIGH);
+	LOCKSTAT_WAITSTART(waitstart);
 
 	/* this must work before curcpu initialization */
 	if (CURCPU_EXISTS()) {
@@ -93,24 +255,11 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
-		}
-		break;
+	if (splk->splk_mcs) {
+		contended = spinlock_mcs_acquire(splk);
+	}
+	else {
+		contended = spinlock_ticket_acquire(splk);
 	}
 
 	membar_store_any();
@@ -118,6 +267,8 @@ spinlock_acquire(struct spinlock *splk)
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
+		LOCKSTAT_ACQUIRED(&splk->splk_lockstat, splk,
+				  waitstart, contended);
 	}
 }
 
@@ -127,17 +278,29 @@ spinlock_acquire(struct spinlock *splk)
 void
 spinlock_release(struct spinlock *splk)
 {
+	struct spinlock_mcsnode *node;
+
 	/* this must work before curcpu initialization */
 	if (CURCPU_EXISTS()) {
 		KASSERT(splk->splk_holder == curcpu->c_self);
 		KASSERT(curcpu->c_spinlocks > 0);
 		curcpu->c_spinlocks--;
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
+		LOCKSTAT_RELEASED(&splk->splk_lockstat, splk);
 	}
 
+	/* Once we let go the next holder owns splk_mcsnode. */
+	node = splk->splk_mcsnode;
+	splk->splk_mcsnode = NULL;
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	if (splk->splk_mcs) {
+		KASSERT(node != NULL);
+		spinlock_mcs_release(splk, node);
+	}
+	else {
+		spinlock_ticket_release(splk);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,13 +33,55 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
+#include <cpu.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
 
+////////////////////////////////////////////////////////////
+//
+// Timed waits.
+
+/*
+ * The timed operations take a relative timeout, but may sleep several
+ * times, so they work from an absolute deadline. synch_deadline works
+ * out the deadline; synch_timeleft works out how long is left before
+ * it, and returns false if it has passed.
+ */
+static
+void
+synch_deadline(const struct timespec *timeout, struct timespec *deadline)
+{
+	struct timespec now;
+
+	KASSERT(timeout->tv_sec >= 0);
+	KASSERT(timeout->tv_nsec >= 0 && timeout->tv_nsec < 1000000000);
+
+	gettime(&now);
+	timespec_add(&now, timeout, deadline);
+}
+
+static
+bool
+synch_timeleft(const struct timespec *deadline, struct timespec *left)
+{
+	struct timespec now;
+
+	gettime(&now);
+	if (now.tv_sec > deadline->tv_sec ||
+	    (now.tv_sec == deadline->tv_sec &&
+	     now.tv_nsec >= deadline->tv_nsec)) {
+		return false;
+	}
+	timespec_sub(deadline, &now, left);
+	return true;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -120,6 +162,59 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+/*
+ * P, but give up with ETIMEDOUT if the count stays 0 for TIMEOUT.
+ */
+int
+P_timed(struct semaphore *sem, const struct timespec *timeout)
+{
+	struct timespec deadline, left;
+	int result;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	synch_deadline(timeout, &deadline);
+	result = 0;
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0) {
+		if (!synch_timeleft(&deadline, &left)) {
+			result = ETIMEDOUT;
+			break;
+		}
+		/* If this times out the loop notices next time round. */
+		(void)wchan_sleep_timed(sem->sem_wchan, &sem->sem_lock,
+					&left);
+	}
+	if (result == 0) {
+		KASSERT(sem->sem_count > 0);
+		sem->sem_count--;
+	}
+	spinlock_release(&sem->sem_lock);
+	return result;
+}
+
+/*
+ * P, but only if it can be done without waiting. Returns true if it
+ * was done.
+ */
+bool
+P_try(struct semaphore *sem)
+{
+	bool ret;
+
+	KASSERT(sem != NULL);
+
+	spinlock_acquire(&sem->sem_lock);
+	ret = sem->sem_count > 0;
+	if (ret) {
+		sem->sem_count--;
+	}
+	spinlock_release(&sem->sem_lock);
+	return ret;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -138,6 +233,35 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Spin budget for adaptive locks: a contended lock_acquire spins for
+ * up to LOCK_SPIN_ROUNDS rounds of LOCK_SPIN_READS reads of
+ * lk_holder, rechecking between rounds that the holder is still
+ * running somewhere else. Past that it's cheaper to sleep.
+ */
+#define LOCK_SPIN_ROUNDS	16
+#define LOCK_SPIN_READS		64
+
+/*
+ * Priority inheritance.
+ *
+ * A thread that has to wait for a lock goes on the lock's lk_waiters
+ * list and lends its priority to the holder; if the holder is itself
+ * waiting for a lock, to that lock's holder too, and so on down the
+ * chain. Each thread keeps the locks it holds on t_heldlocks, so that
+ * when it releases one it can work out what priority it is still
+ * owed by the waiters on the others.
+ *
+ * pi_lock protects t_pri, t_waitlock, lk_waiters, and lk_holder of
+ * any lock that has waiters. That is what lets the chain be followed
+ * from lock to lock without taking each lock's lk_lock. (lk_waiters
+ * is also only changed with lk_lock held, so holders of lk_lock can
+ * check it without pi_lock.) It comes after lk_lock in the lock
+ * order. Taking and releasing a lock nobody is waiting for doesn't
+ * touch it. t_heldlocks is only touched by its own thread.
+ */
+static struct spinlock pi_lock = SPINLOCK_INITIALIZER_NAMED("lockpi");
+
 struct lock *
 lock_create(const char *name)
 {
@@ -155,6 +279,7 @@ lock_create(const char *name)
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKSTAT_LOCKABLEINIT(&lock->lk_lockstat, lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
@@ -164,6 +289,10 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_nspun = 0;
+	lock->lk_nslept = 0;
+	lock->lk_nextheld = NULL;
+	lock->lk_waiters = NULL;
 
 	return lock;
 }
@@ -174,6 +303,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_waiters == NULL);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -181,45 +311,368 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Work out what T's priority should be: its base priority or that of
+ * its most important waiter, whichever is higher. pi_lock must be
+ * held, and T must be curthread, as nobody else may look at
+ * t_heldlocks.
+ */
+static
+int
+lock_pi_compute(struct thread *t)
+{
+	struct lock *held;
+	struct thread *w;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+	KASSERT(t == curthread);
+
+	pri = t->t_basepri;
+	for (held = t->t_heldlocks; held != NULL; held = held->lk_nextheld) {
+		for (w = held->lk_waiters; w != NULL; w = w->t_nextwaiter) {
+			if (w->t_pri > pri) {
+				pri = w->t_pri;
+			}
+		}
+	}
+	return pri;
+}
+
+/*
+ * Become a waiter for LOCK and lend our priority down the chain of
+ * holders. Called with lk_lock held.
+ */
+static
 void
-lock_acquire(struct lock *lock)
+lock_pi_wait(struct lock *lock)
 {
-	DEBUGASSERT(lock != NULL);
-	KASSERT(curthread->t_in_interrupt == false);
+	struct thread *holder;
+	int pri;
 
-	spinlock_acquire(&lock->lk_lock);
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	KASSERT(curthread->t_waitlock == NULL);
+
+	spinlock_acquire(&pi_lock);
+	curthread->t_waitlock = lock;
+	curthread->t_nextwaiter = lock->lk_waiters;
+	lock->lk_waiters = curthread;
+
+	pri = curthread->t_pri;
+	while (lock != NULL) {
+		holder = lock->lk_holder;
+		if (holder == NULL || holder->t_pri >= pri) {
+			/* Nothing further down the chain can be lower. */
+			break;
+		}
+		holder->t_pri = pri;
+		lock = holder->t_waitlock;
+	}
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Stop waiting for LOCK. Needs both lk_lock and pi_lock.
+ *
+ * Any priority we lent the holder stays lent until the holder
+ * releases something; working out what it would otherwise be owed
+ * would mean walking the chain again, and this is rare (lock waits
+ * that time out).
+ */
+static
+void
+lock_pi_unwait(struct lock *lock)
+{
+	struct thread **wp;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+	KASSERT(curthread->t_waitlock == lock);
+
+	for (wp = &lock->lk_waiters; *wp != curthread;
+	     wp = &(*wp)->t_nextwaiter) {
+		KASSERT(*wp != NULL);
+	}
+	*wp = curthread->t_nextwaiter;
+	curthread->t_nextwaiter = NULL;
+	curthread->t_waitlock = NULL;
+}
+
+/*
+ * Take LOCK, which must be free, with lk_lock held. If we were
+ * waiting for it, stop; if anyone else still is, take on their
+ * priority.
+ */
+static
+void
+lock_pi_take(struct lock *lock)
+{
+	struct thread *w;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	KASSERT(lock->lk_holder == NULL);
+
+	lock->lk_nextheld = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+
+	if (lock->lk_waiters == NULL) {
+		/* Nobody can be following a chain through here. */
+		KASSERT(curthread->t_waitlock == NULL);
+		lock->lk_holder = curthread;
+		return;
+	}
+
+	spinlock_acquire(&pi_lock);
+	if (curthread->t_waitlock == lock) {
+		lock_pi_unwait(lock);
+	}
+	KASSERT(curthread->t_waitlock == NULL);
+	lock->lk_holder = curthread;
+	for (w = lock->lk_waiters; w != NULL; w = w->t_nextwaiter) {
+		if (w->t_pri > curthread->t_pri) {
+			curthread->t_pri = w->t_pri;
+		}
+	}
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Let go of LOCK, with lk_lock held, and drop back to whatever
+ * priority we're still owed.
+ */
+static
+void
+lock_pi_drop(struct lock *lock)
+{
+	struct lock **lp;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+	for (lp = &curthread->t_heldlocks; *lp != lock;
+	     lp = &(*lp)->lk_nextheld) {
+		KASSERT(*lp != NULL);
+	}
+	*lp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+
+	/*
+	 * If nobody is waiting and we aren't boosted, there's nothing
+	 * to recompute. (t_pri can go up behind our back, but only
+	 * through a lock we still hold, so it's fine to ignore that.)
+	 */
+	if (lock->lk_waiters == NULL &&
+	    curthread->t_pri == curthread->t_basepri) {
+		lock->lk_holder = NULL;
+		return;
+	}
+
+	spinlock_acquire(&pi_lock);
+	lock->lk_holder = NULL;
+	curthread->t_pri = lock_pi_compute(curthread);
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Recompute the current thread's priority after its base priority
+ * changes.
+ */
+void
+lock_repriority(void)
+{
+	spinlock_acquire(&pi_lock);
+	curthread->t_pri = lock_pi_compute(curthread);
+	spinlock_release(&pi_lock);
+}
+
+/*
+ * Check if the holder of a lock is currently running on some other
+ * cpu, in which case it's worth spinning rather than sleeping. Must
+ * hold lk_lock, which keeps the holder from releasing the lock (and
+ * possibly exiting) while we look at it.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+	struct thread *holder;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+	holder = lock->lk_holder;
+	return holder != NULL && holder->t_state == S_RUN &&
+		holder->t_cpu != curcpu->c_self;
+}
+
+/*
+ * Wait for the lock and take it. Called with lk_lock held; returns
+ * with it released. Shared by lock_acquire, lock_acquire_timed, and
+ * cv_wait. If DEADLINE isn't NULL and passes first, give up and
+ * return ETIMEDOUT; otherwise return 0.
+ */
+static
+int
+lock_wait(struct lock *lock, const struct timespec *deadline)
+{
+	struct timespec left;
+	unsigned rounds, i;
+	bool slept;
+	uint32_t waitstart;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	LOCKSTAT_WAITSTART(waitstart);
 
 	/* Call this (atomically) before waiting for a lock */
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
+	if (lock->lk_holder != NULL) {
+		lock_pi_wait(lock);
+	}
+	rounds = 0;
+	slept = false;
 	while (lock->lk_holder != NULL) {
+		if (!slept && rounds < LOCK_SPIN_ROUNDS &&
+		    lock_holder_running(lock)) {
+			/*
+			 * Spin with the spinlock dropped (and so with
+			 * interrupts back on), just watching for the
+			 * holder to let go.
+			 */
+			spinlock_release(&lock->lk_lock);
+			for (i=0; i<LOCK_SPIN_READS; i++) {
+				if (lock->lk_holder == NULL) {
+					break;
+				}
+			}
+			rounds++;
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
 		/* As in the semaphore. */
-		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		slept = true;
+		if (deadline == NULL) {
+			wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		}
+		else if (synch_timeleft(deadline, &left)) {
+			(void)wchan_sleep_timed(lock->lk_wchan,
+						&lock->lk_lock, &left);
+		}
+		else {
+			spinlock_acquire(&pi_lock);
+			lock_pi_unwait(lock);
+			spinlock_release(&pi_lock);
+			HANGMAN_GIVEUP(&curthread->t_hangman,
+				       &lock->lk_hangman);
+			spinlock_release(&lock->lk_lock);
+			return ETIMEDOUT;
+		}
+	}
+	lock_pi_take(lock);
+	/*
+	 * Holding lk_lock keeps us on this cpu, so the per-cpu totals
+	 * need no lock of their own.
+	 */
+	if (slept) {
+		lock->lk_nslept++;
+		curcpu->c_lockslept++;
+	}
+	else if (rounds > 0) {
+		lock->lk_nspun++;
+		curcpu->c_lockspun++;
 	}
-	lock->lk_holder = curthread;
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+	LOCKSTAT_ACQUIRED(&lock->lk_lockstat, lock, waitstart,
+			  slept || rounds > 0);
 
 	spinlock_release(&lock->lk_lock);
+	return 0;
 }
 
+/*
+ * Let go of the lock and wake up one waiter. Called with lk_lock
+ * held, which is still held on return. Shared by lock_release and
+ * cv_wait.
+ */
+static
 void
-lock_release(struct lock *lock)
+lock_drop(struct lock *lock)
 {
-	DEBUGASSERT(lock != NULL);
-
-	spinlock_acquire(&lock->lk_lock);
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
 
 	KASSERT(lock->lk_holder == curthread);
-	lock->lk_holder = NULL;
+	lock_pi_drop(lock);
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
 	/* Call this (atomically) when the lock is released */
 	HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
+	LOCKSTAT_RELEASED(&lock->lk_lockstat, lock);
+}
+
+void
+lock_acquire(struct lock *lock)
+{
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&lock->lk_lock);
+	(void)lock_wait(lock, NULL);
+}
+
+/*
+ * lock_acquire, but give up with ETIMEDOUT after TIMEOUT.
+ */
+int
+lock_acquire_timed(struct lock *lock, const struct timespec *timeout)
+{
+	struct timespec deadline;
+
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	synch_deadline(timeout, &deadline);
+	spinlock_acquire(&lock->lk_lock);
+	return lock_wait(lock, &deadline);
+}
+
+bool
+lock_tryacquire(struct lock *lock)
+{
+	bool ret;
+	uint32_t waitstart;
+
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+
+	KASSERT(lock->lk_holder != curthread);
+	if (lock->lk_holder == NULL) {
+		/* Won't wait, but hangman wants to see both steps */
+		LOCKSTAT_WAITSTART(waitstart);
+		HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+		lock_pi_take(lock);
+		HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+		LOCKSTAT_ACQUIRED(&lock->lk_lockstat, lock, waitstart, false);
+		ret = true;
+	}
+	else {
+		curcpu->c_locktryfail++;
+		ret = false;
+	}
 
 	spinlock_release(&lock->lk_lock);
+	return ret;
+}
+
+void
+lock_release(struct lock *lock)
+{
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock_drop(lock);
+	spinlock_release(&lock->lk_lock);
 }
 
 bool
@@ -236,10 +689,58 @@ lock_do_i_hold(struct lock *lock)
 	return ret;
 }
 
+/*
+ * Print the adaptive locking counters, summed over the cpus. Reading
+ * other cpus' counters without a lock is racy, but only by a count
+ * or two.
+ */
+void
+lock_printstats(void)
+{
+	struct cpu *c;
+	unsigned spun, slept, tryfail, i;
+
+	spun = slept = tryfail = 0;
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_getnum(i);
+		spun += c->c_lockspun;
+		slept += c->c_lockslept;
+		tryfail += c->c_locktryfail;
+	}
+
+	kprintf("Contended lock acquires: %u\n", spun + slept);
+	kprintf("    won by spinning: %u\n", spun);
+	kprintf("    slept:           %u\n", slept);
+	kprintf("Failed lock_tryacquire calls: %u\n", tryfail);
+}
+
+/*
+ * Zero the adaptive locking counters.
+ */
+void
+lock_resetstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_getnum(i);
+		c->c_lockspun = 0;
+		c->c_lockslept = 0;
+		c->c_locktryfail = 0;
+	}
+}
+
 ////////////////////////////////////////////////////////////
 //
 // CV
-
+//
+// A CV has no spinlock of its own: its wchan is protected by the
+// lk_lock of the lock it is used with. That lets cv_signal and
+// cv_broadcast, which are called with the lock held, move waiters
+// straight from the CV's wchan to the lock's (wait morphing). They
+// then wake one at a time as the lock is released, instead of all
+// waking at once just to queue up again on the lock.
 
 struct cv *
 cv_create(const char *name)
@@ -264,7 +765,6 @@ cv_create(const char *name)
 		return NULL;
 	}
 
-	spinlock_init(&cv->cv_wchanlock);
 	return cv;
 }
 
@@ -273,7 +773,6 @@ cv_destroy(struct cv *cv)
 {
 	KASSERT(cv != NULL);
 
-	spinlock_cleanup(&cv->cv_wchanlock);
 	wchan_destroy(cv->cv_wchan);
 
 	kfree(cv->cv_name);
@@ -283,35 +782,268 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-	spinlock_acquire(&cv->cv_wchanlock);
-	lock_release(lock);
-	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
 	/*
-	 * It is kind of silly to acquire this spinlock in wchan_sleep
-	 * and then release it right away. If we were going for
-	 * performance we might pass a flag to avoid that in this
-	 * case. Or we might use lock->lk_lock to protect the wchan
-	 * and separate out enough of the lock_acquire/lock_release
-	 * logic to make that work cleanly.
+	 * Releasing the lock and going to sleep happen under the one
+	 * spinlock, so no wakeup can slip in between. We come back
+	 * with lk_lock held, usually having been moved onto the
+	 * lock's wchan and woken by lock_release, and go straight
+	 * on to retake the lock.
 	 */
-	spinlock_release(&cv->cv_wchanlock);
-	lock_acquire(lock);
+	spinlock_acquire(&lock->lk_lock);
+	lock_drop(lock);
+	wchan_sleep(cv->cv_wchan, &lock->lk_lock);
+	(void)lock_wait(lock, NULL);
+}
+
+/*
+ * cv_wait, but stop waiting after TIMEOUT and return ETIMEDOUT. As
+ * with cv_wait the lock is held again on return, either way; getting
+ * it back is not subject to the timeout.
+ *
+ * A signal can land just before the timeout: cv_signal has moved us
+ * to the lock's wait channel, and the timeout goes off while we're
+ * still waiting there for the lock. The signal was meant for us and
+ * nobody else was woken, so that counts as being signalled and we
+ * return 0 (wchan_sleep_timed sorts this out); returning ETIMEDOUT
+ * would lose the wakeup.
+ */
+int
+cv_timedwait(struct cv *cv, struct lock *lock, const struct timespec *timeout)
+{
+	int result;
+
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock_drop(lock);
+	result = wchan_sleep_timed(cv->cv_wchan, &lock->lk_lock, timeout);
+	(void)lock_wait(lock, NULL);
+	return result;
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeone(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == curthread);
+	wchan_requeue(cv->cv_wchan, lock->lk_wchan, &lock->lk_lock, false);
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	DEBUGASSERT(cv != NULL);
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == curthread);
+	wchan_requeue(cv->cv_wchan, lock->lk_wchan, &lock->lk_lock, true);
+	spinlock_release(&lock->lk_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name, int mode)
+{
+	struct rwlock *rw;
+
+	KASSERT(mode == RWLOCK_PREFER_READER || mode == RWLOCK_PREFER_WRITER);
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlk_name = kstrdup(name);
+	if (rw->rwlk_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	HANGMAN_LOCKABLEINIT(&rw->rwlk_hangman, rw->rwlk_name);
+
+	rw->rwlk_rwchan = wchan_create(rw->rwlk_name);
+	if (rw->rwlk_rwchan == NULL) {
+		kfree(rw->rwlk_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rwlk_wwchan = wchan_create(rw->rwlk_name);
+	if (rw->rwlk_wwchan == NULL) {
+		wchan_destroy(rw->rwlk_rwchan);
+		kfree(rw->rwlk_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rwlk_lock);
+	rw->rwlk_mode = mode;
+	rw->rwlk_readers = 0;
+	rw->rwlk_wwaiting = 0;
+	rw->rwlk_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rwlk_readers == 0);
+	KASSERT(rw->rwlk_writer == NULL);
+	KASSERT(rw->rwlk_wwaiting == 0);
+	spinlock_cleanup(&rw->rwlk_lock);
+	wchan_destroy(rw->rwlk_wwchan);
+	wchan_destroy(rw->rwlk_rwchan);
+
+	kfree(rw->rwlk_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlk_lock);
+
+	/*
+	 * Tell the deadlock detector we might wait. If a writer holds
+	 * the lock this checks for a cycle through it; otherwise
+	 * there's no holder and it's harmless.
+	 */
+	HANGMAN_WAIT(&curthread->t_hangman, &rw->rwlk_hangman);
+
+	KASSERT(rw->rwlk_writer != curthread);
+	while (rw->rwlk_writer != NULL ||
+	       (rw->rwlk_mode == RWLOCK_PREFER_WRITER &&
+		rw->rwlk_wwaiting > 0)) {
+		wchan_sleep(rw->rwlk_rwchan, &rw->rwlk_lock);
+	}
+	rw->rwlk_readers++;
+
+	/*
+	 * The detector only understands single holders, so don't
+	 * leave a reader registered as one; just close out the wait.
+	 */
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rw->rwlk_hangman);
+	HANGMAN_RELEASE(&curthread->t_hangman, &rw->rwlk_hangman);
+
+	spinlock_release(&rw->rwlk_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlk_lock);
+
+	KASSERT(rw->rwlk_readers > 0);
+	KASSERT(rw->rwlk_writer == NULL);
+	rw->rwlk_readers--;
+	if (rw->rwlk_readers == 0) {
+		/* Last reader out lets a writer in. */
+		wchan_wakeone(rw->rwlk_wwchan, &rw->rwlk_lock);
+	}
+
+	spinlock_release(&rw->rwlk_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlk_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rw->rwlk_hangman);
+
+	KASSERT(rw->rwlk_writer != curthread);
+	rw->rwlk_wwaiting++;
+	while (rw->rwlk_writer != NULL || rw->rwlk_readers > 0) {
+		wchan_sleep(rw->rwlk_wwchan, &rw->rwlk_lock);
+	}
+	rw->rwlk_wwaiting--;
+	rw->rwlk_writer = curthread;
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rw->rwlk_hangman);
+
+	spinlock_release(&rw->rwlk_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlk_lock);
+
+	KASSERT(rw->rwlk_writer == curthread);
+	KASSERT(rw->rwlk_readers == 0);
+	rw->rwlk_writer = NULL;
+
+	HANGMAN_RELEASE(&curthread->t_hangman, &rw->rwlk_hangman);
+
+	if (rw->rwlk_mode == RWLOCK_PREFER_WRITER && rw->rwlk_wwaiting > 0) {
+		/* Readers keep waiting behind the next writer. */
+		wchan_wakeone(rw->rwlk_wwchan, &rw->rwlk_lock);
+	}
+	else {
+		/*
+		 * Let all the readers in. If there's also a writer
+		 * waiting, wake it too; whichever gets the spinlock
+		 * first wins, and the writer goes back to sleep if
+		 * it loses.
+		 */
+		wchan_wakeall(rw->rwlk_rwchan, &rw->rwlk_lock);
+		wchan_wakeone(rw->rwlk_wwchan, &rw->rwlk_lock);
+	}
+
+	spinlock_release(&rw->rwlk_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlk_lock);
+	ret = (rw->rwlk_writer == curthread);
+	spinlock_release(&rw->rwlk_lock);
+
+	return ret;
+}
+
+bool
+rwlock_is_held(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlk_lock);
+	ret = (rw->rwlk_writer != NULL || rw->rwlk_readers > 0);
+	spinlock_release(&rw->rwlk_lock);
+
+	return ret;
 }
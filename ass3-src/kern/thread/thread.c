@@ -39,6 +39,7 @@
 #include <limits.h>
 #include <lib.h>
 #include <array.h>
+#include <clock.h>
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
@@ -64,6 +65,13 @@ struct wchan {
 	struct threadlist wc_threads;	/* list of waiting threads */
 };
 
+/*
+ * Most threads that exit per cpu to keep (with their stacks) for
+ * thread_fork to reuse, instead of freeing them. The pool is freed
+ * by thread_pool_drain when its cpu goes offline.
+ */
+#define THREAD_POOL_MAX	8
+
 /* Master array of CPUs. */
 DECLARRAY(cpu, static __UNUSED inline);
 DEFARRAY(cpu, static __UNUSED inline);
@@ -111,6 +119,49 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+static void wchan_timedout(void *data);
+
+/*
+ * Initialize the fields of a new (or reused) thread structure, other
+ * than the name and the stack.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_wchan = NULL;
+	thread->t_lastrun = 0;
+	thread->t_proc = NULL;
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+
+	/* Timed sleep fields */
+	timeout_init(&thread->t_timeout, wchan_timedout, thread);
+	thread->t_timedlock = NULL;
+	thread->t_timedoutof = NULL;
+
+	/* Priority fields */
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_heldlocks = NULL;
+	thread->t_waitlock = NULL;
+	thread->t_nextwaiter = NULL;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,24 +184,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_init(thread);
 
 	return thread;
 }
@@ -168,6 +203,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -180,12 +216,25 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadpool);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	for (i=0; i<SPINLOCK_MCSNODES; i++) {
+		c->c_mcsnodes[i].mn_next = NULL;
+		c->c_mcsnodes[i].mn_waiting = false;
+		c->c_mcsnodes[i].mn_inuse = false;
+	}
+	c->c_stealseed = hardware_number * 2654435761U + 1;
+	c->c_lockspun = 0;
+	c->c_lockslept = 0;
+	c->c_locktryfail = 0;
+	LOCKSTAT_CPUINIT(c);
+	SYSTAT_CPUINIT(c);
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	SPINLOCK_SETNAME(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -255,6 +304,25 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Number of CPUs.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Look up a CPU by software number.
+ */
+struct cpu *
+cpu_getnum(unsigned num)
+{
+	KASSERT(num < cpuarray_num(&allcpus));
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -290,9 +358,90 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Get a thread, with a stack, from this cpu's pool of dead threads,
+ * or NULL if the pool is empty. The pool is only touched by its own
+ * cpu, so going to splhigh is enough to protect it (and keeps us
+ * from being moved to another cpu halfway through).
+ */
+static
+struct thread *
+thread_pool_get(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* The stack magic was checked when the thread went in. */
+	KASSERT(thread->t_stack != NULL);
+	thread->t_name = kstrdup(name);
+	if (thread->t_name == NULL) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_init(thread);
+	return thread;
+}
+
+/*
+ * Put a zombie on this cpu's pool instead of destroying it, if there
+ * is room. Returns false if the caller should destroy it. Called from
+ * exorcise, so interrupts are already off.
+ */
+static
+bool
+thread_pool_put(struct thread *thread)
+{
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadpool.tl_count >= THREAD_POOL_MAX) {
+		return false;
+	}
+
+	/* Catch overflows before somebody else gets the stack. */
+	thread_checkstack(thread);
+	thread_machdep_cleanup(&thread->t_machdep);
+
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "POOLED";
+
+	threadlist_addhead(&curcpu->c_threadpool, thread);
+	return true;
+}
+
+/*
+ * Free everything in this cpu's pool of dead threads. Called as the
+ * cpu goes offline; each cpu drains its own pool, since nobody else
+ * may touch it.
+ */
+static
+void
+thread_pool_drain(void)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	while ((thread = threadlist_remhead(&curcpu->c_threadpool)) != NULL) {
+		thread_destroy(thread);
+	}
+	splx(spl);
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Up to THREAD_POOL_MAX
+ * of them are kept on the cpu's thread pool for reuse instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -305,7 +454,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_pool_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -354,11 +505,15 @@ thread_panic(void)
 }
 
 /*
- * At system shutdown, ask the other CPUs to switch off.
+ * At system shutdown, ask the other CPUs to switch off, and free
+ * this cpu's pool of dead threads. (The others free theirs when they
+ * get the offline request.)
  */
 void
 thread_shutdown(void)
 {
+	thread_pool_drain();
+
 	/*
 	 * Stop the other CPUs.
 	 *
@@ -445,6 +600,30 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Take the highest-priority thread off a list, or return NULL if the
+ * list is empty. Of several at the same priority, take the one that
+ * has been there longest. Used for run queues and wait channels; the
+ * caller must hold whatever lock protects the list.
+ */
+static
+struct thread *
+threadlist_remhighest(struct threadlist *tl)
+{
+	struct thread *t, *best;
+
+	best = NULL;
+	THREADLIST_FORALL(t, *tl) {
+		if (best == NULL || t->t_pri > best->t_pri) {
+			best = t;
+		}
+	}
+	if (best != NULL) {
+		threadlist_remove(tl, best);
+	}
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -503,18 +682,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread and its stack if we have one */
+	newthread = thread_pool_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -522,6 +705,8 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_pri = curthread->t_basepri;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -550,6 +735,154 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Work stealing.
+ *
+ * Rather than having busy CPUs periodically push threads at other
+ * CPUs, a CPU that runs out of work pulls a thread off the tail of
+ * the busiest other CPU's run queue. This is called from the idle
+ * loop in thread_switch, with interrupts off and no spinlocks held.
+ *
+ * Migrating threads isn't free because of cache affinity; a thread's
+ * working cache set will end up having to be moved to the other CPU,
+ * which is fairly slow. So among the threads near the tail of the
+ * victim's queue we prefer one that hasn't run on the victim in the
+ * last STEAL_HOT_HARDCLOCKS ticks, and only fall back to a cache-hot
+ * one if there's no cold one. System/161 does not (yet) model such
+ * cache effects, so the window is short.
+ */
+#define STEAL_HOT_HARDCLOCKS	2	/* Threads run this recently are hot */
+#define STEAL_SCAN_MAX		4	/* Look at most this far up the queue */
+
+/*
+ * Cheap per-cpu pseudo-random number (xorshift) used to pick where
+ * to start looking for a victim, so that several idle CPUs don't all
+ * pile onto the same run queue lock when loads are equal.
+ */
+static
+uint32_t
+thread_steal_random(void)
+{
+	uint32_t x;
+
+	x = curcpu->c_stealseed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	curcpu->c_stealseed = x;
+	return x;
+}
+
+/*
+ * Choose a thread on VICTIM's run queue to take, or NULL if there's
+ * nothing worth taking. The victim's run queue must be locked.
+ */
+static
+struct thread *
+thread_steal_pick(struct cpu *victim)
+{
+	struct thread *t, *fallback;
+	unsigned n;
+
+	KASSERT(spinlock_do_i_hold(&victim->c_runqueue_lock));
+
+	/*
+	 * An idle cpu with one thread queued is about to run it;
+	 * taking it would just bounce the thread around.
+	 */
+	if (victim->c_isidle && victim->c_runqueue.tl_count < 2) {
+		return NULL;
+	}
+
+	fallback = NULL;
+	n = 0;
+	THREADLIST_FORALL_REV(t, victim->c_runqueue) {
+		/*
+		 * The victim's curthread can appear on its run queue
+		 * if it went to sleep, the victim went idle on its
+		 * stack, and it was then woken up again before the
+		 * victim got around to unidling. Taking it would
+		 * leave two cpus running on the same stack; skip it.
+		 */
+		if (t == victim->c_curthread) {
+			continue;
+		}
+
+		/*
+		 * Reading c_hardclocks from another cpu is racy, but
+		 * this is only a hint.
+		 */
+		if (victim->c_hardclocks - t->t_lastrun >=
+		    STEAL_HOT_HARDCLOCKS) {
+			return t;
+		}
+		if (fallback == NULL) {
+			fallback = t;
+		}
+		if (++n >= STEAL_SCAN_MAX) {
+			break;
+		}
+	}
+	return fallback;
+}
+
+/*
+ * Try to steal a thread from another cpu. Returns the thread, which
+ * has been removed from the victim's run queue and now belongs to the
+ * current cpu, or NULL if no other cpu had anything to spare.
+ *
+ * The queue lengths are sampled without locking; the only run queue
+ * lock held at any one time is the victim's, so two idle cpus trying
+ * to steal from each other can't deadlock.
+ */
+static
+struct thread *
+thread_steal(void)
+{
+	unsigned numcpus, start, i, count, best;
+	struct cpu *c, *victim;
+	struct thread *t;
+
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 2) {
+		return NULL;
+	}
+
+	victim = NULL;
+	best = 0;
+	start = thread_steal_random() % numcpus;
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (start + i) % numcpus);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = thread_steal_pick(victim);
+	if (t != NULL) {
+		threadlist_remove(&victim->c_runqueue, t);
+		t->t_cpu = curcpu->c_self;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (t != NULL) {
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
+	}
+	return t;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -606,6 +939,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_wchan = wc;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -623,6 +957,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_lastrun = curcpu->c_hardclocks;
 
 	/*
 	 * Get the next thread. While there isn't one, call cpu_idle().
@@ -641,13 +976,22 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
-	/* The current cpu is now idle. */
+	/*
+	 * Before actually idling, try to take work from another cpu.
+	 * A stolen thread already has t_cpu pointing here and isn't
+	 * on any list, so we can switch to it directly.
+	 *
+	 * The current cpu is now idle.
+	 */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = threadlist_remhighest(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			next = thread_steal();
+			if (next == NULL) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -819,141 +1163,36 @@ thread_yield(void)
 ////////////////////////////////////////////////////////////
 
 /*
- * Scheduler.
- *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * Change the current thread's priority. If that leaves it below
+ * something else that's runnable here, let that run.
  */
-
 void
-schedule(void)
+thread_setpriority(int pri)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	curthread->t_basepri = pri;
+	lock_repriority();
+	thread_yield();
 }
 
+////////////////////////////////////////////////////////////
+
 /*
- * Thread migration.
- *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
- *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * Scheduler.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * This is called periodically from hardclock(). It should reshuffle
+ * the current CPU's run queue by job priority.
  */
+
 void
-thread_consider_migration(void)
+schedule(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
-
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
-
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
-	}
-
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
-	spinlock_release(&curcpu->c_runqueue_lock);
-
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
-		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
-
 	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * You can write this. If we do nothing, thread_switch always
+	 * picks the highest-priority runnable thread, and threads of
+	 * equal priority run in round-robin fashion.
 	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
-		}
-		spinlock_release(&curcpu->c_runqueue_lock);
-	}
-
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
 }
 
 ////////////////////////////////////////////////////////////
@@ -1019,6 +1258,93 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Timeout function for wchan_sleep_timed. If the thread is still
+ * asleep, take it off its channel (which may not be the one it went
+ * to sleep on, if it was requeued), note which one that was, and
+ * wake it. Either way, let it know we're done with it by clearing
+ * t_timedlock.
+ */
+static
+void
+wchan_timedout(void *data)
+{
+	struct thread *target = data;
+	struct spinlock *lk;
+	struct wchan *wc;
+
+	lk = target->t_timedlock;
+	KASSERT(lk != NULL);
+
+	spinlock_acquire(lk);
+	wc = target->t_wchan;
+	if (wc != NULL) {
+		threadlist_remove(&wc->wc_threads, target);
+		target->t_wchan = NULL;
+		target->t_timedoutof = wc;
+		thread_make_runnable(target, false);
+	}
+	target->t_timedlock = NULL;
+	spinlock_release(lk);
+}
+
+/*
+ * Sleep on a wait channel, but for no longer than TIMEOUT.
+ *
+ * The timeout is per-thread (t_timeout). When we wake up, normally or
+ * not, the timeout has to be dealt with before we can return, since
+ * it points at LK, which the caller is free to destroy afterwards: if
+ * we can't cancel it, it's already running or about to, and we wait
+ * for it to finish with LK.
+ *
+ * Returns ETIMEDOUT only if the timeout took us off WC itself. If we
+ * had been moved to another channel with wchan_requeue first, that
+ * move was our wakeup (a cv_signal, say): whoever did it has handed
+ * us on and won't wake anyone else in our place, so we return 0 and
+ * the timeout has only cut short our wait on the new channel.
+ */
+int
+wchan_sleep_timed(struct wchan *wc, struct spinlock *lk,
+		  const struct timespec *timeout)
+{
+	struct thread *cur = curthread;
+	bool timedout;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!cur->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	if (timeout->tv_sec == 0 && timeout->tv_nsec == 0) {
+		return ETIMEDOUT;
+	}
+
+	cur->t_timedoutof = NULL;
+	cur->t_timedlock = lk;
+	timeout_add(&cur->t_timeout, timeout);
+
+	thread_switch(S_SLEEP, wc, lk);
+	spinlock_acquire(lk);
+
+	if (timeout_cancel(&cur->t_timeout)) {
+		cur->t_timedlock = NULL;
+	}
+	else {
+		while (cur->t_timedlock != NULL) {
+			spinlock_release(lk);
+			spinlock_acquire(lk);
+		}
+	}
+
+	timedout = cur->t_timedoutof == wc;
+	cur->t_timedoutof = NULL;
+	return timedout ? ETIMEDOUT : 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1029,13 +1355,14 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 
 	KASSERT(spinlock_do_i_hold(lk));
 
-	/* Grab a thread from the channel */
-	target = threadlist_remhead(&wc->wc_threads);
+	/* Grab the most important thread from the channel */
+	target = threadlist_remhighest(&wc->wc_threads);
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1066,6 +1393,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1081,6 +1409,34 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move one thread (or all threads, if ALL is set) sleeping on FROM
+ * onto TO without waking them. Both channels must be protected by
+ * the same spinlock LK. Returns the number of threads moved.
+ */
+unsigned
+wchan_requeue(struct wchan *from, struct wchan *to, struct spinlock *lk,
+	      bool all)
+{
+	struct thread *target;
+	unsigned count;
+
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(from != to);
+
+	count = 0;
+	while ((target = threadlist_remhead(&from->wc_threads)) != NULL) {
+		target->t_wchan_name = to->wc_name;
+		target->t_wchan = to;
+		threadlist_addtail(&to->wc_threads, target);
+		count++;
+		if (!all) {
+			break;
+		}
+	}
+	return count;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1193,6 +1549,7 @@ interprocessor_interrupt(void)
 				curcpu->c_number);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
+		thread_pool_drain();
 		kprintf("cpu%d: offline.\n", curcpu->c_number);
 		cpu_halt();
 	}
@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Anonymous pipes. See pipe.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/*
+ * Data goes through a ring buffer of one page.
+ *
+ * As a shortcut, a reader that finds the ring empty lends the pipe a
+ * buffer (p_direct) before it goes to sleep, and a writer that finds
+ * a reader waiting like that, with the ring empty, copies into the
+ * reader's buffer instead of the ring; the reader wakes up with its
+ * data already there. We can't copy straight into the reader's user
+ * memory, because it's in another address space, so the lent buffer
+ * is a kernel one, as big as the read (up to a page); but it means a
+ * big write can hand a page to a waiting reader and fill the ring as
+ * well before the writer has to wait, and the reader doesn't have to
+ * go back to the ring for it.
+ *
+ * Writes of at most PIPE_SIZE bytes are atomic: the writer waits
+ * until there is room for all of it, so they don't get interleaved
+ * with other writers' data.
+ *
+ * Everything is protected by p_lock. Readers wait on p_readcv for data
+ * (or EOF), and writers on p_writecv for room (or for the read end to
+ * go away).
+ */
+#define PIPE_SIZE	PAGE_SIZE
+
+struct pipe {
+	struct lock *p_lock;
+	struct cv *p_readcv;
+	struct cv *p_writecv;
+
+	char *p_buf;			/* ring buffer */
+	unsigned p_start;		/* where the data starts */
+	unsigned p_count;		/* how much data there is */
+
+	char *p_direct;			/* buffer lent by a waiting reader */
+	size_t p_directlen;		/* its size */
+	size_t p_directgot;		/* how much a writer put in it */
+
+	bool p_readclosed;		/* read end is gone */
+	bool p_writeclosed;		/* write end is gone */
+};
+
+/*
+ * One vnode for each end.
+ */
+struct pipe_vnode {
+	struct vnode pv_vnode;
+	struct pipe *pv_pipe;
+	bool pv_iswrite;		/* this is the write end */
+};
+
+static void pipe_destroy(struct pipe *p);
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	/* pipes have no names, so they never get opened */
+	return EINVAL;
+}
+
+/*
+ * The last reference to one end went away: mark it closed and wake
+ * up anyone on the other end who needs to know. The pipe itself goes
+ * when both ends are closed.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe_vnode *pv = vn->vn_data;
+	struct pipe *p = pv->pv_pipe;
+	bool destroy;
+
+	lock_acquire(p->p_lock);
+	if (pv->pv_iswrite) {
+		p->p_writeclosed = true;
+		cv_broadcast(p->p_readcv, p->p_lock);
+	}
+	else {
+		p->p_readclosed = true;
+		cv_broadcast(p->p_writecv, p->p_lock);
+	}
+	destroy = p->p_readclosed && p->p_writeclosed;
+	lock_release(p->p_lock);
+
+	vnode_cleanup(&pv->pv_vnode);
+	kfree(pv);
+
+	if (destroy) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe_vnode *pv = vn->vn_data;
+	struct pipe *p = pv->pv_pipe;
+	char *direct = NULL;
+	bool triedlend = false;
+	size_t directlen, got, len;
+	int result = 0;
+
+	if (pv->pv_iswrite) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+	/* no point lending more than this read can take */
+	directlen = uio->uio_resid < PIPE_SIZE ? uio->uio_resid : PIPE_SIZE;
+
+	lock_acquire(p->p_lock);
+	while (p->p_count == 0 && !p->p_writeclosed) {
+		if (direct != NULL && p->p_direct == direct &&
+		    p->p_directgot > 0) {
+			/* a writer filled our buffer */
+			break;
+		}
+		if (direct == NULL && !triedlend) {
+			/* get a buffer to lend; if we can't, do without */
+			triedlend = true;
+			direct = kmalloc(directlen);
+		}
+		if (direct != NULL && p->p_direct == NULL) {
+			/* lend it, unless another reader already has */
+			p->p_direct = direct;
+			p->p_directlen = directlen;
+			p->p_directgot = 0;
+		}
+		cv_wait(p->p_readcv, p->p_lock);
+	}
+
+	if (direct != NULL && p->p_direct == direct) {
+		/* Take back our buffer, and whatever a writer put in it */
+		got = p->p_directgot;
+		p->p_direct = NULL;
+		p->p_directlen = 0;
+		p->p_directgot = 0;
+		if (got > 0) {
+			lock_release(p->p_lock);
+			result = uiomove(direct, got, uio);
+			kfree(direct);
+			return result;
+		}
+	}
+
+	/* Copy from the ring, in at most two pieces because of the wrap */
+	while (p->p_count > 0 && uio->uio_resid > 0) {
+		len = p->p_count;
+		if (len > PIPE_SIZE - p->p_start) {
+			len = PIPE_SIZE - p->p_start;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + p->p_start, len, uio);
+		if (result) {
+			break;
+		}
+		p->p_start = (p->p_start + len) % PIPE_SIZE;
+		p->p_count -= len;
+	}
+	if (p->p_count == 0) {
+		p->p_start = 0;
+	}
+	cv_broadcast(p->p_writecv, p->p_lock);
+	lock_release(p->p_lock);
+
+	kfree(direct);
+	return result;
+}
+
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe_vnode *pv = vn->vn_data;
+	struct pipe *p = pv->pv_pipe;
+	size_t want, len, end;
+	bool atomic;
+	int result = 0;
+
+	if (!pv->pv_iswrite) {
+		return EBADF;
+	}
+
+	want = uio->uio_resid;
+	atomic = want <= PIPE_SIZE;
+
+	lock_acquire(p->p_lock);
+	while (uio->uio_resid > 0) {
+		if (p->p_readclosed) {
+			/* nobody will ever read it */
+			if (uio->uio_resid == want) {
+				result = EPIPE;
+			}
+			break;
+		}
+
+		if (p->p_direct != NULL && p->p_directgot == 0 &&
+		    p->p_count == 0 && (!atomic || want <= p->p_directlen)) {
+			/* A reader is waiting with a buffer: fill it */
+			len = uio->uio_resid < p->p_directlen ?
+				uio->uio_resid : p->p_directlen;
+			result = uiomove(p->p_direct, len, uio);
+			if (result) {
+				break;
+			}
+			p->p_directgot = len;
+			cv_broadcast(p->p_readcv, p->p_lock);
+			continue;
+		}
+
+		if (p->p_count == PIPE_SIZE ||
+		    (atomic && PIPE_SIZE - p->p_count < uio->uio_resid)) {
+			/* no room; wait */
+			cv_wait(p->p_writecv, p->p_lock);
+			continue;
+		}
+
+		/* Copy into the free part of the ring after the data */
+		end = (p->p_start + p->p_count) % PIPE_SIZE;
+		len = PIPE_SIZE - p->p_count;
+		if (len > PIPE_SIZE - end) {
+			len = PIPE_SIZE - end;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + end, len, uio);
+		if (result) {
+			break;
+		}
+		p->p_count += len;
+		cv_broadcast(p->p_readcv, p->p_lock);
+	}
+	lock_release(p->p_lock);
+
+	if (result && uio->uio_resid < want) {
+		/* report the partial write */
+		result = 0;
+	}
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe_vnode *pv = vn->vn_data;
+	struct pipe *p = pv->pv_pipe;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(p->p_lock);
+	buf->st_size = p->p_count;
+	lock_release(p->p_lock);
+
+	buf->st_mode = S_IFIFO | (pv->pv_iswrite ? 0200 : 0400);
+	buf->st_nlink = 0;
+	buf->st_blksize = PIPE_SIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_vnops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// constructors
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	KASSERT(p->p_direct == NULL);
+	kfree(p->p_buf);
+	cv_destroy(p->p_writecv);
+	cv_destroy(p->p_readcv);
+	lock_destroy(p->p_lock);
+	kfree(p);
+}
+
+static
+struct pipe_vnode *
+pipe_vnode_create(struct pipe *p, bool iswrite)
+{
+	struct pipe_vnode *pv;
+	int result;
+
+	pv = kmalloc(sizeof(*pv));
+	if (pv == NULL) {
+		return NULL;
+	}
+	pv->pv_pipe = p;
+	pv->pv_iswrite = iswrite;
+	result = vnode_init(&pv->pv_vnode, &pipe_vnops, NULL, pv);
+	if (result) {
+		kfree(pv);
+		return NULL;
+	}
+	return pv;
+}
+
+int
+pipe_create(struct vnode **readend_ret, struct vnode **writeend_ret)
+{
+	struct pipe *p;
+	struct pipe_vnode *rv, *wv;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	p->p_readcv = cv_create("pipe read");
+	p->p_writecv = cv_create("pipe write");
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_lock == NULL || p->p_readcv == NULL ||
+	    p->p_writecv == NULL || p->p_buf == NULL) {
+		goto fail;
+	}
+	p->p_start = 0;
+	p->p_count = 0;
+	p->p_direct = NULL;
+	p->p_directlen = 0;
+	p->p_directgot = 0;
+	p->p_readclosed = false;
+	p->p_writeclosed = false;
+
+	rv = pipe_vnode_create(p, false);
+	if (rv == NULL) {
+		goto fail;
+	}
+	wv = pipe_vnode_create(p, true);
+	if (wv == NULL) {
+		vnode_cleanup(&rv->pv_vnode);
+		kfree(rv);
+		goto fail;
+	}
+
+	*readend_ret = &rv->pv_vnode;
+	*writeend_ret = &wv->pv_vnode;
+	return 0;
+
+fail:
+	kfree(p->p_buf);
+	if (p->p_writecv != NULL) {
+		cv_destroy(p->p_writecv);
+	}
+	if (p->p_readcv != NULL) {
+		cv_destroy(p->p_readcv);
+	}
+	if (p->p_lock != NULL) {
+		lock_destroy(p->p_lock);
+	}
+	kfree(p);
+	return ENOMEM;
+}
@@ -90,6 +90,14 @@ DEFARRAY(knowndev, static __UNUSED inline);
 
 static struct knowndevarray *knowndevs;
 
+/*
+ * Lock for the knowndevs array and the knowndev structures in it.
+ * Looking devices up takes it for reading; adding devices and
+ * mounting or unmounting things takes it for writing. When both are
+ * needed, get vfs_biglock first.
+ */
+static struct rwlock *knowndevs_lock;
+
 /* The big lock for all FS ops. Remove for filesystem assignment. */
 static struct lock *vfs_biglock;
 static unsigned vfs_biglock_depth;
@@ -106,6 +114,11 @@ vfs_bootstrap(void)
 		panic("vfs: Could not create knowndevs array\n");
 	}
 
+	knowndevs_lock = rwlock_create("knowndevs", RWLOCK_PREFER_WRITER);
+	if (knowndevs_lock==NULL) {
+		panic("vfs: Could not create knowndevs lock\n");
+	}
+
 	vfs_biglock = lock_create("vfs_biglock");
 	if (vfs_biglock==NULL) {
 		panic("vfs: Could not create vfs big lock\n");
@@ -176,6 +189,7 @@ vfs_sync(void)
 	unsigned i, num;
 
 	vfs_biglock_acquire();
+	rwlock_acquire_read(knowndevs_lock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -185,6 +199,7 @@ vfs_sync(void)
 		}
 	}
 
+	rwlock_release_read(knowndevs_lock);
 	vfs_biglock_release();
 
 	return 0;
@@ -199,9 +214,12 @@ vfs_getroot(const char *devname, struct vnode **ret)
 {
 	struct knowndev *kd;
 	unsigned i, num;
+	int result;
 
 	KASSERT(vfs_biglock_do_i_hold());
 
+	rwlock_acquire_read(knowndevs_lock);
+
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
 		kd = knowndevarray_get(knowndevs, i);
@@ -221,12 +239,15 @@ vfs_getroot(const char *devname, struct vnode **ret)
 
 			if (!strcmp(kd->kd_name, devname) ||
 			    (volname!=NULL && !strcmp(volname, devname))) {
-				return FSOP_GETROOT(kd->kd_fs, ret);
+				result = FSOP_GETROOT(kd->kd_fs, ret);
+				rwlock_release_read(knowndevs_lock);
+				return result;
 			}
 		}
 		else {
 			if (kd->kd_rawname!=NULL &&
 			    !strcmp(kd->kd_name, devname)) {
+				rwlock_release_read(knowndevs_lock);
 				return ENXIO;
 			}
 		}
@@ -242,6 +263,7 @@ vfs_getroot(const char *devname, struct vnode **ret)
 			KASSERT(kd->kd_device != NULL);
 			VOP_INCREF(kd->kd_vnode);
 			*ret = kd->kd_vnode;
+			rwlock_release_read(knowndevs_lock);
 			return 0;
 		}
 
@@ -253,6 +275,7 @@ vfs_getroot(const char *devname, struct vnode **ret)
 			KASSERT(kd->kd_device != NULL);
 			VOP_INCREF(kd->kd_vnode);
 			*ret = kd->kd_vnode;
+			rwlock_release_read(knowndevs_lock);
 			return 0;
 		}
 
@@ -267,6 +290,7 @@ vfs_getroot(const char *devname, struct vnode **ret)
 	 * If we got here, the device specified by devname doesn't exist.
 	 */
 
+	rwlock_release_read(knowndevs_lock);
 	return ENODEV;
 }
 
@@ -281,7 +305,7 @@ vfs_getdevname(struct fs *fs)
 
 	KASSERT(fs != NULL);
 
-	KASSERT(vfs_biglock_do_i_hold());
+	rwlock_acquire_read(knowndevs_lock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -294,10 +318,12 @@ vfs_getdevname(struct fs *fs)
 			 * the fs cannot go away, and the device can't
 			 * go away until the fs goes away.
 			 */
+			rwlock_release_read(knowndevs_lock);
 			return kd->kd_name;
 		}
 	}
 
+	rwlock_release_read(knowndevs_lock);
 	return NULL;
 }
 
@@ -359,6 +385,7 @@ badnames(const char *n1, const char *n2, const char *n3)
 	struct knowndev *kd;
 
 	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(rwlock_do_i_hold_write(knowndevs_lock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -438,13 +465,17 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		volname = FSOP_GETVOLNAME(fs);
 	}
 
+	rwlock_acquire_write(knowndevs_lock);
+
 	if (badnames(name, rawname, volname)) {
+		rwlock_release_write(knowndevs_lock);
 		result = EEXIST;
 		goto fail;
 	}
 
 	result = knowndevarray_add(knowndevs, kd, &index);
 	if (result) {
+		rwlock_release_write(knowndevs_lock);
 		goto fail;
 	}
 
@@ -453,6 +484,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		dev->d_devnumber = index+1;
 	}
 
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 	return 0;
 
@@ -510,6 +542,7 @@ findmount(const char *devname, struct knowndev **result)
 	bool found = false;
 
 	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(rwlock_do_i_hold_write(knowndevs_lock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; !found && i<num; i++) {
@@ -544,14 +577,17 @@ vfs_mount(const char *devname, void *data,
 	int result;
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
+		rwlock_release_write(knowndevs_lock);
 		vfs_biglock_release();
 		return result;
 	}
 
 	if (kd->kd_fs != NULL) {
+		rwlock_release_write(knowndevs_lock);
 		vfs_biglock_release();
 		return EBUSY;
 	}
@@ -560,6 +596,7 @@ vfs_mount(const char *devname, void *data,
 
 	result = mountfunc(data, kd->kd_device, &fs);
 	if (result) {
+		rwlock_release_write(knowndevs_lock);
 		vfs_biglock_release();
 		return result;
 	}
@@ -573,6 +610,7 @@ vfs_mount(const char *devname, void *data,
 	kprintf("vfs: Mounted %s: on %s\n",
 		volname ? volname : kd->kd_name, kd->kd_name);
 
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 	return 0;
 }
@@ -602,6 +640,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 	}
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -622,6 +661,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 	*ret = kd->kd_vnode;
 
  out:
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 	if (myname != NULL) {
 		kfree(myname);
@@ -641,6 +681,7 @@ vfs_unmount(const char *devname)
 	int result;
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -673,6 +714,7 @@ vfs_unmount(const char *devname)
 	KASSERT(result==0);
 
  fail:
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 	return result;
 }
@@ -691,6 +733,7 @@ vfs_swapoff(const char *devname)
 	int result;
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -710,6 +753,7 @@ vfs_swapoff(const char *devname)
 	KASSERT(result==0);
 
  fail:
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 	return result;
 }
@@ -725,6 +769,7 @@ vfs_unmountall(void)
 	int result;
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -780,6 +825,7 @@ vfs_unmountall(void)
 		dev->kd_fs = NULL;
 	}
 
+	rwlock_release_write(knowndevs_lock);
 	vfs_biglock_release();
 
 	return 0;
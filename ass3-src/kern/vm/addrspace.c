@@ -78,6 +78,7 @@ as_create(void)
     ++as_count;
     as->first = NULL;
     as->asid = as_count<<6;
+    as->kdataproc = 0;      /* not copied by as_copy: the pid differs */
 
     return as;
 }
@@ -207,6 +208,8 @@ as_destroy(struct addrspace *as)
     }
     lock_release(hpt_lock);
 
+    if (as->kdataproc != 0)
+        free_kpages(PADDR_TO_KVADDR(as->kdataproc));
     kfree(as);
 }
 
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel data pages. See <kern/kdata.h> and <kdata.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <clock.h>
+#include <vm.h>
+#include <kdata.h>
+#include <syscall.h>
+#include "opt-dumbvm.h"
+
+/*
+ * The time page. It's part of the kernel image, so it never has to
+ * be allocated or freed.
+ */
+static union {
+	struct kdata_time kt;
+	char page[PAGE_SIZE];
+} kdata_time_page __attribute__((aligned(PAGE_SIZE)));
+
+/*
+ * Copy the current time into the time page. Only cpu 0 calls this
+ * (from hardclock), so there is one writer and no lock; readers go by
+ * kt_gen.
+ */
+void
+kdata_tick(void)
+{
+	struct kdata_time *kt = &kdata_time_page.kt;
+	struct timespec ts;
+
+	gettime(&ts);
+
+	kt->kt_gen++;
+	membar_store_store();
+	kt->kt_sec = ts.tv_sec;
+	kt->kt_nsec = ts.tv_nsec;
+	membar_store_store();
+	kt->kt_gen++;
+}
+
+paddr_t
+kdata_timepage(void)
+{
+	return KVADDR_TO_PADDR((vaddr_t)&kdata_time_page);
+}
+
+/*
+ * The __kdata system call: tell libc where the time page is, so it
+ * knows the pages are there.
+ */
+int
+sys___kdata(int32_t *retval)
+{
+#if OPT_DUMBVM
+	/* dumbvm doesn't map the pages */
+	(void)retval;
+	return ENOSYS;
+#else
+	*retval = KDATA_TIME;
+	return 0;
+#endif
+}
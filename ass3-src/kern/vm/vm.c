@@ -9,6 +9,7 @@
 #include <proc.h>
 #include <spl.h>
 #include <synch.h>
+#include <kdata.h>
 
 /* Place your page table functions here */
 
@@ -42,6 +43,42 @@ uint32_t hpt_hash(struct addrspace *as, vaddr_t faultaddr)
     return index;
 }
 
+/*
+ * Map one of the kernel data pages (see <kern/kdata.h>), read-only.
+ * The time page is shared; the process page is allocated, and the
+ * pid written into it, the first time the address space touches it.
+ */
+static int kdata_fault(struct addrspace *as, int faulttype, vaddr_t faultaddress)
+{
+    struct kdata_proc *kp;
+    vaddr_t kva;
+    paddr_t pa;
+    int spl;
+
+    if (faulttype == VM_FAULT_WRITE)
+        return EFAULT;
+
+    if (faultaddress == KDATA_TIME) {
+        pa = kdata_timepage();
+    } else {
+        if (as->kdataproc == 0) {
+            kva = alloc_kpages(1);
+            if (kva == 0)
+                return ENOMEM;
+            kp = (struct kdata_proc *)kva;
+            kp->kp_pid = curproc->p_pid;
+            as->kdataproc = KVADDR_TO_PADDR(kva);
+        }
+        pa = as->kdataproc;
+    }
+
+    /* no TLBLO_DIRTY, so stores get VM_FAULT_READONLY */
+    spl = splhigh();
+    tlb_random(faultaddress | as->asid, pa | TLBLO_VALID);
+    splx(spl);
+    return 0;
+}
+
 void vm_bootstrap(void)
 {
     /* Initialise VM sub-system.  You probably want to initialise your 
@@ -106,6 +143,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;
 	}
 
+    if (faultaddress == KDATA_TIME || faultaddress == KDATA_PROC)
+        return kdata_fault(as, faulttype, faultaddress);
+
 	/* Assert that the address space has been set up properly. */
     as_seg curr = as->first;
     bool notfound = true;
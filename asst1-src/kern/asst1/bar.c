@@ -18,14 +18,29 @@
 
 #define BUFFER_SIZE NCUSTOMERS
 
+/*
+ * Each bottle is a FIFO ticket lock: a bartender takes the next
+ * ticket and waits on the bottle's CV until that ticket is being
+ * served. Bartenders take all the bottles an order needs in bottle
+ * number order, so two orders can never each hold a bottle the other
+ * is waiting for, and orders using different bottles mix at the same
+ * time. Because each bottle serves its waiters strictly in the order
+ * they arrived, a bartender waiting for a bottle can't be overtaken
+ * indefinitely by later ones; so nobody starves.
+ */
+struct bottle_lock {
+	struct lock *bl_lock;		/* protects the two counters */
+	struct cv *bl_cv;		/* wait here for your turn */
+	unsigned bl_next;		/* next ticket to hand out */
+	unsigned bl_serving;		/* ticket now holding the bottle */
+};
+
 static struct semaphore *safe_consumer;
 static struct semaphore *safe_producer;
-static struct semaphore *bottles[NBOTTLES];
+static struct bottle_lock bottles[NBOTTLES];
 static struct semaphore *customer[NCUSTOMERS];
-static struct semaphore *staff[NBARTENDERS];
 static struct barorder *order_buffer[BUFFER_SIZE];
 static struct lock *buffer_lock;
-static struct lock *bottles_lock;
 volatile unsigned long int buffer_counter;
 volatile unsigned long int consume_counter;
 
@@ -79,14 +94,68 @@ struct barorder *take_order(void)
 		//Ensure there at least one order
 		P(safe_consumer);
 		lock_acquire(buffer_lock);
-		//Track who take this order
-		order_buffer[consume_counter % BUFFER_SIZE]->staff = consume_counter % NBARTENDERS;
         struct barorder *ret = order_buffer[consume_counter++ % BUFFER_SIZE];
         lock_release(buffer_lock);
         return ret;
 }
 
 
+static void bottle_acquire(unsigned b)
+{
+	struct bottle_lock *bl = &bottles[b];
+	unsigned ticket;
+
+	lock_acquire(bl->bl_lock);
+	ticket = bl->bl_next++;
+	while (bl->bl_serving != ticket) {
+		cv_wait(bl->bl_cv, bl->bl_lock);
+	}
+	lock_release(bl->bl_lock);
+}
+
+static void bottle_release(unsigned b)
+{
+	struct bottle_lock *bl = &bottles[b];
+
+	lock_acquire(bl->bl_lock);
+	bl->bl_serving++;
+	cv_broadcast(bl->bl_cv, bl->bl_lock);
+	lock_release(bl->bl_lock);
+}
+
+/*
+ * Work out which bottles ORDER needs: the distinct non-empty entries
+ * of requested_bottles, as bottle indexes in increasing order. Returns
+ * how many.
+ */
+static unsigned order_bottles(struct barorder *order,
+			      unsigned needed[DRINK_COMPLEXITY])
+{
+	unsigned i, j, n, b;
+
+	n = 0;
+	for (i = 0; i < DRINK_COMPLEXITY; i++) {
+		b = order->requested_bottles[i];
+		if (b == 0) {
+			continue;
+		}
+		b--;
+
+		/* skip duplicates, then insertion-sort the rest */
+		for (j = 0; j < n && needed[j] != b; j++) {
+		}
+		if (j < n) {
+			continue;
+		}
+		for (j = n; j > 0 && needed[j - 1] > b; j--) {
+			needed[j] = needed[j - 1];
+		}
+		needed[j] = b;
+		n++;
+	}
+	return n;
+}
+
 /*
  * fill_order()
  *
@@ -100,25 +169,24 @@ struct barorder *take_order(void)
 
 void fill_order(struct barorder *order)
 {
+	unsigned needed[DRINK_COMPLEXITY];
+	unsigned i, n;
+
+	/* Take exactly the bottles needed, in increasing order */
+	n = order_bottles(order, needed);
+	for (i = 0; i < n; i++) {
+		if (needed[i] >= NBOTTLES) {
+			panic("Unknown bottle");
+		}
+		bottle_acquire(needed[i]);
+	}
 
-        /* add any sync primitives you need to ensure mutual exclusion
-           holds as described */
+	/* the call to mix must remain */
+	mix(order);
 
-        /* the call to mix must remain */
-		//only one staff can access bottles at the same time
-	    P(staff[order->staff]);
-		int i;        
-		for(i = 0; i < DRINK_COMPLEXITY; ++i){
-			if(order->requested_bottles[i]) P(bottles[order->requested_bottles[i]-1]);
-		}
-		mix(order);
-		for(i = 0; i < DRINK_COMPLEXITY; ++i){
-      		if(order->requested_bottles[i]) V(bottles[order->requested_bottles[i]-1]);
-      	}
-      	//Wake up next staff to use bottles
-      	//Ensure there no starvation because the orders is filled in the order of the orders sent
-      	V(staff[(order->staff+1)%NBARTENDERS]);
-			
+	for (i = n; i > 0; i--) {
+		bottle_release(needed[i - 1]);
+	}
 }
 
 /*
@@ -169,26 +237,19 @@ void bar_open(void)
 
 	if (buffer_lock == NULL) panic("bar: lock create failed");
 
-	bottles_lock = lock_create("bottlesLock");
-
-	if (bottles_lock == NULL) panic("bar: lock create failed");
-
 	int i;
 	for(i = 0; i < NBOTTLES; ++i){
-		bottles[i] = sem_create("bottle", 1);
-		if (bottles[i] == NULL) panic("bar: sem create failed");
+		bottles[i].bl_lock = lock_create("bottle");
+		if (bottles[i].bl_lock == NULL) panic("bar: lock create failed");
+		bottles[i].bl_cv = cv_create("bottle");
+		if (bottles[i].bl_cv == NULL) panic("bar: cv create failed");
+		bottles[i].bl_next = 0;
+		bottles[i].bl_serving = 0;
 	}
 	for(i = 0; i < NCUSTOMERS; ++i){
 		customer[i] = sem_create("customer", 0);
 		if (customer[i] == NULL) panic("bar: sem create failed");
     }
-
-    staff[0] = sem_create("staff", 1);
-
-	for(i = 0; i < NBARTENDERS; ++i){
-		if(i) staff[i] = sem_create("staff", 0);
-		if(staff[i] == NULL) panic("bar: sem create failed");   
-	}
 }
 
 /*
@@ -203,18 +264,15 @@ void bar_close(void)
 	int i;
 	sem_destroy(safe_consumer);
 	sem_destroy(safe_producer);
-	lock_destroy(bottles_lock);
 	lock_destroy(buffer_lock);
 	for(i = 0; i < NBOTTLES; ++i){
-		sem_destroy(bottles[i]);
+		cv_destroy(bottles[i].bl_cv);
+		lock_destroy(bottles[i].bl_lock);
 	}
 	for(i = 0; i < NCUSTOMERS; ++i){
 		sem_destroy(customer[i]);
 	}
-	for(i = 0; i < NBARTENDERS; ++i){
-		sem_destroy(staff[i]);
-	}
-	
+
 }
 
 
@@ -18,7 +18,6 @@ struct barorder {
         int go_home_flag;                                 /* Do not change */
         struct glass glass;                               /* Do not change */
         int id;
-        int staff;
 
         /* This struct can be extended with your own entries below here */ 
 
@@ -4,6 +4,7 @@
 #include <synch.h>
 #include <test.h>
 #include <thread.h>
+#include <clock.h>
 
 #include "bar_driver.h"
 
@@ -33,6 +34,17 @@ struct bottle bottles[NBOTTLES];
 static int customers;
 static struct lock *cust_lock;
 
+/* Number of drinks each customer orders */
+#define NDRINKS 10
+
+/*
+ * What customers order, set by the optional argument to 1d:
+ *    0 (the default)   beer, so every order needs the same bottle
+ *    1                 up to DRINK_COMPLEXITY random bottles, possibly
+ *                      repeated, so many orders can be mixed at once
+ */
+static int drink_menu;
+
 /* A function used to manage staff leaving */
 
 static void go_home(void);
@@ -77,8 +89,15 @@ static void customer(void *unusedpointer, unsigned long customernum)
                 }
                 /* I'll have a beer. */
 
-                //Test 0
-                order.requested_bottles[0] = BEER;
+                if (drink_menu == 0) {
+                        //Test 0
+                        order.requested_bottles[0] = BEER;
+                } else {
+                        for (j = 0; j < DRINK_COMPLEXITY; j++) {
+                                order.requested_bottles[j] =
+                                        random() % (NBOTTLES + 1);
+                        }
+                }
 
                 // uncomment the counter first and comment test 0, then do the follow tests
                 //Test 1
@@ -128,7 +147,7 @@ static void customer(void *unusedpointer, unsigned long customernum)
                 thread_yield();
 
                 i++;
-        } while (i < 10); /* keep going until .... */
+        } while (i < NDRINKS); /* keep going until .... */
 
 #ifdef PRINT_ON
         kprintf("C %ld going home\n", customernum);
@@ -222,9 +241,10 @@ static void bartender(void *unusedpointer, unsigned long staff)
 int run_bar(int nargs, char **args)
 {
         int i, result;
+        struct timespec before, after, duration;
+        uint64_t nsecs, orders;
 
-        (void) nargs; /* avoid compiler warnings */
-        (void) args;
+        drink_menu = nargs > 1 ? atoi(args[1]) : 0;
 
         /* this semaphore indicates everybody has gone home */
         alldone = sem_create("alldone", 0);
@@ -251,6 +271,8 @@ int run_bar(int nargs, char **args)
          */
         bar_open();
 
+        gettime(&before);
+
         /* Start the bartenders */
         for (i = 0; i<NBARTENDERS; i++) {
                 result = thread_fork("bartender thread", NULL,
@@ -276,6 +298,7 @@ int run_bar(int nargs, char **args)
         for (i = 0; i < NCUSTOMERS + NBARTENDERS; i++) {
                 P(alldone);
         }
+        gettime(&after);
 
         for (i = 0; i < NBOTTLES; i++) {
                 kprintf("Bottle %d used for %d doses\n", i + 1,
@@ -290,6 +313,18 @@ int run_bar(int nargs, char **args)
         lock_destroy(cust_lock);
         sem_destroy(alldone);
         kprintf("The bar is closed, bye!!!\n");
+
+        timespec_sub(&after, &before, &duration);
+        nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+        orders = (uint64_t)NCUSTOMERS * NDRINKS;
+        kprintf("%llu orders by %d bartenders in %llu.%09lu s",
+                orders, NBARTENDERS,
+                (unsigned long long)duration.tv_sec,
+                (unsigned long)duration.tv_nsec);
+        if (nsecs > 0) {
+                kprintf(", %llu orders/sec", orders * 1000000000ULL / nsecs);
+        }
+        kprintf("\n");
         return 0;
 }
 
@@ -4,6 +4,9 @@
 #include <test.h>
 #include <thread.h>
 #include <synch.h>
+#include <cpu.h>
+#include <clock.h>
+#include <pcounter.h>
 
 
 
@@ -41,6 +44,18 @@ struct semaphore *finished;
  * **********************************************************************
  */
 
+/*
+ * Sharded mode ("1a 1"): instead of all incrementing one counter under
+ * one lock, the adders increment a per-cpu sharded counter. To still
+ * do exactly NADDS increments, they take permission for increments a
+ * batch of up to ADD_BATCH at a time from a shared budget under
+ * adderLock, and then do that many increments without it.
+ */
+#define ADD_BATCH 64
+
+static struct pcounter *sharded_counter;
+static unsigned long budget;
+
 
 
 /*
@@ -104,6 +119,40 @@ static void adder(void * unusedpointer, unsigned long addernumber)
         thread_exit();
 }
 
+/*
+ * sharded_adder()
+ *
+ *  The adder thread for sharded mode.
+ */
+static void sharded_adder(void * unusedpointer, unsigned long addernumber)
+{
+        unsigned long int n;
+
+        (void) unusedpointer;
+
+        while (1) {
+                /* take a batch of increments from the budget */
+                lock_acquire(adderLock);
+                n = budget < ADD_BATCH ? budget : ADD_BATCH;
+                budget -= n;
+                lock_release(adderLock);
+
+                if (n == 0) {
+                        break;
+                }
+
+                while (n > 0) {
+                        pcounter_inc(sharded_counter);
+                        adder_counters[addernumber]++;
+                        n--;
+                }
+        }
+
+        V(finished);
+
+        thread_exit();
+}
+
 /*
  * maths()
  *
@@ -118,13 +167,13 @@ static void adder(void * unusedpointer, unsigned long addernumber)
 int maths (int data1, char **data2)
 {
         int index, error;
-        unsigned long int sum;
+        unsigned long int sum, total;
+        bool sharded;
+        struct timespec before, after, duration;
+        uint64_t nsecs;
 
-        /*
-         * Avoid unused variable warnings.
-         */
-        (void) data1;
-        (void) data2;
+        /* "1a 1" selects sharded mode */
+        sharded = data1 > 1 && atoi(data2[1]) != 0;
         /* create a semaphore to allow main thread to wait on workers */
 
         finished = sem_create("finished", 0);
@@ -145,15 +194,32 @@ int maths (int data1, char **data2)
                 panic("maths: lock create failed");
         }
 
+        if (sharded) {
+                sharded_counter = pcounter_create("adder");
+                if (sharded_counter == NULL) {
+                        panic("maths: pcounter create failed");
+                }
+                budget = NADDS;
+        }
+
         /*
          * Start NADDERS adder() threads.
          */
 
-        kprintf("Starting %d adder threads\n", NADDERS);
+        kprintf("Starting %d %sadder threads on %u cpus\n", NADDERS,
+                sharded ? "sharded " : "", cpu_count());
+
+        counter = 0;
+        for (index = 0; index < NADDERS; index++) {
+                adder_counters[index] = 0;
+        }
+        gettime(&before);
 
         for (index = 0; index < NADDERS; index++) {
 
-                error = thread_fork("adder thread", NULL, &adder, NULL, index);
+                error = thread_fork("adder thread", NULL,
+                                    sharded ? &sharded_adder : &adder,
+                                    NULL, index);
 
                 /*
                  * panic() on error.
@@ -171,8 +237,10 @@ int maths (int data1, char **data2)
         for (index = 0; index < NADDERS; index++) {
                 P(finished);
         }
+        gettime(&after);
 
-        kprintf("Adder threads performed %ld adds\n", counter);
+        total = sharded ? pcounter_read_sync(sharded_counter) : counter;
+        kprintf("Adder threads performed %ld adds\n", total);
 
         /* Print out some statistics */
         sum = 0;
@@ -183,12 +251,26 @@ int maths (int data1, char **data2)
         }
         kprintf("The adders performed %ld increments overall\n", sum);
 
+        timespec_sub(&after, &before, &duration);
+        nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+        kprintf("%lu increments in %llu.%09lu s", total,
+                (unsigned long long)duration.tv_sec,
+                (unsigned long)duration.tv_nsec);
+        if (nsecs > 0) {
+                kprintf(", %llu increments/sec",
+                        (uint64_t)total * 1000000000ULL / nsecs);
+        }
+        kprintf("\n");
+
         /*
          * **********************************************************************
          * INSERT ANY CLEANUP CODE YOU REQUIRE HERE
          * **********************************************************************
          */
         // free memory
+        if (sharded) {
+                pcounter_destroy(sharded_counter);
+        }
         lock_destroy(adderLock);
         /* clean up the semaphore we allocated earlier */
         sem_destroy(finished);
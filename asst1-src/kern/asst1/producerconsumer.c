@@ -1,19 +1,16 @@
 /* This file will contain your solution. Modify it as you wish. */
 #include <types.h>
-#include <synch.h> 
 #include <lib.h>
+#include <mpmcring.h>
 #include "producerconsumer_driver.h"
 
-/* Declare any variables you need here to keep track of and
-   synchronise your bounded. A sample declaration of a buffer is shown
-   below. You can change this if you choose another implementation. */
+/* The bounded buffer is a lock-free multi-producer multi-consumer
+   ring (see mpmcring.h) of BUFFER_SIZE items. Producers and consumers
+   only ever sleep when the buffer is full or empty respectively;
+   otherwise each transfer is a compare-and-swap on the buffer's tail
+   or head and a copy. */
 
-static struct pc_data buffer[BUFFER_SIZE];
-static int buffer_head = 0;
-static int buffer_tail = 0;
-static struct lock *buffer_lock;
-static struct semaphore *safe_consumer;
-static struct semaphore *safe_producer;
+static struct mpmcring *buffer;
 
 
 /* consumer_receive() is called by a consumer to request more data. It
@@ -23,14 +20,8 @@ static struct semaphore *safe_producer;
 struct pc_data consumer_receive(void)
 {
         struct pc_data thedata;
-        P(safe_consumer);
-        lock_acquire(buffer_lock);
-        thedata = buffer[buffer_head];
-        ++buffer_head;
-        buffer_head %= BUFFER_SIZE;
-        lock_release(buffer_lock);
-        V(safe_producer);
 
+        mpmcring_get(buffer, &thedata);
         return thedata;
 }
 
@@ -39,13 +30,24 @@ struct pc_data consumer_receive(void)
 
 void producer_send(struct pc_data item)
 {
-        P(safe_producer);
-        lock_acquire(buffer_lock);
-        buffer[buffer_tail] = item;
-        ++buffer_tail;
-        buffer_tail %= BUFFER_SIZE;
-        lock_release(buffer_lock);
-        V(safe_consumer);
+        mpmcring_put(buffer, &item);
+}
+
+/* consumer_receive_many() receives up to max items into out, taking
+   as many as are available in one go. It blocks only if the buffer is
+   empty, and returns the number received (at least one). */
+
+unsigned consumer_receive_many(struct pc_data *out, unsigned max)
+{
+        return mpmcring_getmany(buffer, out, max);
+}
+
+/* producer_send_many() sends n items, filling as much of the buffer
+   as is free each time round, and blocks only while it is full. */
+
+void producer_send_many(const struct pc_data *items, unsigned n)
+{
+        mpmcring_putmany(buffer, items, n);
 }
 
 
@@ -56,25 +58,15 @@ void producer_send(struct pc_data item)
 
 void producerconsumer_startup(void)
 {
-        buffer_lock = lock_create("buffer_lock");
-        if (buffer_lock == NULL) {
-                panic("producerconsumer: lock create failed");
-        }
-        safe_producer = sem_create("safe_producer", BUFFER_SIZE);
-        if (safe_producer == NULL) {
-                panic("producerconsumer: sem create failed");
-        }
-        safe_consumer = sem_create("safe_consumer", 0);
-        if (safe_consumer== NULL) {
-                panic("producerconsumer: sem create failed");
+        buffer = mpmcring_create("buffer", BUFFER_SIZE,
+                                 sizeof(struct pc_data));
+        if (buffer == NULL) {
+                panic("producerconsumer: ring create failed");
         }
 }
 
 /* Perform any clean-up you need here */
 void producerconsumer_shutdown(void)
 {
-        lock_destroy(buffer_lock);
-        sem_destroy(safe_producer);
-        sem_destroy(safe_consumer);
+        mpmcring_destroy(buffer);
 }
-
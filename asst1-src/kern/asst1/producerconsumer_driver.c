@@ -10,9 +10,11 @@
  */
 #include "opt-synchprobs.h"
 #include <types.h>  /* required by lib.h */
+#include <kern/errno.h>
 #include <lib.h>    /* for kprintf */
 #include <synch.h>  /* for P(), V(), sem_* */
 #include <thread.h> /* for thread_fork() */
+#include <clock.h>  /* for gettime() */
 #include <test.h>
 
 #include "producerconsumer_driver.h"
@@ -38,6 +40,22 @@
  */
 #define SOMETHING_WRONG_COUNT 10000
 
+/* The largest batch the batched throughput mode will move at once. */
+#define MAX_BATCH 64
+
+/* The counts actually used for a run. They default to the constants
+ * above but can be given on the menu command line, as
+ *      1c [producers [consumers [items]]]
+ *      1cb [producers [consumers [items [batch]]]]
+ * to measure throughput at different numbers of threads. 1cb runs
+ * the simulation twice, once a single item at a time and once in
+ * batches of up to batch_size items, to compare the two.
+ */
+static int num_producers;
+static int num_consumers;
+static int items_to_produce;
+static int batch_size;
+
 /* Semaphores which the simulator uses to determine when all
  * producer threads and all consumer threads have finished.
  */
@@ -45,14 +63,14 @@ static struct semaphore *consumer_finished;
 static struct semaphore *producer_finished;
 
 /* The producer thread's only function. This function calls
- * producer_send ITEMS_TO_PRODUCE times and then exits. NUM_PRODUCERS
+ * producer_send items_to_produce times and then exits. num_producers
  * threads are started to run the function.
  */
 static void
 producer_thread(void *unused_ptr, unsigned long thread_num)
 {
         struct pc_data thedata;
-        int items_to_go = ITEMS_TO_PRODUCE;
+        int items_to_go = items_to_produce;
 
         (void)unused_ptr; /* Avoid compiler warnings */
 
@@ -75,7 +93,7 @@ producer_thread(void *unused_ptr, unsigned long thread_num)
         V(producer_finished);
 }
 
-/* The consumer thread's only function. NUM_CONSUMERS threads are started,
+/* The consumer thread's only function. num_consumers threads are started,
  * each of which runs this function. The function continuously calls
  * consumer_receive() until it receives a special data item containing
  * two zero integers. NOTE: Don't rely on this specific protocol when designing
@@ -86,16 +104,23 @@ consumer_thread(void *unused_ptr, unsigned long thread_num)
 {
         struct pc_data thedata;
         int check_count = 0;
+        int wrong_count;
 
         (void)unused_ptr;
         (void)thread_num;
 
         kprintf("Consumer started\n");
 
+        /* Allow for big runs: no consumer can get more than every item. */
+        wrong_count = SOMETHING_WRONG_COUNT;
+        if (wrong_count <= num_producers * items_to_produce) {
+                wrong_count = num_producers * items_to_produce + 1;
+        }
+
         thedata = consumer_receive();
 
         while (thedata.item1 != 0 || thedata.item2 != 0) {
-                if (++check_count >= SOMETHING_WRONG_COUNT) {
+                if (++check_count >= wrong_count) {
                         /*
                          * something must be wrong if we received this many
                          * items.
@@ -112,7 +137,7 @@ consumer_thread(void *unused_ptr, unsigned long thread_num)
                 thedata = consumer_receive();
         }
 
-        if (check_count >= SOMETHING_WRONG_COUNT) {
+        if (check_count >= wrong_count) {
                 kprintf("*** Error! Consumer exiting...\n");
         } else {
                 kprintf("Consumer finished normally\n");
@@ -122,6 +147,93 @@ consumer_thread(void *unused_ptr, unsigned long thread_num)
         V(consumer_finished);
 }
 
+/* The producer thread function for batched runs: the same items as
+ * producer_thread, but sent batch_size at a time with
+ * producer_send_many.
+ */
+static void
+batch_producer_thread(void *unused_ptr, unsigned long thread_num)
+{
+        struct pc_data batch[MAX_BATCH];
+        int items_to_go = items_to_produce;
+        int i, n;
+
+        (void)unused_ptr;
+
+        kprintf("Producer started\n");
+
+        while(items_to_go > 0) {
+                n = items_to_go < batch_size ? items_to_go : batch_size;
+                for (i = 0; i < n; i++) {
+                        batch[i].item1 = items_to_go - i +
+                                (1000 * thread_num);
+                        batch[i].item2 = batch[i].item1 + 1;
+                }
+
+                producer_send_many(batch, n);
+
+                items_to_go = items_to_go - n;
+        }
+
+        kprintf("Producer finished\n");
+        V(producer_finished);
+}
+
+/* The consumer thread function for batched runs, receiving up to
+ * batch_size items at a time with consumer_receive_many. Stop
+ * messages are only sent once every producer is done, so anything
+ * after one in a batch is also a stop message; all but the first are
+ * meant for other consumers and get sent back.
+ */
+static void
+batch_consumer_thread(void *unused_ptr, unsigned long thread_num)
+{
+        struct pc_data batch[MAX_BATCH];
+        int check_count = 0;
+        int wrong_count;
+        unsigned i, n;
+        bool done = false;
+
+        (void)unused_ptr;
+        (void)thread_num;
+
+        kprintf("Consumer started\n");
+
+        wrong_count = SOMETHING_WRONG_COUNT;
+        if (wrong_count <= num_producers * items_to_produce) {
+                wrong_count = num_producers * items_to_produce + 1;
+        }
+
+        while (!done && check_count < wrong_count) {
+                n = consumer_receive_many(batch, batch_size);
+                for (i = 0; i < n; i++) {
+                        if (batch[i].item1 == 0 && batch[i].item2 == 0) {
+                                done = true;
+                                break;
+                        }
+                        if (++check_count >= wrong_count) {
+                                break;
+                        }
+                        if(batch[i].item1 +1 != batch[i].item2) {
+                                kprintf("*** Error! Unexpected data "
+                                        "%d and %d\n",
+                                        batch[i].item1, batch[i].item2);
+                        }
+                }
+                if (done && i + 1 < n) {
+                        producer_send_many(&batch[i + 1], n - (i + 1));
+                }
+        }
+
+        if (check_count >= wrong_count) {
+                kprintf("*** Error! Consumer exiting...\n");
+        } else {
+                kprintf("Consumer finished normally\n");
+        }
+
+        V(consumer_finished);
+}
+
 /* Create a bunch of threads to consume data. */
 static void
 start_consumer_threads()
@@ -129,9 +241,11 @@ start_consumer_threads()
         int i;
         int result;
 
-        for(i = 0; i < NUM_CONSUMERS; i++) {
+        for(i = 0; i < num_consumers; i++) {
                 result = thread_fork("consumer thread", NULL,
-                                     consumer_thread, NULL, i);
+                                     batch_size > 1 ?
+                                     batch_consumer_thread : consumer_thread,
+                                     NULL, i);
                 if(result) {
                         panic("start_consumer_threads: couldn't fork (%s)\n",
                               strerror(result));
@@ -146,9 +260,11 @@ start_producer_threads()
         int i;
         int result;
 
-        for(i = 0; i < NUM_PRODUCERS; i++) {
+        for(i = 0; i < num_producers; i++) {
                 result = thread_fork("producer thread", NULL,
-                                     producer_thread, NULL, i);
+                                     batch_size > 1 ?
+                                     batch_producer_thread : producer_thread,
+                                     NULL, i);
                 if(result) {
                         panic("start_producer_threads: couldn't fork (%s)\n",
                               strerror(result));
@@ -157,16 +273,16 @@ start_producer_threads()
 }
 
 /* Wait for all producer threads to exit.
- * Producers each produce ITEMS_TO_PRODUCE items and then signal
+ * Producers each produce items_to_produce items and then signal
  * a semaphore and exit, so waiting for them to finish means
- * waiting on that semaphore NUM_PRODUCERS times.
+ * waiting on that semaphore num_producers times.
  */
 static void
 wait_for_producer_threads()
 {
         int i;
         kprintf("Waiting for producer threads to exit...\n");
-        for(i = 0; i < NUM_PRODUCERS; i++) {
+        for(i = 0; i < num_producers; i++) {
                 P(producer_finished);
         }
         kprintf("All producer threads have exited.\n");
@@ -184,31 +300,33 @@ stop_consumer_threads()
         struct pc_data thedata;
 
         /* Our protocol for stopping consumer threads is to
-         * enqueue NUM_CONSUMERS sets of 0, 0 data items.
+         * enqueue num_consumers sets of 0, 0 data items.
          * This may change during testing, however.
          */
         thedata.item1 = 0;
         thedata.item2 = 0;
 
-        for(i = 0; i < NUM_CONSUMERS; i++) {
+        for(i = 0; i < num_consumers; i++) {
                 producer_send(thedata);
         }
 
         /* Now wait for all consumers to signal completion. */
-        for(i = 0; i < NUM_CONSUMERS; i++) {
+        for(i = 0; i < num_consumers; i++) {
                 P(consumer_finished);
         }
 
 }
 
-/* The main function for the simulation. */
-int
-run_producerconsumer(int nargs, char **args)
+/* Run the simulation once, moving batch items at a time (one at a
+ * time if batch is 1), and report its throughput.
+ */
+static void
+simulate(int batch)
 {
-        (void) nargs; /* Avoid "unused variable" warning */
-        (void) args;
+        struct timespec before, after, duration;
+        uint64_t nsecs, items;
 
-        kprintf("run_producerconsumer: starting up\n");
+        batch_size = batch;
 
         /* Initialise synch primitives used in this simulator */
         consumer_finished = sem_create("consumer_finished", 0);
@@ -225,6 +343,7 @@ run_producerconsumer(int nargs, char **args)
         producerconsumer_startup();
 
         /* Run the simulation */
+        gettime(&before);
         start_consumer_threads();
         start_producer_threads();
 
@@ -232,6 +351,22 @@ run_producerconsumer(int nargs, char **args)
 
         wait_for_producer_threads();
         stop_consumer_threads();
+        gettime(&after);
+
+        /* Report throughput, counting the stop messages too */
+        timespec_sub(&after, &before, &duration);
+        nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+        items = (uint64_t)num_producers * items_to_produce + num_consumers;
+        kprintf("%d producers, %d consumers, batch %d: "
+                "%llu items in %llu.%09lu s",
+                num_producers, num_consumers, batch, items,
+                (unsigned long long)duration.tv_sec,
+                (unsigned long)duration.tv_nsec);
+        if (nsecs > 0) {
+                kprintf(", %llu items/sec",
+                        items * 1000000000ULL / nsecs);
+        }
+        kprintf("\n");
 
         /* Run any code required to shut down the simulation */
         producerconsumer_shutdown();
@@ -239,6 +374,51 @@ run_producerconsumer(int nargs, char **args)
         /* Done! */
         sem_destroy(producer_finished);
         sem_destroy(consumer_finished);
+}
+
+/* Pick up the thread and item counts from the command line. */
+static int
+getcounts(int nargs, char **args)
+{
+        num_producers = nargs > 1 ? atoi(args[1]) : NUM_PRODUCERS;
+        num_consumers = nargs > 2 ? atoi(args[2]) : NUM_CONSUMERS;
+        items_to_produce = nargs > 3 ? atoi(args[3]) : ITEMS_TO_PRODUCE;
+        if (num_producers < 1 || num_consumers < 1 || items_to_produce < 1) {
+                return EINVAL;
+        }
+        return 0;
+}
+
+/* The main function for the simulation. */
+int
+run_producerconsumer(int nargs, char **args)
+{
+        if (getcounts(nargs, args)) {
+                kprintf("Usage: 1c [producers [consumers [items]]]\n");
+                return EINVAL;
+        }
+
+        kprintf("run_producerconsumer: starting up\n");
+        simulate(1);
         return 0;
 }
 
+/* Throughput mode: the same simulation single-item and batched. */
+int
+run_producerconsumer_batched(int nargs, char **args)
+{
+        int batch;
+
+        batch = nargs > 4 ? atoi(args[4]) : BUFFER_SIZE;
+        if (getcounts(nargs, args) || batch < 2 || batch > MAX_BATCH) {
+                kprintf("Usage: 1cb [producers [consumers [items "
+                        "[batch]]]]\n");
+                kprintf("       (batch from 2 to %d)\n", MAX_BATCH);
+                return EINVAL;
+        }
+
+        kprintf("run_producerconsumer_batched: starting up\n");
+        simulate(1);
+        simulate(batch);
+        return 0;
+}
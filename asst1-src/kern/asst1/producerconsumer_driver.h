@@ -31,6 +31,7 @@ struct pc_data {
 
 
 extern int run_producerconsumer(int, char**);
+extern int run_producerconsumer_batched(int, char**);
 
 
 
@@ -43,6 +44,16 @@ struct pc_data consumer_receive(void); /* receive a data item, blocking
 void producer_send(struct pc_data); /* send a data item to the shared
                                        buffer */
 
+unsigned consumer_receive_many(struct pc_data *, unsigned);
+                                    /* receive up to the given number of
+                                       items, blocking only if none are
+                                       available; returns how many */
+
+void producer_send_many(const struct pc_data *, unsigned);
+                                    /* send the given number of items,
+                                       blocking while the buffer is
+                                       full */
+
 void producerconsumer_startup(void); /* initialise your buffer and
                                         surrounding code */
 
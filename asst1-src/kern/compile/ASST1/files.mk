@@ -57,6 +57,8 @@ SRCS+=$(KTOP)/lib/bswap.c
 SRCS+=$(KTOP)/lib/kgets.c
 SRCS+=$(KTOP)/lib/kprintf.c
 SRCS+=$(KTOP)/lib/misc.c
+SRCS+=$(KTOP)/lib/mpmcring.c
+SRCS+=$(KTOP)/lib/pcounter.c
 SRCS+=$(KTOP)/lib/time.c
 SRCS+=$(KTOP)/lib/uio.c
 SRCS+=$(KTOP)/main/main.c
@@ -117,6 +117,11 @@ void cpu_hatch(unsigned software_number);
  */
 void cpu_identify(char *buf, size_t max);
 
+/*
+ * Number of CPUs. Software cpu numbers run from 0 to cpu_count()-1.
+ */
+unsigned cpu_count(void);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
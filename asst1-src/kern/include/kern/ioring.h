@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * Submission and completion rings for io_enter().
+ *
+ * A process keeps a struct ioring in its own memory (it fits in a
+ * page; page-align it to keep it in one). To queue a request it fills
+ * in sq[sq_tail % IORING_SQ_ENTRIES] and advances sq_tail; io_enter
+ * then takes requests from sq_head onwards, advancing sq_head, and
+ * hands them to kernel worker threads, so requests on different
+ * files and devices are in progress at the same time.
+ *
+ * Finished requests show up in cq[]: the kernel fills in
+ * cq[cq_tail % IORING_CQ_ENTRIES] and advances cq_tail, and the
+ * process advances cq_head as it consumes them. Completions come in
+ * whatever order the requests finish. The counters run freely and
+ * wrap; only the differences between them matter.
+ *
+ * The kernel only looks at the ring inside io_enter. Data for writes
+ * is copied when the request is submitted, so the buffer can be
+ * reused as soon as io_enter returns; data for reads is copied out
+ * when the completion is posted, so the buffer must be left alone
+ * until then. At most IORING_MAXLEN bytes are transferred per request;
+ * longer requests come back short, like a short read or write. Reads
+ * and writes on files that can't seek (pipes, the console) fail with
+ * ESPIPE.
+ */
+
+#define IORING_SQ_ENTRIES	32	/* must be a power of 2 */
+#define IORING_CQ_ENTRIES	64	/* must be a power of 2 */
+#define IORING_MAXLEN		4096
+
+/* Operations (sqe_op) */
+#define IORING_OP_NOP		0	/* just complete */
+#define IORING_OP_READ		1	/* read sqe_len bytes into sqe_buf */
+#define IORING_OP_WRITE		2	/* write sqe_len bytes from sqe_buf */
+#define IORING_OP_FSYNC		3	/* flush the file to disk */
+
+/* Submission queue entry */
+struct ioring_sqe {
+	int sqe_op;			/* IORING_OP_* */
+	int sqe_fd;			/* file to operate on */
+	off_t sqe_offset;		/* file offset, or -1 for the seek
+					   position (which then advances) */
+#ifdef _KERNEL
+	userptr_t sqe_buf;		/* user-supplied buffer */
+#else
+	void *sqe_buf;			/* buffer */
+#endif
+	size_t sqe_len;			/* length of buffer */
+	unsigned sqe_userdata;		/* copied to the completion */
+	unsigned sqe_pad;
+};
+
+/* Completion queue entry */
+struct ioring_cqe {
+	unsigned cqe_userdata;		/* from the request */
+	int cqe_res;			/* bytes transferred, or -errno */
+};
+
+struct ioring {
+	unsigned sq_head;		/* advanced by the kernel */
+	unsigned sq_tail;		/* advanced by the process */
+	unsigned cq_head;		/* advanced by the process */
+	unsigned cq_tail;		/* advanced by the kernel */
+	struct ioring_sqe sq[IORING_SQ_ENTRIES];
+	struct ioring_cqe cq[IORING_CQ_ENTRIES];
+};
+
+#endif /* _KERN_IORING_H_ */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_KDATA_H_
+#define _KERN_KDATA_H_
+
+/*
+ * Kernel data pages: two read-only pages the kernel maps into every
+ * user address space, so that libc can get the time and the pid
+ * without a system call.
+ *
+ * KDATA_TIME holds a struct kdata_time. There is one copy, shared by
+ * every process, and the kernel updates it every hardclock, so the
+ * time in it is only as good as a tick (1/HZ seconds). The kernel
+ * makes kt_gen odd while it is changing the rest, so readers should
+ * retry until they see the same even kt_gen before and after reading
+ * kt_sec and kt_nsec.
+ *
+ * KDATA_PROC holds a struct kdata_proc, which is different in each
+ * process.
+ *
+ * The pages sit just below the stack. The __kdata system call returns
+ * KDATA_TIME if they are there, so libc can check once and fall back
+ * to system calls on kernels that don't map them.
+ */
+
+#define KDATA_TIME	0x7ffe0000
+#define KDATA_PROC	0x7ffe1000
+
+struct kdata_time {
+	volatile unsigned kt_gen;	/* odd while being updated */
+	volatile __time_t kt_sec;	/* seconds */
+	volatile __i32 kt_nsec;		/* nanoseconds */
+};
+
+struct kdata_proc {
+	__pid_t kp_pid;			/* process id */
+};
+
+#endif /* _KERN_KDATA_H_ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSTAT_H_
+#define _KERN_SYSTAT_H_
+
+/*
+ * System call statistics and tracing, as returned by systat().
+ *
+ * SYSTAT_STATS: fill BUF with a struct systat_call for each call
+ *               number from 0 up, as many as fit in LEN bytes (at
+ *               most SYSTAT_NCALLS); returns the number filled in.
+ * SYSTAT_TRACE: fill BUF with the most recent calls logged while
+ *               tracing was on, oldest first, as many as fit in LEN
+ *               bytes; returns the number filled in.
+ * SYSTAT_RESET: clear the statistics and the trace log.
+ * SYSTAT_TRACEON, SYSTAT_TRACEOFF: start or stop logging calls.
+ *
+ * Latencies are in cycles of the cpu the call ran on. A call that
+ * went to sleep on one cpu and woke up on another can't be timed; it
+ * is counted, but left out of the latency numbers (and has a
+ * st_cycles of 0 in the trace).
+ */
+
+#define SYSTAT_STATS	0
+#define SYSTAT_TRACE	1
+#define SYSTAT_RESET	2
+#define SYSTAT_TRACEON	3
+#define SYSTAT_TRACEOFF	4
+
+#define SYSTAT_NCALLS	128	/* call numbers counted: 0 to NCALLS-1 */
+#define SYSTAT_BUCKETS	32	/* latency histogram buckets */
+#define SYSTAT_TRACESIZE 256	/* calls kept in the trace log */
+
+/*
+ * Counts for one call number. sc_hist[i] counts calls that took at
+ * least 2^i cycles but less than 2^(i+1) (bucket 0 also has 0).
+ */
+struct systat_call {
+	unsigned sc_count;		/* number of calls */
+	unsigned sc_errors;		/* number that failed */
+	unsigned sc_timed;		/* number with latencies */
+	unsigned sc_maxcycles;		/* longest */
+	unsigned long long sc_cycles;	/* total */
+	unsigned sc_hist[SYSTAT_BUCKETS];
+};
+
+/*
+ * One logged call.
+ */
+struct systat_trace {
+	unsigned st_seq;		/* sequence number */
+	int st_pid;			/* calling process */
+	int st_callno;			/* call number */
+	unsigned st_args[4];		/* a0-a3 */
+	int st_retval;			/* return value, if it succeeded */
+	int st_err;			/* error code, or 0 */
+	unsigned st_cycles;		/* latency, or 0 if not known */
+};
+
+#endif /* _KERN_SYSTAT_H_ */
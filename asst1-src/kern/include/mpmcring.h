@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Bounded multi-producer multi-consumer ring buffer.
+ */
+
+#ifndef _MPMCRING_H_
+#define _MPMCRING_H_
+
+#include <spinlock.h>
+
+struct wchan;
+
+/*
+ * A ring of NSLOTS fixed-size items, which any number of threads may
+ * put into and get from at once.
+ *
+ * The fast path takes no locks. Every slot carries a sequence number
+ * saying which lap of the ring it's ready for (Dmitry Vyukov's bounded
+ * MPMC queue): a putter claims the slot at r_tail by advancing r_tail
+ * with compare-and-swap once the slot's sequence number shows it has
+ * been emptied, copies the item in, and then bumps the sequence
+ * number to hand it to getters; getters do the same at r_head. Slots
+ * are filled and emptied in order, so the ring is FIFO.
+ *
+ * Positions count modulo r_wrap, the largest multiple of NSLOTS no
+ * bigger than 2^31, so NSLOTS needn't be a power of two.
+ *
+ * Threads only block, on r_lock and the wait channels, when the ring
+ * is actually full (putters) or empty (getters).
+ */
+struct mpmcring {
+	char *r_name;
+	unsigned r_nslots;		/* Number of slots */
+	unsigned r_wrap;		/* Positions wrap at this */
+	size_t r_itemsize;		/* Size of each item */
+	volatile spinlock_data_t *r_seq; /* Sequence number for each slot */
+	char *r_items;			/* The items themselves */
+	volatile spinlock_data_t r_head; /* Next position to get from */
+	volatile spinlock_data_t r_tail; /* Next position to put at */
+
+	struct spinlock r_lock;		/* Protects the wait channels */
+	struct wchan *r_putwchan;	/* Putters wait here while full */
+	struct wchan *r_getwchan;	/* Getters wait here while empty */
+	volatile unsigned r_putwaiters;	/* Putters waiting or about to */
+	volatile unsigned r_getwaiters;	/* Getters waiting or about to */
+};
+
+/*
+ * Operations:
+ *    mpmcring_create  - make a ring of NSLOTS items of ITEMSIZE bytes.
+ *                       Returns NULL if out of memory.
+ *    mpmcring_destroy - destroy a ring. Nobody may be waiting on it.
+ *    mpmcring_tryput  - copy ITEM into the ring if there's room.
+ *                       Returns true if it did.
+ *    mpmcring_tryget  - copy the oldest item out of the ring into
+ *                       ITEM if there is one. Returns true if it did.
+ *    mpmcring_put     - like tryput, but wait for room if need be.
+ *    mpmcring_get     - like tryget, but wait for an item if need be.
+ *
+ * and their batched forms, which move up to N items (from or to an
+ * array) at the cost of a single claim on the ring and one wakeup
+ * round for however many threads the batch can satisfy:
+ *    mpmcring_tryputmany - put as many of the N ITEMS as there is room
+ *                          for, in order. Returns how many.
+ *    mpmcring_trygetmany - get as many items as are there, up to N.
+ *                          Returns how many.
+ *    mpmcring_putmany    - put all N items, waiting for room as needed.
+ *    mpmcring_getmany    - get up to N items, waiting until there is
+ *                          at least one. Returns how many.
+ */
+struct mpmcring *mpmcring_create(const char *name, unsigned nslots,
+				 size_t itemsize);
+void mpmcring_destroy(struct mpmcring *r);
+bool mpmcring_tryput(struct mpmcring *r, const void *item);
+bool mpmcring_tryget(struct mpmcring *r, void *item);
+void mpmcring_put(struct mpmcring *r, const void *item);
+void mpmcring_get(struct mpmcring *r, void *item);
+unsigned mpmcring_tryputmany(struct mpmcring *r, const void *items,
+			     unsigned n);
+unsigned mpmcring_trygetmany(struct mpmcring *r, void *items, unsigned n);
+void mpmcring_putmany(struct mpmcring *r, const void *items, unsigned n);
+unsigned mpmcring_getmany(struct mpmcring *r, void *items, unsigned n);
+
+#endif /* _MPMCRING_H_ */
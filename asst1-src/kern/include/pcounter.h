@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sharded event counter.
+ */
+
+#ifndef _PCOUNTER_H_
+#define _PCOUNTER_H_
+
+#include <spinlock.h>
+#include <platform/maxcpus.h>
+
+/*
+ * A counter split into one shard per cpu, for counting things that
+ * happen often on many cpus at once but are only rarely read.
+ *
+ * Each shard has its own spinlock. An increment goes to the shard of
+ * the cpu it runs on, so it only ever takes a lock nobody else is
+ * using (unless the thread migrates between choosing the shard and
+ * locking it, which is harmless: the lock is still a lock). Reading
+ * adds up the shards: pcounter_read does so without locking and may
+ * miss increments in flight, while pcounter_read_sync takes every
+ * shard's lock, in cpu order, so it sees an exact total.
+ *
+ * Each shard is aligned to (and so padded out to) PCOUNTER_LINESIZE,
+ * so that no two cpus' shards share a cache line and bounce it back
+ * and forth. That's a guess at the line size that is at least as big
+ * as that of the machines we run on. A whole pcounter is bigger than
+ * a kmalloc subpage block, so it comes on its own pages and the
+ * alignment holds in the heap as well.
+ */
+#define PCOUNTER_LINESIZE	64
+
+struct pcounter_shard {
+	struct spinlock ps_lock;
+	volatile unsigned long ps_count;
+} __ALIGNED(PCOUNTER_LINESIZE);
+
+struct pcounter {
+	char *pc_name;
+	struct pcounter_shard pc_shards[MAXCPUS];
+};
+
+/*
+ * Operations:
+ *    pcounter_create    - make a counter, starting at 0. Returns NULL
+ *                         if out of memory.
+ *    pcounter_destroy   - destroy a counter.
+ *    pcounter_inc       - add 1.
+ *    pcounter_add       - add N.
+ *    pcounter_read      - fetch the total, possibly missing increments
+ *                         that happen while it is being read.
+ *    pcounter_read_sync - fetch the exact total.
+ */
+struct pcounter *pcounter_create(const char *name);
+void pcounter_destroy(struct pcounter *pc);
+void pcounter_inc(struct pcounter *pc);
+void pcounter_add(struct pcounter *pc, unsigned long n);
+unsigned long pcounter_read(struct pcounter *pc);
+unsigned long pcounter_read_sync(struct pcounter *pc);
+
+#endif /* _PCOUNTER_H_ */
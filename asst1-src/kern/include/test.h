@@ -39,6 +39,7 @@
 int twolocks(int, char **);
 int maths(int, char **);
 int run_producerconsumer(int, char **);
+int run_producerconsumer_batched(int, char **);
 int run_bar(int, char **);
 #endif
 
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Bounded multi-producer multi-consumer ring buffer. See mpmcring.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <wchan.h>
+#include <mpmcring.h>
+
+/*
+ * Position arithmetic, modulo r_wrap. Positions are always less than
+ * r_wrap, which is at most 2^31, so the raw difference fits in an int;
+ * mpmcring_diff folds it into (-r_wrap/2, r_wrap/2] so that a position
+ * just past the wrap still counts as ahead of one just before it.
+ */
+static
+unsigned
+mpmcring_add(const struct mpmcring *r, unsigned pos, unsigned n)
+{
+	pos += n;
+	if (pos >= r->r_wrap) {
+		pos -= r->r_wrap;
+	}
+	return pos;
+}
+
+static
+int
+mpmcring_diff(const struct mpmcring *r, unsigned a, unsigned b)
+{
+	int d, half;
+
+	d = (int)(a - b);
+	half = (int)(r->r_wrap / 2);
+	if (d > half) {
+		d -= (int)r->r_wrap;
+	}
+	else if (d <= -half) {
+		d += (int)r->r_wrap;
+	}
+	return d;
+}
+
+struct mpmcring *
+mpmcring_create(const char *name, unsigned nslots, size_t itemsize)
+{
+	struct mpmcring *r;
+	unsigned i;
+
+	KASSERT(nslots > 0 && nslots <= 0x40000000);
+	KASSERT(itemsize > 0);
+
+	r = kmalloc(sizeof(*r));
+	if (r == NULL) {
+		return NULL;
+	}
+	r->r_name = kstrdup(name);
+	r->r_seq = kmalloc(nslots * sizeof(r->r_seq[0]));
+	r->r_items = kmalloc(nslots * itemsize);
+	r->r_putwchan = wchan_create("mpmcring put");
+	r->r_getwchan = wchan_create("mpmcring get");
+	if (r->r_name == NULL || r->r_seq == NULL || r->r_items == NULL ||
+	    r->r_putwchan == NULL || r->r_getwchan == NULL) {
+		if (r->r_getwchan != NULL) {
+			wchan_destroy(r->r_getwchan);
+		}
+		if (r->r_putwchan != NULL) {
+			wchan_destroy(r->r_putwchan);
+		}
+		kfree(r->r_items);
+		kfree((void *)r->r_seq);
+		kfree(r->r_name);
+		kfree(r);
+		return NULL;
+	}
+
+	r->r_nslots = nslots;
+	r->r_wrap = (0x80000000U / nslots) * nslots;
+	r->r_itemsize = itemsize;
+	for (i=0; i<nslots; i++) {
+		/* Slot i is ready to be filled at position i. */
+		spinlock_data_set(&r->r_seq[i], i);
+	}
+	spinlock_data_set(&r->r_head, 0);
+	spinlock_data_set(&r->r_tail, 0);
+
+	spinlock_init(&r->r_lock);
+	r->r_putwaiters = 0;
+	r->r_getwaiters = 0;
+	return r;
+}
+
+void
+mpmcring_destroy(struct mpmcring *r)
+{
+	KASSERT(r->r_putwaiters == 0);
+	KASSERT(r->r_getwaiters == 0);
+
+	spinlock_cleanup(&r->r_lock);
+	wchan_destroy(r->r_getwchan);
+	wchan_destroy(r->r_putwchan);
+	kfree(r->r_items);
+	kfree((void *)r->r_seq);
+	kfree(r->r_name);
+	kfree(r);
+}
+
+/*
+ * Claim up to N consecutive positions on the END counter (r_tail for
+ * putting, r_head for getting). The slot for position pos is ours
+ * when its sequence number reads pos + AHEAD (0 for putters: emptied
+ * on the last lap; 1 for getters: filled on this one). We count how
+ * many slots from END on are ready and take them all with one
+ * compare-and-swap; nobody else can take a ready slot without moving
+ * END, so if the swap works they are all still ours. If the first
+ * slot isn't ready yet the ring is full (or empty) and we claim
+ * nothing; if it was already taken, someone else got there first and
+ * we try again at the new END.
+ *
+ * Returns the number of positions claimed, the first in *RET.
+ */
+static
+unsigned
+mpmcring_claim(struct mpmcring *r, volatile spinlock_data_t *end,
+	       unsigned ahead, unsigned n, unsigned *ret)
+{
+	unsigned pos, seq, old, k, p;
+	int d;
+
+	KASSERT(n > 0 && n <= r->r_nslots);
+
+	pos = spinlock_data_get(end);
+	while (1) {
+		seq = spinlock_data_get(&r->r_seq[pos % r->r_nslots]);
+		d = mpmcring_diff(r, seq, mpmcring_add(r, pos, ahead));
+		if (d < 0) {
+			return 0;
+		}
+		if (d > 0) {
+			pos = spinlock_data_get(end);
+			continue;
+		}
+
+		for (k = 1; k < n; k++) {
+			p = mpmcring_add(r, pos, k);
+			seq = spinlock_data_get(&r->r_seq[p % r->r_nslots]);
+			if (seq != mpmcring_add(r, p, ahead)) {
+				break;
+			}
+		}
+
+		old = spinlock_data_cas(end, pos, mpmcring_add(r, pos, k));
+		if (old == pos) {
+			*ret = pos;
+			return k;
+		}
+		pos = old;
+	}
+}
+
+unsigned
+mpmcring_tryputmany(struct mpmcring *r, const void *items, unsigned n)
+{
+	const char *src = items;
+	unsigned pos, slot, k, i;
+
+	if (n > r->r_nslots) {
+		n = r->r_nslots;
+	}
+	k = mpmcring_claim(r, &r->r_tail, 0, n, &pos);
+	for (i=0; i<k; i++) {
+		slot = pos % r->r_nslots;
+		memcpy(r->r_items + slot * r->r_itemsize,
+		       src + i * r->r_itemsize, r->r_itemsize);
+		/* The item has to be there before getters can see the slot. */
+		membar_store_store();
+		spinlock_data_set(&r->r_seq[slot], mpmcring_add(r, pos, 1));
+		pos = mpmcring_add(r, pos, 1);
+	}
+	return k;
+}
+
+unsigned
+mpmcring_trygetmany(struct mpmcring *r, void *items, unsigned n)
+{
+	char *dst = items;
+	unsigned pos, slot, k, i;
+
+	if (n > r->r_nslots) {
+		n = r->r_nslots;
+	}
+	k = mpmcring_claim(r, &r->r_head, 1, n, &pos);
+	if (k > 0) {
+		membar_load_load();
+	}
+	for (i=0; i<k; i++) {
+		slot = pos % r->r_nslots;
+		memcpy(dst + i * r->r_itemsize,
+		       r->r_items + slot * r->r_itemsize, r->r_itemsize);
+		/* Done reading before putters can reuse the slot. */
+		membar_any_store();
+		spinlock_data_set(&r->r_seq[slot],
+				  mpmcring_add(r, pos, r->r_nslots));
+		pos = mpmcring_add(r, pos, 1);
+	}
+	return k;
+}
+
+bool
+mpmcring_tryput(struct mpmcring *r, const void *item)
+{
+	return mpmcring_tryputmany(r, item, 1) == 1;
+}
+
+bool
+mpmcring_tryget(struct mpmcring *r, void *item)
+{
+	return mpmcring_trygetmany(r, item, 1) == 1;
+}
+
+/*
+ * Having put or got N items, wake up to N threads on the other side
+ * if any are waiting. The waiter counts go up before waiters look at
+ * the ring for the last time, and we look at them only after
+ * changing the ring, with full barriers in between on both sides;
+ * so either the waiter sees our change or we see the waiter.
+ */
+static
+void
+mpmcring_wakeup(struct mpmcring *r, volatile unsigned *waiters,
+		struct wchan *wc, unsigned n)
+{
+	membar_any_any();
+	if (*waiters == 0) {
+		return;
+	}
+	spinlock_acquire(&r->r_lock);
+	if (n >= *waiters) {
+		wchan_wakeall(wc, &r->r_lock);
+	}
+	else {
+		while (n-- > 0) {
+			wchan_wakeone(wc, &r->r_lock);
+		}
+	}
+	spinlock_release(&r->r_lock);
+}
+
+void
+mpmcring_putmany(struct mpmcring *r, const void *items, unsigned n)
+{
+	const char *src = items;
+	unsigned k;
+
+	while (n > 0) {
+		k = mpmcring_tryputmany(r, src, n);
+		if (k == 0) {
+			spinlock_acquire(&r->r_lock);
+			r->r_putwaiters++;
+			membar_any_any();
+			while ((k = mpmcring_tryputmany(r, src, n)) == 0) {
+				wchan_sleep(r->r_putwchan, &r->r_lock);
+			}
+			r->r_putwaiters--;
+			spinlock_release(&r->r_lock);
+		}
+		mpmcring_wakeup(r, &r->r_getwaiters, r->r_getwchan, k);
+		src += k * r->r_itemsize;
+		n -= k;
+	}
+}
+
+unsigned
+mpmcring_getmany(struct mpmcring *r, void *items, unsigned n)
+{
+	unsigned k;
+
+	KASSERT(n > 0);
+
+	k = mpmcring_trygetmany(r, items, n);
+	if (k == 0) {
+		spinlock_acquire(&r->r_lock);
+		r->r_getwaiters++;
+		membar_any_any();
+		while ((k = mpmcring_trygetmany(r, items, n)) == 0) {
+			wchan_sleep(r->r_getwchan, &r->r_lock);
+		}
+		r->r_getwaiters--;
+		spinlock_release(&r->r_lock);
+	}
+	mpmcring_wakeup(r, &r->r_putwaiters, r->r_putwchan, k);
+	return k;
+}
+
+void
+mpmcring_put(struct mpmcring *r, const void *item)
+{
+	mpmcring_putmany(r, item, 1);
+}
+
+void
+mpmcring_get(struct mpmcring *r, void *item)
+{
+	mpmcring_getmany(r, item, 1);
+}
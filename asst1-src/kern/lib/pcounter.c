@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sharded event counter. See pcounter.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <pcounter.h>
+
+struct pcounter *
+pcounter_create(const char *name)
+{
+	struct pcounter *pc;
+	unsigned i;
+
+	pc = kmalloc(sizeof(*pc));
+	if (pc == NULL) {
+		return NULL;
+	}
+	KASSERT(((vaddr_t)pc->pc_shards & (PCOUNTER_LINESIZE - 1)) == 0);
+	pc->pc_name = kstrdup(name);
+	if (pc->pc_name == NULL) {
+		kfree(pc);
+		return NULL;
+	}
+	for (i=0; i<MAXCPUS; i++) {
+		spinlock_init(&pc->pc_shards[i].ps_lock);
+		pc->pc_shards[i].ps_count = 0;
+	}
+	return pc;
+}
+
+void
+pcounter_destroy(struct pcounter *pc)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		spinlock_cleanup(&pc->pc_shards[i].ps_lock);
+	}
+	kfree(pc->pc_name);
+	kfree(pc);
+}
+
+void
+pcounter_add(struct pcounter *pc, unsigned long n)
+{
+	struct pcounter_shard *ps;
+
+	ps = &pc->pc_shards[curcpu->c_number];
+	spinlock_acquire(&ps->ps_lock);
+	ps->ps_count += n;
+	spinlock_release(&ps->ps_lock);
+}
+
+void
+pcounter_inc(struct pcounter *pc)
+{
+	pcounter_add(pc, 1);
+}
+
+unsigned long
+pcounter_read(struct pcounter *pc)
+{
+	unsigned long total;
+	unsigned i, n;
+
+	n = cpu_count();
+	total = 0;
+	for (i=0; i<n; i++) {
+		total += pc->pc_shards[i].ps_count;
+	}
+	return total;
+}
+
+unsigned long
+pcounter_read_sync(struct pcounter *pc)
+{
+	unsigned long total;
+	unsigned i, n;
+
+	n = cpu_count();
+	total = 0;
+	for (i=0; i<n; i++) {
+		spinlock_acquire(&pc->pc_shards[i].ps_lock);
+	}
+	for (i=0; i<n; i++) {
+		total += pc->pc_shards[i].ps_count;
+	}
+	for (i=n; i>0; i--) {
+		spinlock_release(&pc->pc_shards[i-1].ps_lock);
+	}
+	return total;
+}
@@ -601,6 +601,7 @@ static const char *mainmenu[] = {
 	"[1a] Simple math synchronisation    ",
 	"[1b] Simple deadlock                ",
 	"[1c] Producer/consumer problem      ",
+	"[1cb] Producer/consumer batching    ",
 	"[1d] Bar synchronisation            ",
 #endif
 	"[kh] Kernel heap stats              ",
@@ -658,6 +659,7 @@ static struct {
 	{ "1a",     maths },
 	{ "1b",     twolocks },
 	{ "1c",     run_producerconsumer},
+	{ "1cb",    run_producerconsumer_batched},
 	{ "1d",     run_bar},
 #endif
 
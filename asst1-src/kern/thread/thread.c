@@ -254,6 +254,15 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Number of CPUs.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Destroy a thread.
  *
@@ -29,6 +29,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -36,12 +37,18 @@
  * Usage: cat [files]
  */
 
+/* How much to ask copy_file_range for at once. */
+#define COPY_SIZE (1024*1024)
 
 
-/* Print a file that's already been opened. */
+
+/*
+ * Print the rest of a file through a buffer, for kernels without
+ * copy_file_range.
+ */
 static
 void
-docat(const char *name, int fd)
+catloop(const char *name, int fd)
 {
 	char buf[1024];
 	int len, wr, wrtot;
@@ -74,6 +81,34 @@ docat(const char *name, int fd)
 	}
 }
 
+/* Print a file that's already been opened. */
+static
+void
+docat(const char *name, int fd)
+{
+	int len, total;
+
+	/*
+	 * Have the kernel copy the file to stdout for us. As long as we
+	 * get more than zero bytes, we haven't hit EOF. Zero means EOF.
+	 * Less than zero means an error occurred. (When reading from
+	 * the console each call returns after a line or so.) If the
+	 * kernel doesn't have copy_file_range, or won't do it for these
+	 * files, copy the old way instead.
+	 */
+	total = 0;
+	while ((len = copy_file_range(fd, NULL, STDOUT_FILENO, NULL,
+				      COPY_SIZE)) > 0) {
+		total += len;
+	}
+	if (len<0 && total==0 && (errno==ENOSYS || errno==EINVAL)) {
+		catloop(name, fd);
+	}
+	else if (len<0) {
+		err(1, "%s", name);
+	}
+}
+
 /* Print a file by name. */
 static
 void
@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -35,29 +36,21 @@
  * Usage: cp oldfile newfile
  */
 
+/* How much to ask copy_file_range for at once. */
+#define COPY_SIZE (1024*1024)
 
-/* Copy one file to another. */
+
+/*
+ * Copy the rest of one open file to another through a buffer, for
+ * kernels without copy_file_range.
+ */
 static
 void
-copy(const char *from, const char *to)
+copyloop(const char *from, int fromfd, const char *to, int tofd)
 {
-	int fromfd;
-	int tofd;
 	char buf[1024];
 	int len, wr, wrtot;
 
-	/*
-	 * Open the files, and give up if they won't open
-	 */
-	fromfd = open(from, O_RDONLY);
-	if (fromfd<0) {
-		err(1, "%s", from);
-	}
-	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
-	if (tofd<0) {
-		err(1, "%s", to);
-	}
-
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -84,6 +77,48 @@ copy(const char *from, const char *to)
 	if (len<0) {
 		err(1, "%s", from);
 	}
+}
+
+/* Copy one file to another. */
+static
+void
+copy(const char *from, const char *to)
+{
+	int fromfd;
+	int tofd;
+	int len, total;
+
+	/*
+	 * Open the files, and give up if they won't open
+	 */
+	fromfd = open(from, O_RDONLY);
+	if (fromfd<0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
+	if (tofd<0) {
+		err(1, "%s", to);
+	}
+
+	/*
+	 * Have the kernel move the data across, a big piece at a time,
+	 * without it passing through our address space. As long as we
+	 * get more than zero bytes, we haven't hit EOF. Zero means EOF.
+	 * Less than zero means an error occurred. If the kernel doesn't
+	 * have copy_file_range, or won't do it for these files, copy
+	 * the old way instead.
+	 */
+	total = 0;
+	while ((len = copy_file_range(fromfd, NULL, tofd, NULL,
+				      COPY_SIZE)) > 0) {
+		total += len;
+	}
+	if (len<0 && total==0 && (errno==ENOSYS || errno==EINVAL)) {
+		copyloop(from, fromfd, to, tofd);
+	}
+	else if (len<0) {
+		err(1, "%s to %s", from, to);
+	}
 
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * systat - show system call statistics and traces.
+ *
+ * Usage: systat                 counts and average/max latency per call
+ *        systat hist callno     latency histogram for one call
+ *        systat trace           calls logged since tracing was turned on
+ *        systat on | off        turn tracing on or off
+ *        systat reset           clear the counts and the trace log
+ *
+ * The kernel has to be built with "options systat"; otherwise this
+ * fails with ENOSYS. Latencies are in cpu cycles.
+ *
+ * This program uses these system calls:
+ *    systat write _exit
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+static struct systat_call calls[SYSTAT_NCALLS];
+static struct systat_trace trace[SYSTAT_TRACESIZE];
+
+static
+const char *
+callname(int callno)
+{
+	switch (callno) {
+	    case SYS_fork: return "fork";
+	    case SYS_execv: return "execv";
+	    case SYS_waitpid: return "waitpid";
+	    case SYS_getpid: return "getpid";
+	    case SYS_sbrk: return "sbrk";
+	    case SYS_getrlimit: return "getrlimit";
+	    case SYS_setrlimit: return "setrlimit";
+	    case SYS_open: return "open";
+	    case SYS_pipe: return "pipe";
+	    case SYS_dup2: return "dup2";
+	    case SYS_close: return "close";
+	    case SYS_read: return "read";
+	    case SYS_pread: return "pread";
+	    case SYS_readv: return "readv";
+	    case SYS_getdirentry: return "getdirentry";
+	    case SYS_write: return "write";
+	    case SYS_pwrite: return "pwrite";
+	    case SYS_writev: return "writev";
+	    case SYS_lseek: return "lseek";
+	    case SYS_ftruncate: return "ftruncate";
+	    case SYS_fsync: return "fsync";
+	    case SYS_link: return "link";
+	    case SYS_remove: return "remove";
+	    case SYS_mkdir: return "mkdir";
+	    case SYS_rmdir: return "rmdir";
+	    case SYS_rename: return "rename";
+	    case SYS_chdir: return "chdir";
+	    case SYS___getcwd: return "__getcwd";
+	    case SYS_fstat: return "fstat";
+	    case SYS___time: return "__time";
+	    case SYS_nanosleep: return "nanosleep";
+	    case SYS_sync: return "sync";
+	    case SYS_reboot: return "reboot";
+	    case SYS_futex: return "futex";
+	    case SYS_copy_file_range: return "copy_file_range";
+	    case SYS_io_enter: return "io_enter";
+	    case SYS_systat: return "systat";
+	    case SYS___kdata: return "__kdata";
+	}
+	return "?";
+}
+
+static
+void
+getstats(void)
+{
+	if (systat(SYSTAT_STATS, calls, sizeof(calls)) < 0) {
+		err(1, "systat");
+	}
+}
+
+static
+void
+showstats(void)
+{
+	int i;
+
+	getstats();
+	printf("%-16s %4s %10s %8s %12s %10s\n",
+	       "call", "num", "calls", "errors", "avg cycles", "max");
+	for (i=0; i<SYSTAT_NCALLS; i++) {
+		if (calls[i].sc_count == 0) {
+			continue;
+		}
+		printf("%-16s %4d %10u %8u %12llu %10u\n",
+		       callname(i), i, calls[i].sc_count, calls[i].sc_errors,
+		       calls[i].sc_timed ?
+		       calls[i].sc_cycles / calls[i].sc_timed : 0ULL,
+		       calls[i].sc_maxcycles);
+	}
+}
+
+static
+void
+showhist(int callno)
+{
+	const struct systat_call *sc;
+	unsigned i, lo, hi, most, stars;
+
+	if (callno < 0 || callno >= SYSTAT_NCALLS) {
+		errx(1, "No call %d", callno);
+	}
+	getstats();
+	sc = &calls[callno];
+
+	printf("%s (%d): %u calls, %u errors, %u timed\n", callname(callno),
+	       callno, sc->sc_count, sc->sc_errors, sc->sc_timed);
+
+	lo = SYSTAT_BUCKETS;
+	hi = most = 0;
+	for (i=0; i<SYSTAT_BUCKETS; i++) {
+		if (sc->sc_hist[i] == 0) {
+			continue;
+		}
+		if (lo == SYSTAT_BUCKETS) {
+			lo = i;
+		}
+		hi = i;
+		if (sc->sc_hist[i] > most) {
+			most = sc->sc_hist[i];
+		}
+	}
+	for (i=lo; i<=hi && i<SYSTAT_BUCKETS; i++) {
+		stars = sc->sc_hist[i] * 40ULL / most;
+		printf("%10u -> %-10u %8u ", i == 0 ? 0 : 1U << i,
+		       (2U << i) - 1, sc->sc_hist[i]);
+		while (stars-- > 0) {
+			putchar('*');
+		}
+		putchar('\n');
+	}
+}
+
+static
+void
+showtrace(void)
+{
+	const struct systat_trace *st;
+	int n, i;
+
+	n = systat(SYSTAT_TRACE, trace, sizeof(trace));
+	if (n < 0) {
+		err(1, "systat");
+	}
+	for (i=0; i<n; i++) {
+		st = &trace[i];
+		printf("%6u [%d] %s(0x%x, 0x%x, 0x%x, 0x%x) = %d",
+		       st->st_seq, st->st_pid, callname(st->st_callno),
+		       st->st_args[0], st->st_args[1],
+		       st->st_args[2], st->st_args[3], st->st_retval);
+		if (st->st_err) {
+			printf(" %s", strerror(st->st_err));
+		}
+		if (st->st_cycles) {
+			printf(" <%u>", st->st_cycles);
+		}
+		printf("\n");
+	}
+}
+
+static
+void
+simple(int op)
+{
+	if (systat(op, NULL, 0) < 0) {
+		err(1, "systat");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc == 1) {
+		showstats();
+	}
+	else if (argc == 3 && !strcmp(argv[1], "hist")) {
+		showhist(atoi(argv[2]));
+	}
+	else if (argc == 2 && !strcmp(argv[1], "trace")) {
+		showtrace();
+	}
+	else if (argc == 2 && !strcmp(argv[1], "on")) {
+		simple(SYSTAT_TRACEON);
+	}
+	else if (argc == 2 && !strcmp(argv[1], "off")) {
+		simple(SYSTAT_TRACEOFF);
+	}
+	else if (argc == 2 && !strcmp(argv[1], "reset")) {
+		simple(SYSTAT_RESET);
+	}
+	else {
+		errx(1, "Usage: systat [hist callno | trace | on | off | reset]");
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYNC_UCOND_H_
+#define _SYNC_UCOND_H_
+
+#include <sync/umutex.h>
+
+/*
+ * User-level condition variable built on futex(), with Mesa
+ * semantics like the kernel's CVs. As in the kernel, the mutex must
+ * be held for all three operations; that lets signal and broadcast
+ * skip the system call when nobody is waiting.
+ *
+ * c_seq is bumped by every signal or broadcast; a waiter sleeps only
+ * if it hasn't changed since the waiter let go of the mutex.
+ */
+struct ucond {
+	volatile int c_seq;
+	volatile unsigned c_waiters;
+};
+
+#define UCOND_INITIALIZER	{ 0, 0 }
+
+void ucond_init(struct ucond *c);
+void ucond_wait(struct ucond *c, struct umutex *m);
+void ucond_signal(struct ucond *c, struct umutex *m);
+void ucond_broadcast(struct ucond *c, struct umutex *m);
+
+#endif /* _SYNC_UCOND_H_ */
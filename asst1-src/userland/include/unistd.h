@@ -39,10 +39,15 @@
  * about the kern/ headers.
  */
 #include <kern/fcntl.h>
+#include <kern/futex.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/ioring.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/systat.h>
 #include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -121,6 +126,12 @@ pid_t waitpid(pid_t pid, int *returncode, int flags);
 int open(const char *filename, int flags, ...);
 ssize_t read(int filehandle, void *buf, size_t size);
 ssize_t write(int filehandle, const void *buf, size_t size);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t copy_file_range(int infd, off_t *inpos, int outfd, off_t *outpos,
+			size_t len);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
 int close(int filehandle);
 int reboot(int code);
 int sync(void);
@@ -147,6 +158,13 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int getrlimit(int resource, struct rlimit *rlp);
+int setrlimit(int resource, const struct rlimit *rlp);
+int futex(volatile int *addr, int op, int val);
+int io_enter(struct ioring *ring, unsigned to_submit, unsigned min_complete);
+int systat(int op, void *buf, size_t len);
+void *__kdata(void);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -21,5 +21,11 @@ awk '
     }
 ' | awk '{
 	# output something simple that will work in syscalls.S.
-	printf "SYSCALL(%s, %s)\n", $1, $2;
+	# __time and getpid are wrapped in C by unix/kdata.c.
+	if ($1 == "__time" || $1 == "getpid") {
+		printf "WRAPPEDSYSCALL(%s, %s)\n", $1, $2;
+	}
+	else {
+		printf "SYSCALL(%s, %s)\n", $1, $2;
+	}
 }'
@@ -31,7 +31,7 @@
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
+ * Uses __time (see unix/kdata.c), which does the same thing
  * but also returns nanoseconds.
  */
 
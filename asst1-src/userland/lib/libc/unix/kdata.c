@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * __time and getpid, reading the kernel data pages (see
+ * <kern/kdata.h>) instead of making a system call.
+ *
+ * The first call asks the kernel with __kdata whether the pages are
+ * there. If they aren't (a kernel without them, or one built with
+ * dumbvm), these fall back to the real system calls, whose stubs are
+ * named __sys___time and __sys_getpid (see syscalls/gensyscalls.sh).
+ *
+ * The time in the page is only updated every hardclock, so it is
+ * good to 1/HZ seconds rather than to the nanosecond.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <kern/kdata.h>
+
+int __sys___time(time_t *seconds, unsigned long *nanoseconds);
+pid_t __sys_getpid(void);
+
+static int kdata_state;		/* 0 = don't know yet, 1 = mapped, -1 = not */
+
+static
+int
+kdata_mapped(void)
+{
+	int olderrno;
+
+	if (kdata_state == 0) {
+		/* don't let the probe change errno */
+		olderrno = errno;
+		kdata_state = __kdata() == (void *)KDATA_TIME ? 1 : -1;
+		errno = olderrno;
+	}
+	return kdata_state > 0;
+}
+
+int
+__time(time_t *seconds, unsigned long *nanoseconds)
+{
+	const struct kdata_time *kt = (const struct kdata_time *)KDATA_TIME;
+	unsigned gen;
+	time_t s;
+	unsigned long ns;
+
+	if (!kdata_mapped()) {
+		return __sys___time(seconds, nanoseconds);
+	}
+
+	/*
+	 * The kernel makes kt_gen odd while it updates the time, so
+	 * retry until we get a copy from a single update. (The fields
+	 * are volatile, so these reads happen in order.)
+	 */
+	do {
+		gen = kt->kt_gen;
+		s = kt->kt_sec;
+		ns = kt->kt_nsec;
+	} while ((gen & 1) != 0 || kt->kt_gen != gen);
+
+	if (seconds != NULL) {
+		*seconds = s;
+	}
+	if (nanoseconds != NULL) {
+		*nanoseconds = ns;
+	}
+	return 0;
+}
+
+pid_t
+getpid(void)
+{
+	const struct kdata_proc *kp = (const struct kdata_proc *)KDATA_PROC;
+
+	if (!kdata_mapped()) {
+		return __sys_getpid();
+	}
+	return kp->kp_pid;
+}
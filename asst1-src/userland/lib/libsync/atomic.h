@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Atomic operations on ints for libsync, using the MIPS LL/SC
+ * instructions (see the kernel's spinlock.h for how they work). Each
+ * loops until its SC succeeds.
+ */
+
+#ifndef _LIBSYNC_ATOMIC_H_
+#define _LIBSYNC_ATOMIC_H_
+
+/*
+ * Compare-and-swap: if *p is OLD, set it to NEW. Returns the value
+ * *p had, so it succeeded if that is OLD.
+ */
+static __inline
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != old) give up */
+		"move %1, %4;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Exchange: set *p to NEW and return the old value.
+ */
+static __inline
+int
+atomic_xchg(volatile int *p, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"move %1, %3;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Add INC to *p and return the old value.
+ */
+static __inline
+int
+atomic_add(volatile int *p, int inc)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"addu %1, %0, %3;"	/*   tmp = prev + inc */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (inc)
+		: "memory");
+	return prev;
+}
+
+#endif /* _LIBSYNC_ATOMIC_H_ */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex-based condition variable. See <sync/ucond.h>.
+ */
+
+#include <unistd.h>
+#include <sync/ucond.h>
+
+#include "atomic.h"
+
+void
+ucond_init(struct ucond *c)
+{
+	c->c_seq = 0;
+	c->c_waiters = 0;
+}
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+	int seq;
+
+	/*
+	 * Read the sequence number while still holding the mutex, so
+	 * any signal sent after we let go of it changes the number
+	 * and keeps FUTEX_WAIT from sleeping.
+	 */
+	seq = c->c_seq;
+	c->c_waiters++;
+	umutex_unlock(m);
+
+	futex(&c->c_seq, FUTEX_WAIT, seq);
+
+	/*
+	 * Other woken waiters may be after the mutex too, so take it
+	 * the slow way, marking it as contended.
+	 */
+	while (atomic_xchg(&m->m_state, 2) != 0) {
+		futex(&m->m_state, FUTEX_WAIT, 2);
+	}
+	c->c_waiters--;
+}
+
+void
+ucond_signal(struct ucond *c, struct umutex *m)
+{
+	(void)m;
+
+	if (c->c_waiters == 0) {
+		return;
+	}
+	atomic_add(&c->c_seq, 1);
+	futex(&c->c_seq, FUTEX_WAKE, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c, struct umutex *m)
+{
+	(void)m;
+
+	if (c->c_waiters == 0) {
+		return;
+	}
+	atomic_add(&c->c_seq, 1);
+	futex(&c->c_seq, FUTEX_WAKE, 0x7fffffff);	/* everybody */
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex-based mutex. See <sync/umutex.h>.
+ */
+
+#include <unistd.h>
+#include <sync/umutex.h>
+
+#include "atomic.h"
+
+void
+umutex_init(struct umutex *m)
+{
+	m->m_state = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	int c;
+
+	/* Fast path: free -> held, no system call. */
+	c = atomic_cas(&m->m_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+
+	/*
+	 * Slow path: mark the mutex as having waiters, and sleep
+	 * until we're the one that finds it free. Since we can't
+	 * tell whether anyone else is still waiting once we get it,
+	 * we leave it marked; at worst that costs one extra wakeup.
+	 */
+	if (c != 2) {
+		c = atomic_xchg(&m->m_state, 2);
+	}
+	while (c != 0) {
+		/* EAGAIN just means it changed; look again */
+		futex(&m->m_state, FUTEX_WAIT, 2);
+		c = atomic_xchg(&m->m_state, 2);
+	}
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	return atomic_cas(&m->m_state, 0, 1) == 0;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (atomic_xchg(&m->m_state, 0) == 2) {
+		futex(&m->m_state, FUTEX_WAKE, 1);
+	}
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * aiotest - exercise io_enter.
+ *
+ * Usage: aiotest file [file...]
+ *
+ * Writes NBLOCKS blocks to each file through the submission ring,
+ * with the requests for all the files in flight at once, fsyncs them,
+ * then reads everything back the same way and checks it. Put the
+ * files on different devices (e.g. lhd0:, lhd1:, and emu0:) to keep
+ * all of them busy at the same time.
+ *
+ * Then checks that a failed execv leaves requests in flight alone
+ * (their completions still turn up afterwards), that pipes are
+ * refused with ESPIPE, and that processes can exit with requests in
+ * flight or completions uncollected without upsetting anyone else.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXFILES	4
+#define NBLOCKS		8	/* MAXFILES*NBLOCKS <= IORING_SQ_ENTRIES */
+#define BLOCKSIZE	IORING_MAXLEN
+#define NEXITERS	4	/* processes that exit mid-I/O */
+
+static struct ioring ring __attribute__((aligned(4096)));
+static char bufs[MAXFILES][NBLOCKS][BLOCKSIZE];
+static const char *names[MAXFILES];
+static int fds[MAXFILES];
+
+static
+char
+pattern(unsigned file, unsigned block, unsigned pos)
+{
+	return (char)(file * 31 + block * 7 + pos);
+}
+
+static
+void
+queuefd(int op, int fd, off_t offset, void *buf, size_t len,
+	unsigned userdata)
+{
+	struct ioring_sqe *sqe;
+
+	if (ring.sq_tail - ring.sq_head >= IORING_SQ_ENTRIES) {
+		errx(1, "Submission ring overflow");
+	}
+	sqe = &ring.sq[ring.sq_tail & (IORING_SQ_ENTRIES - 1)];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_offset = offset;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_userdata = userdata;
+	ring.sq_tail++;
+}
+
+static
+void
+queue(int op, unsigned file, unsigned block)
+{
+	queuefd(op, fds[file], (off_t)block * BLOCKSIZE, bufs[file][block],
+		op == IORING_OP_FSYNC ? 0 : BLOCKSIZE, file * NBLOCKS + block);
+}
+
+/*
+ * Submit everything queued without waiting for any of it.
+ */
+static
+void
+submit(void)
+{
+	unsigned n;
+	int r;
+
+	n = ring.sq_tail - ring.sq_head;
+	r = io_enter(&ring, n, 0);
+	if (r < 0) {
+		err(1, "io_enter");
+	}
+	if ((unsigned)r != n) {
+		errx(1, "io_enter submitted %d of %u", r, n);
+	}
+}
+
+/*
+ * Wait for the next completion and return its result.
+ */
+static
+int
+reap(unsigned *userdata_ret)
+{
+	struct ioring_cqe *cqe;
+
+	while (ring.cq_head == ring.cq_tail) {
+		if (io_enter(&ring, 0, 1) < 0) {
+			err(1, "io_enter");
+		}
+	}
+	cqe = &ring.cq[ring.cq_head & (IORING_CQ_ENTRIES - 1)];
+	*userdata_ret = cqe->cqe_userdata;
+	ring.cq_head++;
+	return cqe->cqe_res;
+}
+
+/*
+ * Submit everything queued and collect its completions.
+ */
+static
+void
+run(const char *what, size_t expected)
+{
+	struct ioring_cqe *cqe;
+	unsigned n, submitted, done;
+	const char *name;
+	int r;
+
+	n = ring.sq_tail - ring.sq_head;
+	submitted = done = 0;
+	while (done < n) {
+		r = io_enter(&ring, n - submitted, 1);
+		if (r < 0) {
+			err(1, "io_enter");
+		}
+		submitted += r;
+
+		while (ring.cq_head != ring.cq_tail) {
+			cqe = &ring.cq[ring.cq_head & (IORING_CQ_ENTRIES - 1)];
+			name = names[cqe->cqe_userdata / NBLOCKS];
+			if (cqe->cqe_res < 0) {
+				errno = -cqe->cqe_res;
+				err(1, "%s: %s", name, what);
+			}
+			if ((size_t)cqe->cqe_res != expected) {
+				errx(1, "%s: %s: short count %d", name, what,
+				     cqe->cqe_res);
+			}
+			ring.cq_head++;
+			done++;
+		}
+	}
+}
+
+static
+void
+phase(const char *what, int op, unsigned nfiles, size_t expected)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned f, b;
+
+	__time(&s0, &ns0);
+	for (f=0; f<nfiles; f++) {
+		for (b=0; b<NBLOCKS; b++) {
+			queue(op, f, b);
+			if (op == IORING_OP_FSYNC) {
+				break;
+			}
+		}
+	}
+	run(what, expected);
+	__time(&s1, &ns1);
+
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	printf("aiotest: %s: %lu.%09lu seconds\n", what,
+	       (unsigned long)(s1 - s0), ns1 - ns0);
+}
+
+/*
+ * Submit a write, fail an execv, then collect the write.
+ */
+static
+void
+test_execfail(void)
+{
+	char *args[2];
+	unsigned userdata;
+	int r;
+
+	memset(bufs[0][0], 'x', BLOCKSIZE);
+	queuefd(IORING_OP_WRITE, fds[0], 0, bufs[0][0], BLOCKSIZE, 1234);
+	submit();
+
+	args[0] = (char *)"/nonexistent/aiotest";
+	args[1] = NULL;
+	if (execv(args[0], args) == 0 || errno != ENOENT) {
+		err(1, "execv of a missing file: expected ENOENT, got");
+	}
+
+	r = reap(&userdata);
+	if (userdata != 1234) {
+		errx(1, "execv: got completion %u, expected 1234", userdata);
+	}
+	if (r < 0) {
+		errno = -r;
+		err(1, "execv: write");
+	}
+	if (r != BLOCKSIZE) {
+		errx(1, "execv: write: short count %d", r);
+	}
+	printf("aiotest: failed execv kept the request\n");
+}
+
+/*
+ * Reads and writes on a pipe could block a worker forever, so they
+ * fail with ESPIPE.
+ */
+static
+void
+test_espipe(void)
+{
+	unsigned userdata, i;
+	int p[2], r;
+
+	if (pipe(p) < 0) {
+		err(1, "pipe");
+	}
+	queuefd(IORING_OP_READ, p[0], -1, bufs[0][0], 16, 0);
+	queuefd(IORING_OP_WRITE, p[1], -1, bufs[0][1], 16, 1);
+	submit();
+	for (i=0; i<2; i++) {
+		r = reap(&userdata);
+		if (r != -ESPIPE) {
+			errx(1, "pipe %s: got %d, expected -ESPIPE",
+			     userdata ? "write" : "read", r);
+		}
+	}
+	close(p[0]);
+	close(p[1]);
+}
+
+/*
+ * Children submit a ring's worth of I/O and exit, some at once with
+ * it all in flight, some after it has had time to finish so the
+ * completions are left uncollected. Then make sure the workers are
+ * still there for us.
+ */
+static
+void
+test_exit(void)
+{
+	struct timespec ts;
+	unsigned userdata, i, b;
+	int r, status;
+	pid_t pid;
+
+	for (i=0; i<NEXITERS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			for (b=0; b<NBLOCKS; b++) {
+				queue(IORING_OP_WRITE, 0, b);
+			}
+			queuefd(IORING_OP_NOP, -1, 0, NULL, 0, 0);
+			submit();
+			if (i % 2) {
+				ts.tv_sec = 0;
+				ts.tv_nsec = 100 * 1000 * 1000;
+				(void)nanosleep(&ts, NULL);
+			}
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "exit: child %u failed", i);
+		}
+	}
+
+	queue(IORING_OP_READ, 0, 0);
+	submit();
+	r = reap(&userdata);
+	if (r != BLOCKSIZE) {
+		errx(1, "exit: read afterwards got %d", r);
+	}
+	printf("aiotest: exits with I/O in flight were harmless\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nfiles, f, b, i;
+
+	if (argc < 2 || argc > MAXFILES + 1) {
+		errx(1, "Usage: aiotest file [file...] (up to %d files)",
+		     MAXFILES);
+	}
+	nfiles = argc - 1;
+
+	for (f=0; f<nfiles; f++) {
+		names[f] = argv[f+1];
+		fds[f] = open(names[f], O_RDWR|O_CREAT|O_TRUNC, 0664);
+		if (fds[f] < 0) {
+			err(1, "%s", names[f]);
+		}
+		for (b=0; b<NBLOCKS; b++) {
+			for (i=0; i<BLOCKSIZE; i++) {
+				bufs[f][b][i] = pattern(f, b, i);
+			}
+		}
+	}
+
+	phase("write", IORING_OP_WRITE, nfiles, BLOCKSIZE);
+	phase("fsync", IORING_OP_FSYNC, nfiles, 0);
+
+	memset(bufs, 0, sizeof(bufs));
+	phase("read", IORING_OP_READ, nfiles, BLOCKSIZE);
+
+	for (f=0; f<nfiles; f++) {
+		for (b=0; b<NBLOCKS; b++) {
+			for (i=0; i<BLOCKSIZE; i++) {
+				if (bufs[f][b][i] != pattern(f, b, i)) {
+					errx(1, "%s: block %u byte %u "
+					     "is wrong", names[f], b, i);
+				}
+			}
+		}
+	}
+
+	test_execfail();
+	test_espipe();
+	test_exit();
+
+	for (f=0; f<nfiles; f++) {
+		close(fds[f]);
+	}
+
+	printf("aiotest: passed.\n");
+	return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copytest - test copy_file_range.
+ *
+ * Usage: copytest [file]
+ *
+ * Copies between two files at explicit offsets and through the seek
+ * positions, checking the data and where the positions end up; then
+ * copies within one file, where ranges that overlap have to be
+ * refused with EINVAL (through one fd or two) and ranges that don't
+ * have to work. The files default to "copytest.a" and "copytest.b"
+ * ("file.a" and "file.b" if a name is given) and are removed at the
+ * end.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DATASIZE	10000	/* more than one kernel buffer's worth */
+
+static char data[DATASIZE];
+static char back[DATASIZE];
+static char namea[64], nameb[64];
+
+static
+char
+pattern(unsigned pos)
+{
+	return (char)(pos * 11 + pos / 253);
+}
+
+static
+int
+openfile(const char *name, int flags)
+{
+	int fd;
+
+	fd = open(name, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	return fd;
+}
+
+static
+void
+expectlen(ssize_t r, size_t want, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)r != want) {
+		errx(1, "%s: %ld bytes, expected %lu", what, (long)r,
+		     (unsigned long)want);
+	}
+}
+
+static
+void
+expectpos(int fd, off_t want, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "%s: lseek", what);
+	}
+	if (pos != want) {
+		errx(1, "%s: seek position %ld, expected %ld", what,
+		     (long)pos, (long)want);
+	}
+}
+
+static
+void
+expectoff(off_t off, off_t want, const char *what)
+{
+	if (off != want) {
+		errx(1, "%s: offset came back as %ld, expected %ld", what,
+		     (long)off, (long)want);
+	}
+}
+
+static
+void
+expectinval(ssize_t r, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s: copied %ld bytes, expected EINVAL", what,
+		     (long)r);
+	}
+	if (errno != EINVAL) {
+		err(1, "%s: expected EINVAL, got", what);
+	}
+}
+
+/*
+ * Check that LEN bytes of FD at OFFSET hold the pattern from PATPOS.
+ */
+static
+void
+checkdata(int fd, off_t offset, size_t len, unsigned patpos,
+	  const char *what)
+{
+	size_t i;
+
+	expectlen(pread(fd, back, len, offset), len, what);
+	for (i=0; i<len; i++) {
+		if (back[i] != pattern(patpos + i)) {
+			errx(1, "%s: wrong data at byte %lu", what,
+			     (unsigned long)i);
+		}
+	}
+}
+
+/*
+ * Between two files.
+ */
+static
+void
+test_twofiles(void)
+{
+	off_t inoff, outoff;
+	int a, b;
+
+	a = openfile(namea, O_RDWR|O_CREAT|O_TRUNC);
+	b = openfile(nameb, O_RDWR|O_CREAT|O_TRUNC);
+	expectlen(write(a, data, DATASIZE), DATASIZE, "write");
+
+	/* explicit offsets: updated, seek positions left alone */
+	inoff = 100;
+	outoff = 50;
+	expectlen(copy_file_range(a, &inoff, b, &outoff, 6000), 6000,
+		  "copy at offsets");
+	expectoff(inoff, 6100, "copy at offsets, in");
+	expectoff(outoff, 6050, "copy at offsets, out");
+	expectpos(a, DATASIZE, "copy at offsets, in");
+	expectpos(b, 0, "copy at offsets, out");
+	checkdata(b, 50, 6000, 100, "copy at offsets");
+
+	/* seek positions, stopping short at EOF */
+	if (lseek(a, DATASIZE - 300, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	expectlen(copy_file_range(a, NULL, b, NULL, 1000), 300,
+		  "copy at seek positions");
+	expectpos(a, DATASIZE, "copy at seek positions, in");
+	expectpos(b, 300, "copy at seek positions, out");
+	checkdata(b, 0, 300, DATASIZE - 300, "copy at seek positions");
+
+	close(a);
+	close(b);
+}
+
+/*
+ * Within one file.
+ */
+static
+void
+test_samefile(void)
+{
+	off_t inoff, outoff;
+	int a, a2;
+
+	a = openfile(namea, O_RDWR|O_CREAT|O_TRUNC);
+	expectlen(write(a, data, DATASIZE), DATASIZE, "write");
+
+	/* one fd, both seek positions: refused */
+	expectinval(copy_file_range(a, NULL, a, NULL, 10),
+		    "same fd, seek positions");
+
+	/* overlapping, forwards and backwards */
+	inoff = 0;
+	outoff = 500;
+	expectinval(copy_file_range(a, &inoff, a, &outoff, 5000),
+		    "overlap forwards");
+	inoff = 500;
+	outoff = 0;
+	expectinval(copy_file_range(a, &inoff, a, &outoff, 5000),
+		    "overlap backwards");
+	inoff = 100;
+	outoff = 100;
+	expectinval(copy_file_range(a, &inoff, a, &outoff, 1),
+		    "overlap onto itself");
+
+	/* one side at the seek position, the other explicit */
+	if (lseek(a, 1000, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	outoff = 1500;
+	expectinval(copy_file_range(a, NULL, a, &outoff, 1000),
+		    "overlap with the seek position");
+	expectpos(a, 1000, "refused copy");
+
+	/* a second open of the same file is still the same file */
+	a2 = openfile(namea, O_RDWR);
+	inoff = 4000;
+	outoff = 3000;
+	expectinval(copy_file_range(a, &inoff, a2, &outoff, 2000),
+		    "overlap through two fds");
+
+	/* nothing was touched */
+	checkdata(a, 0, DATASIZE, 0, "after refused copies");
+
+	/* ranges that just touch are fine */
+	inoff = 0;
+	outoff = 5000;
+	expectlen(copy_file_range(a, &inoff, a2, &outoff, 5000), 5000,
+		  "adjacent ranges");
+	checkdata(a, 0, 5000, 0, "adjacent ranges, source");
+	checkdata(a, 5000, 5000, 0, "adjacent ranges, copy");
+
+	close(a2);
+	close(a);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *base;
+	unsigned i;
+
+	if (argc > 2) {
+		errx(1, "Usage: copytest [file]");
+	}
+	base = argc == 2 ? argv[1] : "copytest";
+	snprintf(namea, sizeof(namea), "%s.a", base);
+	snprintf(nameb, sizeof(nameb), "%s.b", base);
+
+	for (i=0; i<DATASIZE; i++) {
+		data[i] = pattern(i);
+	}
+
+	test_twofiles();
+	test_samefile();
+
+	remove(namea);
+	remove(nameb);
+	printf("copytest: passed.\n");
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fdlimit - test RLIMIT_NOFILE.
+ *
+ * Usage: fdlimit
+ *
+ * Checks the default limits, raising them to "infinity", lowering the
+ * soft limit and running into EMFILE, dup2 at and past the limit,
+ * files left open above a lowered limit, the rules for changing the
+ * hard limit, and that the limits are inherited across fork.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define LOWLIMIT	16
+#define LOWERLIMIT	8
+#define PATH		"con:"
+
+static
+void
+getlim(rlim_t *cur, rlim_t *max)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		err(1, "getrlimit");
+	}
+	*cur = rl.rlim_cur;
+	*max = rl.rlim_max;
+}
+
+static
+int
+setlim(rlim_t cur, rlim_t max)
+{
+	struct rlimit rl;
+
+	rl.rlim_cur = cur;
+	rl.rlim_max = max;
+	return setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static
+void
+checklim(const char *what, rlim_t wantcur, rlim_t wantmax)
+{
+	rlim_t cur, max;
+
+	getlim(&cur, &max);
+	if (cur != wantcur || max != wantmax) {
+		errx(1, "%s: limits are %lu/%lu, expected %lu/%lu", what,
+		     (unsigned long)cur, (unsigned long)max,
+		     (unsigned long)wantcur, (unsigned long)wantmax);
+	}
+}
+
+/*
+ * Expect a call to have failed with a particular error.
+ */
+static
+void
+expect(int r, int wanterr, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s: succeeded, expected %s", what,
+		     strerror(wanterr));
+	}
+	if (errno != wanterr) {
+		err(1, "%s: expected %s, got", what, strerror(wanterr));
+	}
+}
+
+int
+main(void)
+{
+	rlim_t cur, hardmax;
+	int fd, lastfd, nfds, status;
+	pid_t pid;
+
+	/* Defaults: OPEN_MAX soft, the table maximum hard. */
+	getlim(&cur, &hardmax);
+	if (cur != OPEN_MAX) {
+		errx(1, "default soft limit is %lu, expected %d",
+		     (unsigned long)cur, OPEN_MAX);
+	}
+	if (hardmax < OPEN_MAX) {
+		errx(1, "default hard limit %lu is below OPEN_MAX",
+		     (unsigned long)hardmax);
+	}
+
+	/* Infinity means as much as we can get. */
+	if (setlim(RLIM_INFINITY, RLIM_INFINITY) < 0) {
+		err(1, "setrlimit infinity/infinity");
+	}
+	checklim("infinity/infinity", hardmax, hardmax);
+	if (setlim(hardmax, RLIM_INFINITY) < 0) {
+		err(1, "setrlimit max/infinity");
+	}
+	checklim("max/infinity", hardmax, hardmax);
+
+	/* Soft above hard is invalid. */
+	expect(setlim(LOWLIMIT + 1, LOWLIMIT), EINVAL, "setrlimit cur > max");
+
+	/* Lower the soft limit and run out of fds. */
+	if (setlim(LOWLIMIT, hardmax) < 0) {
+		err(1, "setrlimit %d", LOWLIMIT);
+	}
+	checklim("lowered", LOWLIMIT, hardmax);
+
+	nfds = 0;
+	lastfd = -1;
+	while ((fd = open(PATH, O_RDONLY)) >= 0) {
+		if (fd >= LOWLIMIT) {
+			errx(1, "open returned fd %d past the limit", fd);
+		}
+		lastfd = fd;
+		nfds++;
+	}
+	expect(fd, EMFILE, "open past the limit");
+	if (lastfd != LOWLIMIT - 1) {
+		errx(1, "last fd opened was %d, expected %d", lastfd,
+		     LOWLIMIT - 1);
+	}
+	printf("fdlimit: opened %d files before EMFILE\n", nfds);
+
+	/* dup2 onto the last fd is fine; one past it isn't. */
+	if (dup2(STDIN_FILENO, LOWLIMIT - 1) != LOWLIMIT - 1) {
+		err(1, "dup2 to %d", LOWLIMIT - 1);
+	}
+	expect(dup2(STDIN_FILENO, LOWLIMIT), EBADF, "dup2 to the limit");
+	expect(dup2(STDIN_FILENO, LOWLIMIT + 5), EBADF, "dup2 past the limit");
+
+	/*
+	 * Lower the limit below open files. They stay open and can be
+	 * closed, but can't be made again with dup2.
+	 */
+	if (setlim(LOWERLIMIT, hardmax) < 0) {
+		err(1, "setrlimit %d", LOWERLIMIT);
+	}
+	if (close(LOWLIMIT - 1) < 0) {
+		err(1, "close of fd %d above the limit", LOWLIMIT - 1);
+	}
+	expect(dup2(STDIN_FILENO, LOWLIMIT - 1), EBADF,
+	       "dup2 above a lowered limit");
+	for (fd = 3; fd < LOWLIMIT - 1; fd++) {
+		if (close(fd) < 0) {
+			err(1, "close %d", fd);
+		}
+	}
+
+	/* The hard limit can come down, but not go back up. */
+	if (setlim(LOWERLIMIT, LOWLIMIT) < 0) {
+		err(1, "setrlimit lowering the hard limit");
+	}
+	checklim("hard lowered", LOWERLIMIT, LOWLIMIT);
+	expect(setlim(LOWERLIMIT, LOWLIMIT + 1), EPERM,
+	       "setrlimit raising the hard limit");
+	if (setlim(LOWLIMIT, LOWLIMIT) < 0) {
+		err(1, "setrlimit raising the soft limit to the hard limit");
+	}
+
+	/* Children inherit the limits. */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		checklim("in child", LOWLIMIT, LOWLIMIT);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child failed");
+	}
+
+	printf("fdlimit: passed.\n");
+	return 0;
+}
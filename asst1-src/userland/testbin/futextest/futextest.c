@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest - test futex() and the libsync mutexes and condition
+ * variables.
+ *
+ * Usage: futextest
+ *
+ * Checks that FUTEX_WAIT with a value that's already stale fails with
+ * EAGAIN at once instead of sleeping, that FUTEX_WAKE with nobody
+ * waiting wakes nobody, and that bad arguments are refused. Then runs
+ * umutex through its fast paths and through the contended unlock,
+ * which has to go to the kernel with FUTEX_WAKE, and the ucond signal
+ * paths.
+ *
+ * There are no user threads and no shared memory, so nothing else can
+ * ever be sleeping on one of our words; the contended state is set up
+ * by hand the way a second locker's slow path would leave it.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <sync/umutex.h>
+#include <sync/ucond.h>
+
+#define NLOOPS		1000
+
+static volatile int word;
+static struct umutex mutex = UMUTEX_INITIALIZER;
+static struct ucond cond;
+
+static
+void
+expecterr(int r, int wanterr, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s: returned %d, expected an error", what, r);
+	}
+	if (errno != wanterr) {
+		err(1, "%s: wrong error", what);
+	}
+}
+
+static
+void
+expectwoken(int r, int want, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if (r != want) {
+		errx(1, "%s: woke %d, expected %d", what, r, want);
+	}
+}
+
+static
+void
+expectstate(int want, const char *what)
+{
+	if (mutex.m_state != want) {
+		errx(1, "%s: mutex state %d, expected %d", what,
+		     mutex.m_state, want);
+	}
+}
+
+/*
+ * The raw system call.
+ */
+static
+void
+test_futex(void)
+{
+	volatile int *misaligned;
+	int i;
+
+	/* a stale value must come straight back, every time */
+	word = 5;
+	for (i=0; i<NLOOPS; i++) {
+		expecterr(futex(&word, FUTEX_WAIT, 4), EAGAIN,
+			  "FUTEX_WAIT, stale value");
+	}
+
+	/* nobody is waiting */
+	expectwoken(futex(&word, FUTEX_WAKE, 1), 0, "FUTEX_WAKE");
+	expectwoken(futex(&word, FUTEX_WAKE, 0x7fffffff), 0,
+		    "FUTEX_WAKE, everybody");
+
+	/* bad arguments */
+	misaligned = (volatile int *)((char *)&word + 1);
+	expecterr(futex(misaligned, FUTEX_WAIT, 5), EINVAL,
+		  "FUTEX_WAIT, misaligned");
+	expecterr(futex(&word, FUTEX_WAKE, -1), EINVAL,
+		  "FUTEX_WAKE, negative count");
+	expecterr(futex(&word, 99, 0), EINVAL, "bad op");
+	expecterr(futex(NULL, FUTEX_WAIT, 0), EFAULT, "FUTEX_WAIT on NULL");
+}
+
+static
+void
+test_umutex(void)
+{
+	int i;
+
+	/* uncontended: never leaves 0 and 1 */
+	for (i=0; i<NLOOPS; i++) {
+		umutex_lock(&mutex);
+		expectstate(1, "lock");
+		umutex_unlock(&mutex);
+		expectstate(0, "unlock");
+	}
+
+	/* trylock gets a free mutex but not a held one */
+	if (!umutex_trylock(&mutex)) {
+		errx(1, "trylock failed on a free mutex");
+	}
+	expectstate(1, "trylock");
+	if (umutex_trylock(&mutex)) {
+		errx(1, "trylock succeeded on a held mutex");
+	}
+	expectstate(1, "failed trylock");
+
+	/*
+	 * Contended: a second locker would have marked it 2 before
+	 * going to sleep, so unlock has to call FUTEX_WAKE. It must
+	 * still come back free, and take the fast path next time.
+	 */
+	for (i=0; i<NLOOPS; i++) {
+		mutex.m_state = 2;
+		umutex_unlock(&mutex);
+		expectstate(0, "contended unlock");
+		umutex_lock(&mutex);
+		expectstate(1, "lock after contended unlock");
+	}
+	if (umutex_trylock(&mutex)) {
+		errx(1, "trylock succeeded on a held mutex");
+	}
+	umutex_unlock(&mutex);
+	expectstate(0, "unlock");
+}
+
+static
+void
+test_ucond(void)
+{
+	int seq;
+
+	ucond_init(&cond);
+	umutex_lock(&mutex);
+
+	/* with no waiters, signals don't touch the sequence number */
+	seq = cond.c_seq;
+	ucond_signal(&cond, &mutex);
+	ucond_broadcast(&cond, &mutex);
+	if (cond.c_seq != seq) {
+		errx(1, "ucond: signal with no waiters changed c_seq");
+	}
+
+	/*
+	 * With a waiter recorded the number moves on, so a waiter that
+	 * hadn't got to sleep yet would see a stale value and not sleep.
+	 */
+	cond.c_waiters = 1;
+	ucond_signal(&cond, &mutex);
+	if (cond.c_seq == seq) {
+		errx(1, "ucond: signal didn't change c_seq");
+	}
+	expecterr(futex(&cond.c_seq, FUTEX_WAIT, seq), EAGAIN,
+		  "FUTEX_WAIT on c_seq after signal");
+	seq = cond.c_seq;
+	ucond_broadcast(&cond, &mutex);
+	expecterr(futex(&cond.c_seq, FUTEX_WAIT, seq), EAGAIN,
+		  "FUTEX_WAIT on c_seq after broadcast");
+	cond.c_waiters = 0;
+
+	umutex_unlock(&mutex);
+	expectstate(0, "unlock");
+}
+
+int
+main(void)
+{
+	test_futex();
+	test_umutex();
+	test_ucond();
+
+	printf("futextest: passed.\n");
+	return 0;
+}
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest - test readv and writev, and pread and pwrite.
+ *
+ * Usage: iovtest [file]
+ *
+ * Writes with several iovecs and reads back with a different split,
+ * checking the pieces come out in order; tries iovec counts that are
+ * out of range, and counts big enough that the kernel can't keep the
+ * array on its stack; and has several processes writev records to one
+ * shared O_APPEND file at once, checking none of them are torn or
+ * lost. Then checks that pread and pwrite go where they're told,
+ * leave the seek position alone, and refuse negative offsets and
+ * pipes. The file defaults to "iovtest.dat" and is removed at the end.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DATASIZE	4096
+#define NWRITERS	4
+#define NRECORDS	32	/* per writer */
+#define RECBODY		200	/* record body size */
+
+static struct iovec iov[IOV_MAX + 1];
+static char data[DATASIZE];
+static char back[DATASIZE];
+static const char *path = "iovtest.dat";
+
+static
+char
+pattern(unsigned pos)
+{
+	return (char)(pos * 13 + pos / 251);
+}
+
+static
+int
+openfile(int flags)
+{
+	int fd;
+
+	fd = open(path, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	return fd;
+}
+
+static
+void
+xclose(int fd)
+{
+	if (close(fd) < 0) {
+		err(1, "close");
+	}
+}
+
+/*
+ * Point NIOV iovecs at consecutive pieces of BUF, with lengths from
+ * LENS (cycled through; a 0 makes an empty iovec). Returns how many
+ * bytes they cover.
+ */
+static
+size_t
+setup(char *buf, int niov, const size_t *lens, unsigned nlens)
+{
+	size_t pos;
+	int i;
+
+	pos = 0;
+	for (i=0; i<niov; i++) {
+		iov[i].iov_base = buf + pos;
+		iov[i].iov_len = lens[i % nlens];
+		pos += iov[i].iov_len;
+	}
+	return pos;
+}
+
+static
+void
+expectlen(ssize_t r, size_t want, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)r != want) {
+		errx(1, "%s: transferred %ld bytes, expected %lu", what,
+		     (long)r, (unsigned long)want);
+	}
+}
+
+static
+void
+checkback(size_t len, const char *what)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (back[i] != pattern(i)) {
+			errx(1, "%s: wrong data at byte %lu", what,
+			     (unsigned long)i);
+		}
+	}
+}
+
+/*
+ * Write with one split, read back with another.
+ */
+static
+void
+test_order(int niov_w, const size_t *wlens, unsigned nwlens,
+	   int niov_r, const size_t *rlens, unsigned nrlens,
+	   const char *what)
+{
+	size_t len, rlen;
+	int fd;
+
+	len = setup(data, niov_w, wlens, nwlens);
+	fd = openfile(O_RDWR|O_CREAT|O_TRUNC);
+	expectlen(writev(fd, iov, niov_w), len, what);
+	xclose(fd);
+
+	memset(back, 0, sizeof(back));
+	rlen = setup(back, niov_r, rlens, nrlens);
+	if (rlen < len) {
+		errx(1, "%s: read iovecs too short", what);
+	}
+	fd = openfile(O_RDONLY);
+	expectlen(readv(fd, iov, niov_r), len, what);
+	xclose(fd);
+	checkback(len, what);
+}
+
+static
+void
+test_orders(void)
+{
+	static const size_t w3[] = { 100, 1, 400 };
+	static const size_t r2[] = { 7, 300 };
+	static const size_t w1[] = { 1 };
+	static const size_t r1[] = { 3 };
+	static const size_t wz[] = { 10, 0, 0, 25 };
+	static const size_t rbig[] = { DATASIZE };
+	static const size_t wodd[] = { 1, 2, 3 };
+	static const size_t rodd[] = { 5 };
+
+	/* a few iovecs, which the kernel keeps on its stack */
+	test_order(3, w3, 3, 4, r2, 2, "3 iovecs");
+	/* empty iovecs in the middle are skipped over */
+	test_order(4, wz, 4, 1, rbig, 1, "empty iovecs");
+	/* more than fit on the kernel stack */
+	test_order(20, wodd, 3, 9, rodd, 1, "20 iovecs");
+	test_order(300, w1, 1, 100, r1, 1, "300 iovecs");
+	/* the most allowed */
+	test_order(IOV_MAX, w1, 1, IOV_MAX, w1, 1, "IOV_MAX iovecs");
+}
+
+/*
+ * Bad iovec counts.
+ */
+static
+void
+expectinval(ssize_t r, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s: succeeded, expected EINVAL", what);
+	}
+	if (errno != EINVAL) {
+		err(1, "%s: expected EINVAL, got", what);
+	}
+}
+
+static
+void
+test_badcounts(void)
+{
+	static const size_t one[] = { 1 };
+	int fd;
+
+	setup(data, IOV_MAX + 1, one, 1);
+	fd = openfile(O_RDWR|O_CREAT|O_TRUNC);
+	expectinval(writev(fd, iov, 0), "writev, 0 iovecs");
+	expectinval(writev(fd, iov, -1), "writev, -1 iovecs");
+	expectinval(writev(fd, iov, IOV_MAX + 1), "writev, IOV_MAX+1 iovecs");
+	expectinval(readv(fd, iov, 0), "readv, 0 iovecs");
+	expectinval(readv(fd, iov, -1), "readv, -1 iovecs");
+	expectinval(readv(fd, iov, IOV_MAX + 1), "readv, IOV_MAX+1 iovecs");
+	xclose(fd);
+}
+
+/*
+ * Each record is a header line naming the writer and record number,
+ * then a body of the writer's letter, written as two iovecs. With
+ * all the writers sharing one O_APPEND openfile, every record has to
+ * land whole.
+ */
+static
+void
+test_append(void)
+{
+	char head[16], body[RECBODY], rec[16 + RECBODY];
+	struct iovec riov[2];
+	unsigned seen[NWRITERS][NRECORDS];
+	pid_t pids[NWRITERS];
+	int fd, i, j, w, n, status;
+	size_t headlen, reclen;
+	ssize_t r;
+
+	fd = openfile(O_WRONLY|O_CREAT|O_TRUNC|O_APPEND);
+	for (i=0; i<NWRITERS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			memset(body, 'a' + i, sizeof(body));
+			for (j=0; j<NRECORDS; j++) {
+				snprintf(head, sizeof(head), "%d %03d\n", i, j);
+				riov[0].iov_base = head;
+				riov[0].iov_len = strlen(head);
+				riov[1].iov_base = body;
+				riov[1].iov_len = sizeof(body);
+				expectlen(writev(fd, riov, 2),
+					  riov[0].iov_len + sizeof(body),
+					  "append writev");
+			}
+			_exit(0);
+		}
+	}
+	for (i=0; i<NWRITERS; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "append: writer %d failed", i);
+		}
+	}
+	xclose(fd);
+
+	/* every header is "w nnn\n", 6 bytes */
+	headlen = 6;
+	reclen = headlen + RECBODY;
+	memset(seen, 0, sizeof(seen));
+	fd = openfile(O_RDONLY);
+	for (n=0; n<NWRITERS * NRECORDS; n++) {
+		r = read(fd, rec, reclen);
+		expectlen(r, reclen, "append read");
+		if (rec[1] != ' ' || rec[5] != '\n') {
+			errx(1, "append: record %d: bad header", n);
+		}
+		w = rec[0] - '0';
+		j = (rec[2] - '0') * 100 + (rec[3] - '0') * 10 + rec[4] - '0';
+		if (w < 0 || w >= NWRITERS || j < 0 || j >= NRECORDS) {
+			errx(1, "append: record %d: bad header", n);
+		}
+		for (i=0; i<RECBODY; i++) {
+			if (rec[headlen + i] != 'a' + w) {
+				errx(1, "append: record %d (writer %d, "
+				     "number %d) is torn", n, w, j);
+			}
+		}
+		seen[w][j]++;
+	}
+	r = read(fd, rec, 1);
+	expectlen(r, 0, "append read at EOF");
+	xclose(fd);
+
+	for (w=0; w<NWRITERS; w++) {
+		for (j=0; j<NRECORDS; j++) {
+			if (seen[w][j] != 1) {
+				errx(1, "append: writer %d record %d "
+				     "appears %u times", w, j, seen[w][j]);
+			}
+		}
+	}
+}
+
+static
+void
+expecterr(ssize_t r, int wanterr, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s: succeeded, expected %s", what,
+		     strerror(wanterr));
+	}
+	if (errno != wanterr) {
+		err(1, "%s: expected %s, got", what, strerror(wanterr));
+	}
+}
+
+static
+void
+expectpos(int fd, off_t want, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "%s: lseek", what);
+	}
+	if (pos != want) {
+		errx(1, "%s: seek position is %ld, expected %ld", what,
+		     (long)pos, (long)want);
+	}
+}
+
+/*
+ * pread and pwrite use the offset they're given and don't move the
+ * seek position, even on an O_APPEND file.
+ */
+static
+void
+test_pio(void)
+{
+	int fd, fds[2];
+
+	fd = openfile(O_RDWR|O_CREAT|O_TRUNC);
+	expectlen(write(fd, data, 100), 100, "write");
+	expectpos(fd, 100, "write");
+
+	/* write past the end and in the middle, then read it back */
+	expectlen(pwrite(fd, data + 1000, 50, 1000), 50, "pwrite");
+	expectpos(fd, 100, "pwrite");
+	expectlen(pwrite(fd, data + 40, 20, 40), 20, "pwrite");
+	expectpos(fd, 100, "pwrite");
+
+	memset(back, 0, sizeof(back));
+	expectlen(pread(fd, back + 1000, 50, 1000), 50, "pread");
+	expectlen(pread(fd, back, 100, 0), 100, "pread");
+	expectpos(fd, 100, "pread");
+	checkback(100, "pread");
+	if (memcmp(back + 1000, data + 1000, 50)) {
+		errx(1, "pread: wrong data at offset 1000");
+	}
+
+	/* the ordinary write carries on from where it was */
+	expectlen(write(fd, data + 100, 10), 10, "write");
+	expectpos(fd, 110, "write after pwrite");
+
+	/* pread at or past EOF reads nothing */
+	expectlen(pread(fd, back, 10, 1050), 0, "pread at EOF");
+	expectlen(pread(fd, back, 10, 5000), 0, "pread past EOF");
+
+	expecterr(pread(fd, back, 10, -1), EINVAL, "pread at -1");
+	expecterr(pwrite(fd, data, 10, -1), EINVAL, "pwrite at -1");
+	expectpos(fd, 110, "failed pread/pwrite");
+	xclose(fd);
+
+	/* O_APPEND doesn't apply to pwrite */
+	fd = openfile(O_RDWR|O_APPEND);
+	expectlen(pwrite(fd, data + 200, 10, 200), 10, "append pwrite");
+	expectpos(fd, 0, "append pwrite");
+	expectlen(pread(fd, back + 200, 10, 200), 10, "append pread");
+	if (memcmp(back + 200, data + 200, 10)) {
+		errx(1, "append pwrite: wrong data at offset 200");
+	}
+	xclose(fd);
+
+	/* pipes can't be positioned */
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	expecterr(pwrite(fds[1], data, 10, 0), ESPIPE, "pwrite on a pipe");
+	expecterr(pread(fds[0], back, 10, 0), ESPIPE, "pread on a pipe");
+	xclose(fds[0]);
+	xclose(fds[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+
+	if (argc > 2) {
+		errx(1, "Usage: iovtest [file]");
+	}
+	if (argc == 2) {
+		path = argv[1];
+	}
+
+	for (i=0; i<DATASIZE; i++) {
+		data[i] = pattern(i);
+	}
+
+	test_orders();
+	test_badcounts();
+	test_append();
+	test_pio();
+
+	if (remove(path) < 0) {
+		err(1, "remove %s", path);
+	}
+	printf("iovtest: passed.\n");
+	return 0;
+}
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipetest - test pipe().
+ *
+ * Usage: pipetest
+ *
+ * Checks EOF once every write end is closed, EPIPE once the read end
+ * is, that writes of up to the pipe size come out in one piece with
+ * several writers going at once, reads that are already waiting when
+ * the data arrives (the direct handoff path), and pipe ends passed
+ * to a child by fork and dup2.
+ *
+ * The pipe size is taken from st_blksize.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXSIZE		16384	/* largest pipe size we cope with */
+#define NWRITERS	4
+#define NWRITES		8	/* per writer */
+#define EXTRAFD		20	/* spare fd for dup2 */
+
+static char buf[3 * MAXSIZE];
+static char buf2[3 * MAXSIZE];
+static size_t pipesize;
+
+static
+void
+mkpipe(int fds[2])
+{
+	struct stat st;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (pipesize == 0) {
+		if (fstat(fds[0], &st) < 0) {
+			err(1, "fstat");
+		}
+		pipesize = st.st_blksize;
+		if (pipesize == 0 || pipesize > MAXSIZE) {
+			errx(1, "pipe size %lu is out of range",
+			     (unsigned long)pipesize);
+		}
+	}
+}
+
+static
+void
+xclose(int fd)
+{
+	if (close(fd) < 0) {
+		err(1, "close %d", fd);
+	}
+}
+
+static
+pid_t
+xfork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+static
+void
+xwait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child %d failed", pid);
+	}
+}
+
+/*
+ * Give the other process time to get into read() and block.
+ */
+static
+void
+snooze(void)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200 * 1000 * 1000;
+	(void)nanosleep(&ts, NULL);
+}
+
+static
+void
+xwrite(int fd, const char *p, size_t len)
+{
+	ssize_t r;
+
+	r = write(fd, p, len);
+	if (r < 0) {
+		err(1, "write");
+	}
+	if ((size_t)r != len) {
+		errx(1, "short write: %ld of %lu", (long)r,
+		     (unsigned long)len);
+	}
+}
+
+/*
+ * Read exactly LEN bytes, in however many pieces they come.
+ */
+static
+void
+readall(int fd, char *p, size_t len)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		r = read(fd, p, len);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			errx(1, "unexpected EOF with %lu bytes to go",
+			     (unsigned long)len);
+		}
+		p += r;
+		len -= r;
+	}
+}
+
+static
+void
+expecteof(int fd, const char *what)
+{
+	char c;
+	ssize_t r;
+
+	r = read(fd, &c, 1);
+	if (r < 0) {
+		err(1, "%s: read", what);
+	}
+	if (r != 0) {
+		errx(1, "%s: got data instead of EOF", what);
+	}
+}
+
+static
+void
+fill(char *p, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = (char)(seed + i * 7);
+	}
+}
+
+static
+void
+check(const char *p, size_t len, unsigned seed, const char *what)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (p[i] != (char)(seed + i * 7)) {
+			errx(1, "%s: wrong data at byte %lu", what,
+			     (unsigned long)i);
+		}
+	}
+}
+
+/*
+ * Data written before the write end closes can still be read, then
+ * read returns 0. A write end held by someone else keeps it open.
+ */
+static
+void
+test_eof(void)
+{
+	int fds[2];
+
+	mkpipe(fds);
+	if (dup2(fds[1], EXTRAFD) < 0) {
+		err(1, "dup2");
+	}
+	fill(buf, 100, 1);
+	xwrite(fds[1], buf, 50);
+	xclose(fds[1]);
+	xwrite(EXTRAFD, buf + 50, 50);
+	xclose(EXTRAFD);
+
+	readall(fds[0], buf2, 100);
+	check(buf2, 100, 1, "eof");
+	expecteof(fds[0], "eof");
+	expecteof(fds[0], "eof again");
+	xclose(fds[0]);
+}
+
+/*
+ * A reader asleep in read() wakes up with EOF when the writer exits.
+ */
+static
+void
+test_eof_wakeup(void)
+{
+	int fds[2];
+	pid_t pid;
+
+	mkpipe(fds);
+	pid = xfork();
+	if (pid == 0) {
+		xclose(fds[0]);
+		snooze();
+		_exit(0);
+	}
+	xclose(fds[1]);
+	expecteof(fds[0], "eof wakeup");
+	xclose(fds[0]);
+	xwait(pid);
+}
+
+/*
+ * Writing with the read end gone fails with EPIPE, whether it was
+ * gone already or goes away while the writer is waiting for room.
+ */
+static
+void
+test_epipe(void)
+{
+	int fds[2];
+	pid_t pid;
+	ssize_t r;
+
+	mkpipe(fds);
+	xclose(fds[0]);
+	r = write(fds[1], "x", 1);
+	if (r >= 0) {
+		errx(1, "epipe: write succeeded");
+	}
+	if (errno != EPIPE) {
+		err(1, "epipe: expected EPIPE, got");
+	}
+	xclose(fds[1]);
+
+	mkpipe(fds);
+	pid = xfork();
+	if (pid == 0) {
+		xclose(fds[1]);
+		snooze();
+		_exit(0);
+	}
+	xclose(fds[0]);
+	/* fill it, then block for room until the child exits */
+	fill(buf, pipesize, 2);
+	xwrite(fds[1], buf, pipesize);
+	r = write(fds[1], buf, pipesize);
+	if (r >= 0) {
+		errx(1, "epipe: blocked write returned %ld", (long)r);
+	}
+	if (errno != EPIPE) {
+		err(1, "epipe: blocked write: expected EPIPE, got");
+	}
+	xclose(fds[1]);
+	xwait(pid);
+}
+
+/*
+ * Several children write whole pipe-sized blocks of their own byte
+ * at once. Every block has to come out in one piece.
+ */
+static
+void
+test_atomic(void)
+{
+	int fds[2], i, j;
+	unsigned counts[NWRITERS];
+	pid_t pids[NWRITERS];
+	size_t k;
+	char c;
+
+	mkpipe(fds);
+	for (i=0; i<NWRITERS; i++) {
+		pids[i] = xfork();
+		if (pids[i] == 0) {
+			xclose(fds[0]);
+			memset(buf, 'a' + i, pipesize);
+			for (j=0; j<NWRITES; j++) {
+				xwrite(fds[1], buf, pipesize);
+			}
+			_exit(0);
+		}
+	}
+	xclose(fds[1]);
+
+	for (i=0; i<NWRITERS; i++) {
+		counts[i] = 0;
+	}
+	for (i=0; i<NWRITERS * NWRITES; i++) {
+		readall(fds[0], buf2, pipesize);
+		c = buf2[0];
+		if (c < 'a' || c >= 'a' + NWRITERS) {
+			errx(1, "atomic: block %d: bad byte 0x%x", i, c);
+		}
+		for (k=1; k<pipesize; k++) {
+			if (buf2[k] != c) {
+				errx(1, "atomic: block %d from writer %d "
+				     "was split at byte %lu", i, c - 'a',
+				     (unsigned long)k);
+			}
+		}
+		counts[c - 'a']++;
+	}
+	expecteof(fds[0], "atomic");
+	xclose(fds[0]);
+
+	for (i=0; i<NWRITERS; i++) {
+		xwait(pids[i]);
+		if (counts[i] != NWRITES) {
+			errx(1, "atomic: got %u blocks from writer %d, "
+			     "expected %d", counts[i], i, NWRITES);
+		}
+	}
+}
+
+/*
+ * The reader is already waiting when the data is written, so the
+ * writer hands it over in the reader's lent buffer: a write that
+ * fits, a write bigger than the read (which has to go through the
+ * ring instead), and a write bigger than the pipe, which goes partly
+ * to the lent buffer and partly through the ring.
+ */
+static
+void
+test_handoff(void)
+{
+	int fds[2];
+	pid_t pid;
+	ssize_t r;
+	size_t big;
+
+	big = 2 * pipesize + 100;
+
+	mkpipe(fds);
+	pid = xfork();
+	if (pid == 0) {
+		xclose(fds[0]);
+		snooze();
+		fill(buf, 60, 3);
+		xwrite(fds[1], buf, 60);
+		snooze();
+		fill(buf, 100, 4);
+		xwrite(fds[1], buf, 100);
+		snooze();
+		fill(buf, big, 5);
+		xwrite(fds[1], buf, big);
+		_exit(0);
+	}
+	xclose(fds[1]);
+
+	/* a 60-byte write into a waiting 100-byte read */
+	r = read(fds[0], buf2, 100);
+	if (r < 0) {
+		err(1, "handoff: read");
+	}
+	if (r != 60) {
+		errx(1, "handoff: read %ld bytes, expected 60", (long)r);
+	}
+	check(buf2, 60, 3, "handoff");
+
+	/* a 100-byte write into a waiting 10-byte read */
+	readall(fds[0], buf2, 10);
+	readall(fds[0], buf2 + 10, 90);
+	check(buf2, 100, 4, "handoff, small read");
+
+	/* more than the pipe holds */
+	readall(fds[0], buf2, big);
+	check(buf2, big, 5, "handoff, big write");
+
+	expecteof(fds[0], "handoff");
+	xclose(fds[0]);
+	xwait(pid);
+}
+
+/*
+ * A child gets the write end as its stdout with dup2, and writes
+ * through that; the parent's copy of the write end has to be closed
+ * too before the parent sees EOF.
+ */
+static
+void
+test_inherit(void)
+{
+	int fds[2];
+	pid_t pid;
+
+	mkpipe(fds);
+	pid = xfork();
+	if (pid == 0) {
+		xclose(fds[0]);
+		if (dup2(fds[1], STDOUT_FILENO) < 0) {
+			err(1, "dup2");
+		}
+		xclose(fds[1]);
+		fill(buf, 1000, 6);
+		xwrite(STDOUT_FILENO, buf, 1000);
+		_exit(0);
+	}
+
+	/* the child inherited the read end too; ours still works */
+	readall(fds[0], buf2, 1000);
+	check(buf2, 1000, 6, "inherit");
+	xwait(pid);
+
+	/* our write end is still open, so no EOF yet */
+	xwrite(fds[1], "z", 1);
+	readall(fds[0], buf2, 1);
+	xclose(fds[1]);
+	expecteof(fds[0], "inherit");
+	xclose(fds[0]);
+}
+
+int
+main(void)
+{
+	test_eof();
+	test_eof_wakeup();
+	test_epipe();
+	test_atomic();
+	test_handoff();
+	test_inherit();
+
+	printf("pipetest: passed.\n");
+	return 0;
+}